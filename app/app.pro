@@ -24,7 +24,13 @@ SOURCES += main.cpp\
     rulebar.cpp \
     drawview.cpp \
     commands.cpp \
-    document.cpp
+    document.cpp \
+    documentloader.cpp \
+    documentwriter.cpp \
+    tilecache.cpp \
+    shapeindex.cpp \
+    snapengine.cpp \
+    tilerenderer.cpp
 
 HEADERS  += mainwindow.h \
     drawobj.h \
@@ -36,7 +42,13 @@ HEADERS  += mainwindow.h \
     rulebar.h \
     drawview.h \
     commands.h \
-    document.h
+    document.h \
+    documentloader.h \
+    documentwriter.h \
+    tilecache.h \
+    shapeindex.h \
+    snapengine.h \
+    tilerenderer.h
 
 RESOURCES += \
     app.qrc
@@ -1,21 +1,138 @@
 #include "commands.h"
+#include <QDateTime>
 #include <QDebug>
+
+// rough heap use of a command and of a shape kept alive by one
+static const qint64 CommandCost = 128;
+static const qint64 ShapeCost = 1024;
+// moves of the same shapes closer together than this become one step
+static const qint64 MergeInterval = 1000;
+
+static QList<QGraphicsItem *> selectedShapes( QGraphicsScene * scene )
+{
+    DrawScene * drawScene = dynamic_cast<DrawScene*>(scene);
+    return drawScene ? drawScene->selectedShapes() : scene->selectedItems();
+}
+
+// the first redo of a command comes after the edit, so both directions
+// record the shape for the next incremental save
+static void markChanged( QGraphicsItem * item )
+{
+    DrawScene * drawScene = item ? qobject_cast<DrawScene*>(item->scene()) : NULL;
+    if ( drawScene )
+        drawScene->markShapeChanged(item);
+}
+
+static void markChanged( const QList<QGraphicsItem *> & items )
+{
+    foreach (QGraphicsItem *item, items) {
+        markChanged(item);
+    }
+}
+
+// children cover the shapes of a group
+static qint64 shapeCost( QGraphicsItem * item )
+{
+    qint64 cost = ShapeCost;
+    foreach (QGraphicsItem *child, item->childItems()) {
+        cost += shapeCost(child);
+    }
+    return cost;
+}
+
+static qint64 listCost( const QList<QGraphicsItem *> & items )
+{
+    return items.size() * qint64(sizeof(QGraphicsItem*));
+}
+
+qint64 DrawCommand::memoryCost() const
+{
+    return CommandCost + text().size() * qint64(sizeof(QChar));
+}
+
+UndoStack::UndoStack(QObject *parent)
+    :QUndoStack(parent)
+    ,m_budget(0)
+    ,m_used(0)
+    ,m_dropping(false)
+{
+    connect(this,SIGNAL(indexChanged(int)),this,SLOT(enforceBudget()));
+}
+
+void UndoStack::setMemoryBudget(qint64 bytes)
+{
+    m_budget = bytes;
+    enforceBudget();
+}
+
+// the stack deletes commands on its own when they merge, are undone and
+// pushed over or fall off the undo limit, so the sum is taken again. new
+// and merged commands only ever show up on top, the costs of the others
+// are the ones they had there
+void UndoStack::enforceBudget()
+{
+    if ( m_dropping )
+        return;
+    // undoing the oldest live step leaves only discarded ones to undo. they
+    // go at once rather than with one undo each that changes nothing
+    m_dropping = true;
+    while ( index() > 0 && command(index() - 1)->isObsolete() )
+        undo();
+    m_dropping = false;
+
+    QHash<const QUndoCommand*,qint64> costs;
+    costs.reserve(count());
+    m_used = 0;
+    for ( int i = 0 ; i < count() ; ++i ){
+        const QUndoCommand * cmd = command(i);
+        QHash<const QUndoCommand*,qint64>::const_iterator it = m_costs.constFind(cmd);
+        qint64 cost = 0;
+        if ( it != m_costs.constEnd() && i < count() - 1 ){
+            cost = it.value();
+        }else{
+            const DrawCommand * drawCommand = dynamic_cast<const DrawCommand*>(cmd);
+            cost = drawCommand ? drawCommand->memoryCost() : 0;
+        }
+        costs.insert(cmd,cost);
+        if ( !cmd->isObsolete() )
+            m_used += cost;
+    }
+    m_costs.swap(costs);
+    if ( m_budget <= 0 )
+        return;
+
+    // oldest first, so the obsolete commands stay below the live ones. the
+    // newest done command and the ones to redo are kept
+    for ( int i = 0 ; m_used > m_budget && i < index() - 1 ; ++i ){
+        QUndoCommand * cmd = const_cast<QUndoCommand*>(command(i));
+        if ( cmd->isObsolete() )
+            continue;
+        DrawCommand * drawCommand = dynamic_cast<DrawCommand*>(cmd);
+        if ( drawCommand )
+            drawCommand->release();
+        m_used -= m_costs.value(cmd);
+        cmd->setObsolete(true);
+        cmd->setText(tr("%1 (discarded)").arg(cmd->text()));
+    }
+}
 MoveShapeCommand::MoveShapeCommand(QGraphicsScene *graphicsScene, const QPointF &delta, QUndoCommand *parent)
-    : QUndoCommand(parent)
+    : DrawCommand(parent)
 {
     myItem = 0;
-    myItems = graphicsScene->selectedItems();
+    myItems = selectedShapes(graphicsScene);
     myGraphicsScene = graphicsScene;
     myDelta = delta;
+    myTime = QDateTime::currentMSecsSinceEpoch();
     bMoved = true;
 }
 
 MoveShapeCommand::MoveShapeCommand(QGraphicsItem * item, const QPointF &delta, QUndoCommand *parent)
-    : QUndoCommand(parent)
+    : DrawCommand(parent)
 {
     myGraphicsScene = 0;
     myItem = item;
     myDelta = delta;
+    myTime = QDateTime::currentMSecsSinceEpoch();
     bMoved = true;
 }
 
@@ -29,6 +146,8 @@ void MoveShapeCommand::undo()
            item->moveBy(-myDelta.x(),-myDelta.y());
         }
     }
+    markChanged(myItem);
+    markChanged(myItems);
     setText(QObject::tr("Undo Move %1,%2")
         .arg(-myDelta.x()).arg(-myDelta.y()));
     bMoved = false;
@@ -49,21 +168,80 @@ void MoveShapeCommand::redo()
             myGraphicsScene->update();
         }
     }
+    markChanged(myItem);
+    markChanged(myItems);
     setText(QObject::tr("Redo Move %1,%2")
         .arg(myDelta.x()).arg(myDelta.y()));
 }
+
+bool MoveShapeCommand::mergeWith(const QUndoCommand *command)
+{
+    if (command->id() != MoveShapeCommand::Id )
+        return false;
+
+    const MoveShapeCommand *cmd = static_cast<const MoveShapeCommand *>(command);
+    if ( cmd->myTime - myTime > MergeInterval )
+        return false;
+    if ( cmd->myItem != myItem || cmd->myGraphicsScene != myGraphicsScene ||
+         cmd->myItems != myItems )
+        return false;
+
+    myDelta += cmd->myDelta;
+    myTime = cmd->myTime;
+    // moved back to where they were, the stack drops the step
+    if ( myDelta.isNull() )
+        setObsolete(true);
+    setText(QObject::tr("Redo Move %1,%2")
+        .arg(myDelta.x()).arg(myDelta.y()));
+    return true;
+}
+
+qint64 MoveShapeCommand::memoryCost() const
+{
+    return DrawCommand::memoryCost() + listCost(myItems);
+}
+
+void MoveShapeCommand::release()
+{
+    myItem = 0;
+    myItems.clear();
+}
 //! [3]
 //! [4]
 RemoveShapeCommand::RemoveShapeCommand(QGraphicsScene *scene, QUndoCommand *parent)
-    : QUndoCommand(parent)
+    : DrawCommand(parent)
 {
     myGraphicsScene = scene;
-    items = myGraphicsScene->selectedItems();
+    items = selectedShapes(myGraphicsScene);
+    b_removed = false;
 }
 
 RemoveShapeCommand::~RemoveShapeCommand()
 {
+    release();
+}
+
+qint64 RemoveShapeCommand::memoryCost() const
+{
+    qint64 cost = DrawCommand::memoryCost() + listCost(items);
+    if ( b_removed ){
+        foreach (QGraphicsItem *item, items) {
+            cost += shapeCost(item);
+        }
+    }
+    return cost;
+}
 
+void RemoveShapeCommand::release()
+{
+    if ( b_removed ){
+        foreach (QGraphicsItem *item, items) {
+            if ( !item->scene() )
+                delete item;
+        }
+    }
+    items.clear();
+    b_removed = false;
 }
 //! [4]
 
@@ -76,6 +254,7 @@ void RemoveShapeCommand::undo()
             myGraphicsScene->addItem(item);
     }
     myGraphicsScene->update();
+    b_removed = false;
     setText(QObject::tr("Undo Delete %1").arg(items.count()));
 }
 //! [5]
@@ -88,6 +267,7 @@ void RemoveShapeCommand::redo()
         if ( !g )
             myGraphicsScene->removeItem(item);
     }
+    b_removed = true;
         setText(QObject::tr("Redo Delete %1").arg(items.count()));
 }
 //! [6]
@@ -95,21 +275,39 @@ void RemoveShapeCommand::redo()
 //! [7]
 AddShapeCommand::AddShapeCommand(QGraphicsItem *item,
                        QGraphicsScene *scene, QUndoCommand *parent)
-    : QUndoCommand(parent)
+    : DrawCommand(parent)
 {
     static int itemCount = 0;
 
     myGraphicsScene = scene;
     myDiagramItem = item;
     initialPosition = item->pos();
+    b_removed = false;
     ++itemCount;
 }
 //! [7]
 
+// the scene owns the item unless an undo took it out, the item may be gone
+// with its scene otherwise
 AddShapeCommand::~AddShapeCommand()
 {
-    if (!myDiagramItem->scene())
+    release();
+}
+
+qint64 AddShapeCommand::memoryCost() const
+{
+    qint64 cost = DrawCommand::memoryCost();
+    if ( b_removed )
+        cost += shapeCost(myDiagramItem);
+    return cost;
+}
+
+void AddShapeCommand::release()
+{
+    if ( b_removed && !myDiagramItem->scene() )
         delete myDiagramItem;
+    myDiagramItem = 0;
+    b_removed = false;
 }
 
 //! [8]
@@ -117,6 +315,7 @@ void AddShapeCommand::undo()
 {
     myGraphicsScene->removeItem(myDiagramItem);
     myGraphicsScene->update();
+    b_removed = true;
     setText(QObject::tr("Undo Add %1")
         .arg(createCommandString(myDiagramItem, initialPosition)));
 
@@ -130,6 +329,7 @@ void AddShapeCommand::redo()
         myGraphicsScene->addItem(myDiagramItem);
     myDiagramItem->setPos(initialPosition);
     myGraphicsScene->update();
+    b_removed = false;
     setText(QObject::tr("Redo Add %1")
         .arg(createCommandString(myDiagramItem, initialPosition)));
 
@@ -143,7 +343,7 @@ QString createCommandString(QGraphicsItem *item, const QPointF &pos)
 
 
 RotateShapeCommand::RotateShapeCommand(QGraphicsItem *item, const qreal oldAngle, QUndoCommand *parent)
-    :QUndoCommand(parent)
+    :DrawCommand(parent)
 {
     myItem = item;
     myOldAngle = oldAngle;
@@ -155,6 +355,7 @@ void RotateShapeCommand::undo()
 {
     myItem->setRotation(myOldAngle);
     myItem->scene()->update();
+    markChanged(myItem);
     setText(QObject::tr("Undo Rotate %1").arg(newAngle));
 }
 
@@ -162,6 +363,7 @@ void RotateShapeCommand::redo()
 {
     myItem->setRotation(newAngle);
     myItem->update();
+    markChanged(myItem);
     setText(QObject::tr("Redo Rotate %1").arg(newAngle));
 }
 
@@ -169,12 +371,36 @@ void RotateShapeCommand::redo()
 GroupShapeCommand::GroupShapeCommand(QGraphicsItemGroup * group,
                            QGraphicsScene *graphicsScene,
                            QUndoCommand *parent)
-: QUndoCommand(parent)
+: DrawCommand(parent)
 {
     myGraphicsScene = graphicsScene;
     myGroup = group;
     items = group->childItems();
     b_undo = false;
+    b_removed = false;
+}
+
+GroupShapeCommand::~GroupShapeCommand()
+{
+    release();
+}
+
+qint64 GroupShapeCommand::memoryCost() const
+{
+    qint64 cost = DrawCommand::memoryCost() + listCost(items);
+    if ( b_removed )
+        cost += shapeCost(myGroup);
+    return cost;
+}
+
+void GroupShapeCommand::release()
+{
+    // the shapes went back to the scene, only the empty group is left
+    if ( b_removed && !myGroup->scene() )
+        delete myGroup;
+    myGroup = 0;
+    items.clear();
+    b_removed = false;
 }
 
 void GroupShapeCommand::undo()
@@ -188,6 +414,7 @@ void GroupShapeCommand::undo()
     myGraphicsScene->removeItem(myGroup);
     myGraphicsScene->update();
     b_undo = true;
+    b_removed = true;
     setText(QObject::tr("Undo Group %1").arg(items.count()));
 
 }
@@ -206,6 +433,7 @@ void GroupShapeCommand::redo()
     if ( myGroup->scene() == NULL )
         myGraphicsScene->addItem(myGroup);
     myGraphicsScene->update();
+    b_removed = false;
 
     setText(QObject::tr("Redo Group %1").arg(items.count()));
 
@@ -215,11 +443,34 @@ void GroupShapeCommand::redo()
 UnGroupShapeCommand::UnGroupShapeCommand(QGraphicsItemGroup *group,
                                QGraphicsScene *graphicsScene,
                                QUndoCommand *parent)
-    :QUndoCommand(parent)
+    :DrawCommand(parent)
 {
     myGraphicsScene = graphicsScene;
     myGroup = group;
     items = group->childItems();
+    b_ungrouped = false;
+}
+
+UnGroupShapeCommand::~UnGroupShapeCommand()
+{
+    release();
+}
+
+qint64 UnGroupShapeCommand::memoryCost() const
+{
+    qint64 cost = DrawCommand::memoryCost() + listCost(items);
+    if ( b_ungrouped )
+        cost += shapeCost(myGroup);
+    return cost;
+}
+
+void UnGroupShapeCommand::release()
+{
+    if ( b_ungrouped && !myGroup->scene() )
+        delete myGroup;
+    myGroup = 0;
+    items.clear();
+    b_ungrouped = false;
 }
 
 void UnGroupShapeCommand::undo()
@@ -234,6 +485,7 @@ void UnGroupShapeCommand::undo()
     if ( myGroup->scene() == NULL )
         myGraphicsScene->addItem(myGroup);
     myGraphicsScene->update();
+    b_ungrouped = false;
 
     setText(QObject::tr("Undo UnGroup %1").arg(items.count()));
 
@@ -246,11 +498,12 @@ void UnGroupShapeCommand::redo()
         item->setSelected(true);
         myGroup->removeFromGroup(item);
         AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
-        if (ab && !qgraphicsitem_cast<SizeHandleRect*>(ab))
+        if (ab)
             ab->updateCoordinate();
     }
     myGraphicsScene->removeItem(myGroup);
     myGraphicsScene->update();
+    b_ungrouped = true;
     setText(QObject::tr("Redo UnGroup %1").arg(items.count()));
 
 }
@@ -265,7 +518,11 @@ ResizeShapeCommand::ResizeShapeCommand(QGraphicsItem *item,
     handle_ = handle;
     scale_  = QPointF(scale) ;
     opposite_ = Handle_None;
-    bResized = true;       
+    // a drag records a single command, flipped across the opposite side
+    AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
+    if ( ab )
+        opposite_ = ab->swapHandle(handle,scale);
+    bResized = true;
 }
 
 void ResizeShapeCommand::undo()
@@ -283,6 +540,7 @@ void ResizeShapeCommand::undo()
         item->updateCoordinate();
         item->update();
     }
+    markChanged(myItem);
     bResized = false;
     setText(QObject::tr("Undo Resize %1,%2 ,handle:%3")
         .arg(1./scale_.x(),8,'f',2).arg(1./scale_.y(),8,'f',2).arg(handle));
@@ -300,6 +558,7 @@ void ResizeShapeCommand::redo()
             item->update();
         }
     }
+    markChanged(myItem);
     setText(QObject::tr("Redo Resize %1,%2 ,handle:%3")
         .arg(scale_.x(),8,'f',2).arg(scale_.y(),8,'f',2).arg(handle));
 
@@ -353,6 +612,7 @@ void ControlShapeCommand::undo()
         item->updateCoordinate();
         item->update();
     }
+    markChanged(myItem);
     bControled = false;
     setText(QObject::tr("Undo Control %1,%2")
         .arg(lastPos_.x()).arg(lastPos_.y()));
@@ -369,6 +629,7 @@ void ControlShapeCommand::redo()
             item->update();
         }
     }
+    markChanged(myItem);
     setText(QObject::tr("Redo Control %1,%2")
         .arg(newPos_.x()).arg(newPos_.y()));
 
@@ -393,3 +654,151 @@ bool ControlShapeCommand::mergeWith(const QUndoCommand *command)
 
     return true;
 }
+
+BatchShapeCommand::BatchShapeCommand(QGraphicsScene *graphicsScene, const QString &name,
+                                     QUndoCommand *parent)
+    :DrawCommand(parent)
+{
+    myGraphicsScene = graphicsScene;
+    myName = name;
+    bDone = true;
+    b_removed = false;
+}
+
+BatchShapeCommand::~BatchShapeCommand()
+{
+    release();
+}
+
+void BatchShapeCommand::append(QGraphicsItem *item, EditKind kind, int handle, const QPointF &value)
+{
+    Edit edit;
+    edit.item = item;
+    edit.value = value;
+    edit.kind = kind;
+    edit.handle = handle;
+    myEdits.append(edit);
+}
+
+void BatchShapeCommand::addMove(QGraphicsItem *item, const QPointF &delta)
+{
+    append(item,Move,Handle_None,delta);
+}
+
+void BatchShapeCommand::addResize(QGraphicsItem *item, int handle, const QPointF &scale)
+{
+    append(item,Resize,handle,scale);
+}
+
+void BatchShapeCommand::addRotate(QGraphicsItem *item, const QPointF &center, qreal angle)
+{
+    QTransform turn;
+    turn.translate(center.x(),center.y());
+    turn.rotate(-angle);
+    turn.translate(-center.x(),-center.y());
+    const QPointF anchor = item->mapToScene(item->transformOriginPoint());
+    append(item,Move,Handle_None,anchor - turn.map(anchor));
+    append(item,Rotate,Handle_None,QPointF(angle,0));
+}
+
+void BatchShapeCommand::addShape(QGraphicsItem *item)
+{
+    append(item,Add,Handle_None,item->pos());
+}
+
+// backwards, a shape may be resized and then moved
+void BatchShapeCommand::undo()
+{
+    for ( int i = myEdits.size() - 1 ; i >= 0 ; --i ){
+        const Edit & edit = myEdits.at(i);
+        switch ( edit.kind ) {
+        case Move:
+            edit.item->moveBy(-edit.value.x(),-edit.value.y());
+            markChanged(edit.item);
+            break;
+        case Resize:
+        {
+            AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(edit.item);
+            if ( item ){
+                item->stretch(edit.handle,1./edit.value.x(),1./edit.value.y(),item->opposite(edit.handle));
+                item->updateCoordinate();
+            }
+            markChanged(edit.item);
+        }
+            break;
+        case Rotate:
+            edit.item->setRotation(edit.item->rotation() - edit.value.x());
+            markChanged(edit.item);
+            break;
+        case Add:
+            myGraphicsScene->removeItem(edit.item);
+            break;
+        }
+    }
+    myGraphicsScene->update();
+    bDone = false;
+    b_removed = true;
+    setText(QObject::tr("Undo %1 %2").arg(myName).arg(myEdits.size()));
+}
+
+void BatchShapeCommand::redo()
+{
+    if ( !bDone ){
+        foreach (const Edit & edit, myEdits) {
+            switch ( edit.kind ) {
+            case Move:
+                edit.item->moveBy(edit.value.x(),edit.value.y());
+                break;
+            case Resize:
+            {
+                AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(edit.item);
+                if ( item ){
+                    item->stretch(edit.handle,edit.value.x(),edit.value.y(),item->opposite(edit.handle));
+                    item->updateCoordinate();
+                }
+            }
+                break;
+            case Rotate:
+                edit.item->setRotation(edit.item->rotation() + edit.value.x());
+                break;
+            case Add:
+                if ( edit.item->scene() == NULL )
+                    myGraphicsScene->addItem(edit.item);
+                edit.item->setPos(edit.value);
+                break;
+            }
+        }
+        myGraphicsScene->update();
+    }
+    foreach (const Edit & edit, myEdits) {
+        if ( edit.kind != Add )
+            markChanged(edit.item);
+    }
+    bDone = true;
+    b_removed = false;
+    setText(QObject::tr("Redo %1 %2").arg(myName).arg(myEdits.size()));
+}
+
+qint64 BatchShapeCommand::memoryCost() const
+{
+    qint64 cost = DrawCommand::memoryCost() + myEdits.size() * qint64(sizeof(Edit));
+    if ( b_removed ){
+        foreach (const Edit & edit, myEdits) {
+            if ( edit.kind == Add )
+                cost += shapeCost(edit.item);
+        }
+    }
+    return cost;
+}
+
+void BatchShapeCommand::release()
+{
+    if ( b_removed ){
+        foreach (const Edit & edit, myEdits) {
+            if ( edit.kind == Add && !edit.item->scene() )
+                delete edit.item;
+        }
+    }
+    myEdits.clear();
+    b_removed = false;
+}
@@ -2,25 +2,75 @@
 #define COMMANDS
 
 #include <QUndoCommand>
+#include <QHash>
+#include <QUndoStack>
+#include <QVector>
 #include "drawscene.h"
 
-class MoveShapeCommand : public QUndoCommand
+// A command of the undo history that knows roughly how much memory it
+// holds, and can give it up once it is too old to be undone, see UndoStack.
+class DrawCommand : public QUndoCommand
 {
 public:
+    explicit DrawCommand(QUndoCommand * parent = 0) : QUndoCommand(parent) {}
+    virtual qint64 memoryCost() const;
+    // frees the shapes the command keeps alive, called on a done command
+    // right before the stack makes it obsolete
+    virtual void release() {}
+};
+
+// Keeps the memory of its done commands under a budget: once it is
+// exceeded the oldest commands release what they hold and become
+// obsolete, marked as discarded in the history. Once only they are left to
+// undo they are dropped from it, so undo never changes nothing.
+class UndoStack : public QUndoStack
+{
+    Q_OBJECT
+public:
+    explicit UndoStack(QObject * parent = 0);
+    // 0 for no budget
+    void setMemoryBudget( qint64 bytes );
+    qint64 memoryBudget() const { return m_budget; }
+    qint64 memoryUsed() const { return m_used; }
+
+private slots:
+    void enforceBudget();
+
+private:
+    qint64 m_budget;
+    qint64 m_used;
+    // the cost of every command on the stack, taken when it reached the top
+    QHash<const QUndoCommand*,qint64> m_costs;
+    // set while the discarded commands are undone, see enforceBudget
+    bool m_dropping;
+};
+
+class MoveShapeCommand : public DrawCommand
+{
+public:
+    enum { Id = 1236, };
     MoveShapeCommand(QGraphicsScene *graphicsScene, const QPointF & delta ,
                 QUndoCommand * parent = 0);
     MoveShapeCommand(QGraphicsItem * item, const QPointF & delta , QUndoCommand * parent = 0);
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+
+    // moves of the same shapes pushed in quick succession, like keyboard
+    // nudges, become one step
+    bool mergeWith(const QUndoCommand *command) Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE { return Id; }
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
 private:
     QGraphicsScene *myGraphicsScene;
     QGraphicsItem  *myItem;
     QList<QGraphicsItem *> myItems;
     QPointF myDelta;
+    qint64 myTime;
     bool bMoved;
 };
 
-class ResizeShapeCommand : public QUndoCommand
+class ResizeShapeCommand : public DrawCommand
 {
 public:
     enum { Id = 1234, };
@@ -41,7 +91,7 @@ private:
     bool bResized;
 };
 
-class ControlShapeCommand : public QUndoCommand
+class ControlShapeCommand : public DrawCommand
 {
 public:
     enum { Id = 1235, };
@@ -65,7 +115,7 @@ private:
 };
 
 
-class RotateShapeCommand : public QUndoCommand
+class RotateShapeCommand : public DrawCommand
 {
 public:
     RotateShapeCommand(QGraphicsItem *item , const qreal oldAngle ,
@@ -78,47 +128,61 @@ private:
     qreal newAngle;
 };
 
-class RemoveShapeCommand : public QUndoCommand
+// the commands below own the shapes they took out of the scene, and
+// delete them when they are deleted themselves
+
+class RemoveShapeCommand : public DrawCommand
 {
 public:
     explicit RemoveShapeCommand(QGraphicsScene *graphicsScene, QUndoCommand *parent = 0);
     ~RemoveShapeCommand();
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
 
 private:
     QList<QGraphicsItem *> items;
     QGraphicsScene *myGraphicsScene;
+    bool b_removed;
 };
 
-class GroupShapeCommand : public QUndoCommand
+class GroupShapeCommand : public DrawCommand
 {
 public:
     explicit GroupShapeCommand( QGraphicsItemGroup * group, QGraphicsScene *graphicsScene,
                            QUndoCommand *parent = 0);
+    ~GroupShapeCommand();
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
 private:
     QList<QGraphicsItem *> items;
     QGraphicsItemGroup * myGroup;
     QGraphicsScene *myGraphicsScene;
     bool b_undo;
+    bool b_removed;
 };
 
-class UnGroupShapeCommand : public QUndoCommand
+class UnGroupShapeCommand : public DrawCommand
 {
 public:
     explicit UnGroupShapeCommand( QGraphicsItemGroup * group, QGraphicsScene *graphicsScene,
                              QUndoCommand *parent = 0);
+    ~UnGroupShapeCommand();
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
 private:
     QList<QGraphicsItem *> items;
     QGraphicsItemGroup * myGroup;
     QGraphicsScene *myGraphicsScene;
+    bool b_ungrouped;
 };
 
-class AddShapeCommand : public QUndoCommand
+class AddShapeCommand : public DrawCommand
 {
 public:
     AddShapeCommand(QGraphicsItem *item , QGraphicsScene *graphicsScene,
@@ -127,11 +191,56 @@ public:
 
     void undo() Q_DECL_OVERRIDE;
     void redo() Q_DECL_OVERRIDE;
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
 
 private:
     QGraphicsItem *myDiagramItem;
     QGraphicsScene *myGraphicsScene;
     QPointF initialPosition;
+    bool b_removed;
+};
+
+// Many shapes edited as one step, like an align or a paste. The edits are
+// kept as a flat array and replayed in one pass with a single scene update,
+// rather than as a command per shape. The shapes are edited before they
+// are added, the first redo leaves them as they are.
+class BatchShapeCommand : public DrawCommand
+{
+public:
+    BatchShapeCommand(QGraphicsScene *graphicsScene, const QString & name ,
+                      QUndoCommand *parent = 0);
+    ~BatchShapeCommand();
+
+    void addMove( QGraphicsItem * item , const QPointF & delta );
+    void addResize( QGraphicsItem * item , int handle , const QPointF & scale );
+    // the shape was turned by angle about center, moving its origin
+    void addRotate( QGraphicsItem * item , const QPointF & center , qreal angle );
+    // the shape is in the scene already
+    void addShape( QGraphicsItem * item );
+    bool isEmpty() const { return myEdits.isEmpty(); }
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+    qint64 memoryCost() const Q_DECL_OVERRIDE;
+    void release() Q_DECL_OVERRIDE;
+
+private:
+    enum EditKind { Move , Resize , Rotate , Add };
+    struct Edit
+    {
+        QGraphicsItem * item;
+        QPointF value;
+        qint32 kind;
+        qint32 handle;
+    };
+    void append( QGraphicsItem * item , EditKind kind , int handle , const QPointF & value );
+
+    QVector<Edit> myEdits;
+    QGraphicsScene *myGraphicsScene;
+    QString myName;
+    bool bDone;
+    bool b_removed;
 };
 
 QString createCommandString(QGraphicsItem *item, const QPointF &point);
@@ -1,7 +1,442 @@
 #include "document.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QPainter>
+#include <QSvgGenerator>
+#include <QXmlStreamReader>
+#include "drawscene.h"
+#include "documentloader.h"
+#include "tilerenderer.h"
 
-Document::Document()
+// bytes appended to a small drawing before a save compacts it, larger
+// drawings compact once the journal is half their size
+static const qint64 JournalMinimum = 1 << 20;
+
+Document::Document(DrawScene *scene)
+    :m_scene(scene)
+    ,m_journalBase(0)
+    ,m_journalSize(0)
+    ,m_nextKey(0)
+{
+}
+
+// the scene rebuilds its item index once, after the whole drawing
+class BulkInsert
+{
+public:
+    explicit BulkInsert( DrawScene * scene ) :scene_(scene) { scene_->beginBulkInsert(); }
+    ~BulkInsert() { scene_->endBulkInsert(); }
+private:
+    DrawScene * scene_;
+};
+
+bool Document::load(const QString &fileName)
+{
+    m_error.clear();
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        m_error = file.errorString();
+        return false;
+    }
+
+    // parse straight from the mapped file
+    QByteArray bytes;
+    if ( !DocumentLoader::readFile(file,&bytes,&m_error) )
+        return false;
+    BulkInsert bulk(m_scene);
+
+    if ( DocumentLoader::isBinaryFile(fileName) ){
+        bool journal = false;
+        int records = 0;
+        const bool ok = loadBinary(bytes,&journal,&records);
+        // the keys of a replayed journal are not known, the next save compacts
+        resetJournal(ok && !journal ? fileName : QString(),records);
+        return ok;
+    }
+
+    QXmlStreamReader xml(bytes);
+    if (xml.readNextStartElement()) {
+        if ( xml.name() == tr("canvas"))
+        {
+            int width = xml.attributes().value(tr("width")).toInt();
+            int height = xml.attributes().value(tr("height")).toInt();
+            m_scene->setSceneRect(0,0,width,height);
+            loadCanvas(&xml);
+        }
+    }
+    resetJournal(QString());
+
+    if ( xml.hasError() ){
+        m_error = xml.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool Document::save(const QString &fileName, bool compact)
+{
+    m_error.clear();
+    if ( DocumentWriter::writeFile(saveSnapshot(fileName,compact),fileName,&m_error) )
+        return true;
+    resetJournal(QString());
+    return false;
+}
+
+DocumentSnapshot Document::snapshot() const
+{
+    DocumentSnapshot snapshot;
+    snapshot.size = m_scene->sceneRect().size();
+    QBuffer buffer(&snapshot.records);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    DocumentLoader::setupBinaryStream(stream);
+    foreach (QGraphicsItem *item , m_scene->shapes()) {
+        AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
+        if ( ab )
+            ab->saveToBinary(&stream);
+    }
+    return snapshot;
+}
+
+DocumentSnapshot Document::saveSnapshot(const QString &fileName, bool compact)
 {
+    const QString path = QFileInfo(fileName).absoluteFilePath();
+    const bool append = !compact && !m_journalFile.isEmpty() && path == m_journalFile &&
+                        m_scene->sceneRect().size() == m_journalPage &&
+                        m_journalSize - m_journalBase < qMax(JournalMinimum,m_journalBase / 2);
+    if ( !append ){
+        DocumentSnapshot full = snapshot();
+        resetJournal(QString());
+        if ( DocumentLoader::isBinaryFile(fileName) ){
+            QByteArray header;
+            QBuffer buffer(&header);
+            buffer.open(QIODevice::WriteOnly);
+            QDataStream stream(&buffer);
+            DocumentLoader::setupBinaryStream(stream);
+            DocumentLoader::writeBinaryHeader(stream,full.size);
+            m_journalFile = path;
+            m_journalPage = full.size;
+            m_journalBase = m_journalSize = header.size() + full.records.size();
+            assignKeys();
+        }
+        return full;
+    }
 
+    const QSet<QGraphicsItem*> removed = m_scene->removedShapes();
+    const QList<QGraphicsItem*> changed = m_scene->changedShapes();
+    const QSet<QGraphicsItem*> joined = m_scene->joinedShapes();
+    m_scene->clearShapeChanges();
+
+    DocumentSnapshot segment;
+    segment.size = m_journalPage;
+    segment.appendAt = m_journalSize;
+    if ( removed.isEmpty() && changed.isEmpty() )
+        return segment;
+
+    QBuffer buffer(&segment.records);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    DocumentLoader::setupBinaryStream(stream);
+    const qint64 record = beginShapeRecord(&stream,JournalRecord);
+    const qint64 countPos = buffer.pos();
+    quint32 count = 0;
+    stream << count;
+    foreach (QGraphicsItem *item , removed) {
+        // shapes added and removed since the last save were never written
+        QHash<QGraphicsItem*,quint32>::iterator it = m_keys.find(item);
+        if ( it == m_keys.end() )
+            continue;
+        stream << it.value() << quint8(0);
+        m_keys.erase(it);
+        ++count;
+    }
+    // keys follow the order the shapes joined the top level, which is the
+    // order a reload adds them in. a shape back on the top level, by undo
+    // or ungroup, stacks above the others and leaves its old slot
+    foreach (QGraphicsItem *item , changed) {
+        AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
+        if ( !ab )
+            continue;
+        QHash<QGraphicsItem*,quint32>::iterator it = m_keys.find(item);
+        if ( it != m_keys.end() && joined.contains(item) ){
+            stream << it.value() << quint8(0);
+            ++count;
+            m_keys.erase(it);
+            it = m_keys.end();
+        }
+        if ( it == m_keys.end() )
+            it = m_keys.insert(item,m_nextKey++);
+        stream << it.value() << quint8(1);
+        ab->saveToBinary(&stream);
+        ++count;
+    }
+    const qint64 end = buffer.pos();
+    buffer.seek(countPos);
+    stream << count;
+    buffer.seek(end);
+    endShapeRecord(&stream,record);
+
+    m_journalSize += segment.records.size();
+    return segment;
 }
 
+void Document::resetJournal(const QString &fileName, int records)
+{
+    m_journalFile.clear();
+    m_keys.clear();
+    m_scene->clearShapeChanges();
+    // shapes that failed to load would shift the keys of the records after them
+    if ( fileName.isEmpty() || !DocumentLoader::isBinaryFile(fileName) ||
+         m_scene->shapes().size() != records )
+        return;
+    const QFileInfo info(fileName);
+    m_journalFile = info.absoluteFilePath();
+    m_journalPage = m_scene->sceneRect().size();
+    m_journalBase = m_journalSize = info.size();
+    assignKeys();
+}
+
+void Document::assignKeys()
+{
+    m_keys.clear();
+    m_nextKey = 0;
+    foreach (QGraphicsItem *item , m_scene->shapes()) {
+        m_keys.insert(item,m_nextKey++);
+    }
+}
+
+bool Document::exportSvg(const QString &fileName)
+{
+    m_error.clear();
+    const QRectF page = m_scene->sceneRect();
+    QSvgGenerator generator;
+    generator.setFileName(fileName);
+    generator.setSize(page.size().toSize());
+    generator.setViewBox(QRectF(QPointF(0,0),page.size()));
+    generator.setTitle(QFileInfo(fileName).completeBaseName());
+    generator.setDescription(tr("A drawing created by qdraw"));
+
+    QPainter painter;
+    if ( !painter.begin(&generator) ){
+        m_error = tr("Cannot write file %1").arg(fileName);
+        return false;
+    }
+    // the views show the scene with y pointing up
+    painter.setWorldTransform(QTransform(1,0,0,-1,-page.left(),page.bottom()));
+    m_scene->render(&painter,page,page);
+    painter.end();
+    return true;
+}
+
+QImage Document::renderImage(const QSize &size, int threads) const
+{
+    const QRectF page = m_scene->sceneRect();
+    if ( page.isEmpty() || size.isEmpty() )
+        return QImage();
+
+    const qreal sx = size.width() / page.width();
+    const qreal sy = size.height() / page.height();
+    const QTransform trans(sx,0,0,-sy,-page.left() * sx,page.bottom() * sy);
+    SceneSnapshotPtr snapshot = SceneSnapshot::create(m_scene);
+    if ( snapshot )
+        return TileRenderer::renderImage(snapshot,trans,size,Qt::white,threads);
+
+    // items the snapshot cannot copy are painted by the scene itself
+    QImage image(size,QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setWorldTransform(trans);
+    m_scene->render(&painter,page,page);
+    return image;
+}
+
+void Document::loadCanvas( QXmlStreamReader *xml)
+{
+    Q_ASSERT(xml->isStartElement() && xml->name() == "canvas");
+
+    QList<QGraphicsItem*> items;
+    while (xml->readNextStartElement()) {
+        AbstractShape * item = NULL;
+        if (xml->name() == tr("rect")){
+            item = new GraphicsRectItem(QRect(0,0,1,1));
+        }else if (xml->name() == tr("roundrect")){
+            item = new GraphicsRectItem(QRect(0,0,1,1),true);
+        }else if (xml->name() == tr("ellipse"))
+            item = new GraphicsEllipseItem(QRect(0,0,1,1));
+        else if (xml->name()==tr("polygon"))
+            item = new GraphicsPolygonItem();
+        else if ( xml->name()==tr("bezier"))
+            item = new GraphicsBezier();
+        else if ( xml->name() == tr("polyline"))
+            item = new GraphicsBezier(false);
+        else if ( xml->name() == tr("line"))
+            item = new GraphicsLineItem();
+        else if ( xml->name() == tr("group"))
+            item =qgraphicsitem_cast<AbstractShape*>(loadGroupFromXML(xml));
+        else
+            xml->skipCurrentElement();
+
+        if (item && item->loadFromXml(xml))
+            items.append(item);
+        else if ( item )
+            delete item;
+    }
+    m_scene->addItems(items);
+}
+
+GraphicsItemGroup *Document::loadGroupFromXML(QXmlStreamReader *xml)
+{
+    QList<QGraphicsItem*> items;
+    qreal angle = xml->attributes().value(tr("rotate")).toDouble();
+    while (xml->readNextStartElement()) {
+        AbstractShape * item = NULL;
+        if (xml->name() == tr("rect")){
+            item = new GraphicsRectItem(QRect(0,0,1,1));
+        }else if (xml->name() == tr("roundrect")){
+            item = new GraphicsRectItem(QRect(0,0,1,1),true);
+        }else if (xml->name() == tr("ellipse"))
+            item = new GraphicsEllipseItem(QRect(0,0,1,1));
+        else if (xml->name()==tr("polygon"))
+            item = new GraphicsPolygonItem();
+        else if ( xml->name()==tr("bezier"))
+            item = new GraphicsBezier();
+        else if ( xml->name() == tr("polyline"))
+            item = new GraphicsBezier(false);
+        else if ( xml->name() == tr("line"))
+            item = new GraphicsLineItem();
+        else if ( xml->name() == tr("group"))
+            item =qgraphicsitem_cast<AbstractShape*>(loadGroupFromXML(xml));
+        else
+            xml->skipCurrentElement();
+        // the children join the scene with their group
+        if (item && item->loadFromXml(xml))
+            items.append(item);
+        else if ( item )
+            delete item;
+    }
+
+    if ( items.count() > 0 ){
+        GraphicsItemGroup * group = m_scene->createGroup(items,false);
+        if (group){
+            group->setRotation(angle);
+            group->updateCoordinate();
+            //qDebug()<<"angle:" <<angle;
+        }
+        return group;
+    }
+    return 0;
+}
+
+bool Document::loadBinary(const QByteArray &bytes, bool *journal, int *records)
+{
+    QDataStream header(bytes);
+    DocumentLoader::setupBinaryStream(header);
+    QSizeF size;
+    QVector<int> kinds;
+    if ( !DocumentLoader::readBinaryHeader(header,size,kinds) ){
+        m_error = tr("Not a binary drawing or unsupported version");
+        return false;
+    }
+    m_scene->setSceneRect(QRectF(QPointF(0,0),size));
+
+    const int offset = int(header.device()->pos());
+    QByteArray body = QByteArray::fromRawData(bytes.constData() + offset,bytes.size() - offset);
+    QByteArray resolved;
+    *journal = DocumentLoader::applyJournal(body,kinds,&resolved);
+    if ( *journal )
+        body = resolved;
+
+    QDataStream stream(body);
+    DocumentLoader::setupBinaryStream(stream);
+    QList<QGraphicsItem*> items;
+    // drawings of older versions have no journal kind in their string table
+    *records = kinds.size() > JournalRecord && kinds.at(JournalRecord) == JournalRecord ? 0 : -1;
+    while ( !stream.atEnd() && stream.status() == QDataStream::Ok ) {
+        AbstractShape * item = loadShapeFromBinary(&stream,kinds);
+        if ( item )
+            items.append(item);
+        if ( *records >= 0 )
+            ++*records;
+    }
+    m_scene->addItems(items);
+    if ( stream.status() != QDataStream::Ok ){
+        m_error = tr("Truncated drawing");
+        return false;
+    }
+    return true;
+}
+
+AbstractShape *Document::loadShapeFromBinary(QDataStream *stream, const QVector<int> &kinds)
+{
+    quint8 index = 0;
+    quint32 size = 0;
+    *stream >> index >> size;
+    if ( stream->status() != QDataStream::Ok )
+        return NULL;
+    const qint64 end = stream->device()->pos() + size;
+
+    AbstractShape * item = NULL;
+    switch ( index < kinds.size() ? kinds.at(index) : -1 ) {
+    case RectRecord:
+        item = new GraphicsRectItem(QRect(0,0,1,1));
+        break;
+    case RoundRectRecord:
+        item = new GraphicsRectItem(QRect(0,0,1,1),true);
+        break;
+    case EllipseRecord:
+        item = new GraphicsEllipseItem(QRect(0,0,1,1));
+        break;
+    case PolygonRecord:
+        item = new GraphicsPolygonItem();
+        break;
+    case BezierRecord:
+        item = new GraphicsBezier();
+        break;
+    case PolylineRecord:
+        item = new GraphicsBezier(false);
+        break;
+    case LineRecord:
+        item = new GraphicsLineItem();
+        break;
+    case GroupRecord:
+        item = qgraphicsitem_cast<AbstractShape*>(loadGroupFromBinary(stream,kinds));
+        break;
+    default:
+        break;
+    }
+
+    if ( item && !item->loadFromBinary(stream) ){
+        delete item;
+        item = NULL;
+    }
+    // skip unknown records and fields appended by newer writers
+    if ( stream->status() == QDataStream::Ok && stream->device()->pos() != end )
+        stream->device()->seek(end);
+    return item;
+}
+
+GraphicsItemGroup *Document::loadGroupFromBinary(QDataStream *stream, const QVector<int> &kinds)
+{
+    QList<QGraphicsItem*> items;
+    qreal x, y, angle;
+    quint32 count = 0;
+    *stream >> x >> y >> angle >> count;
+    for ( quint32 i = 0 ; i < count && stream->status() == QDataStream::Ok ; ++i ){
+        AbstractShape * item = loadShapeFromBinary(stream,kinds);
+        // the children join the scene with their group
+        if ( item )
+            items.append(item);
+    }
+
+    if ( items.count() > 0 ){
+        GraphicsItemGroup * group = m_scene->createGroup(items,false);
+        if (group){
+            group->setRotation(angle);
+            group->updateCoordinate();
+        }
+        return group;
+    }
+    return 0;
+}
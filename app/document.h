@@ -1,13 +1,66 @@
 #ifndef DOCUMENT_H
 #define DOCUMENT_H
 
+#include <QCoreApplication>
+#include <QImage>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include "drawobj.h"
+#include "documentwriter.h"
 
+class DrawScene;
+
+// Reads, writes and renders the shapes of a scene, independent of any view.
 class Document
 {
+    Q_DECLARE_TR_FUNCTIONS(Document)
 public:
-    Document();
+    explicit Document(DrawScene * scene);
+
+    DrawScene * scene() const { return m_scene; }
+    QString errorString() const { return m_error; }
+
+    // the format follows the file name, see DocumentLoader::isBinaryFile
+    bool load(const QString & fileName);
+    // see saveSnapshot, a failed write leaves the previous version intact
+    bool save(const QString & fileName , bool compact = false);
+    // the shapes as binary records, cheap enough to take on every save and
+    // written out by a DocumentWriter on another thread
+    DocumentSnapshot snapshot() const;
+    // what a save to fileName writes: only the shapes changed since the
+    // last save, appended as a journal segment, when fileName is the binary
+    // drawing last loaded or saved in full. everything, compacting the
+    // journal, otherwise, when compact is set or the journal has grown large
+    DocumentSnapshot saveSnapshot(const QString & fileName , bool compact = false);
+    // fileName was loaded with one top-level shape per record, in record
+    // order, or saved in full. empty if the next save has to be a full one
+    void resetJournal(const QString & fileName , int records = -1);
+    // the page as the views show it, with y pointing up
+    bool exportSvg(const QString & fileName);
+    QImage renderImage(const QSize & size , int threads) const;
+
+    // journal is set if changes were appended to the drawing
+    bool loadBinary( const QByteArray & bytes , bool * journal , int * records );
+    void loadCanvas( QXmlStreamReader *xml );
+    AbstractShape * loadShapeFromBinary( QDataStream * stream , const QVector<int> & kinds );
+
+private:
+    GraphicsItemGroup * loadGroupFromXML( QXmlStreamReader * xml );
+    GraphicsItemGroup * loadGroupFromBinary( QDataStream * stream , const QVector<int> & kinds );
+
+    void assignKeys();
 
+    DrawScene * m_scene;
+    QString m_error;
 
+    // the binary drawing saves append to, keys number its shape records
+    QString m_journalFile;
+    QSizeF m_journalPage;
+    qint64 m_journalBase;
+    qint64 m_journalSize;
+    QHash<QGraphicsItem*,quint32> m_keys;
+    quint32 m_nextKey;
 };
 
 #endif // DOCUMENT_H
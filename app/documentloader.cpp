@@ -0,0 +1,378 @@
+#include "documentloader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <climits>
+#include <QBuffer>
+#include <QXmlStreamReader>
+#include <QPolygonF>
+#include <QMap>
+#include "drawobj.h"
+
+static const quint32 BinaryMagic = 0x57524451;
+static const quint16 BinaryVersion = 1;
+// records handed to the view at once
+static const int BatchSize = 2000;
+
+static qreal attribute( const QXmlStreamAttributes & attributes , const char * name )
+{
+    return attributes.value(QLatin1String(name)).toDouble();
+}
+
+static int recordKind( const QStringRef & name )
+{
+    for ( int k = 0 ; k < JournalRecord ; ++k ){
+        if ( name == shapeRecordName(k) )
+            return k;
+    }
+    return -1;
+}
+
+DocumentLoader::DocumentLoader(const QString &fileName, QObject *parent)
+    :QObject(parent)
+    ,m_fileName(fileName)
+    ,m_canceled(0)
+    ,m_batchCount(0)
+    ,m_hasJournal(false)
+    ,m_recordCount(-1)
+{
+    qRegisterMetaType<QVector<int> >("QVector<int>");
+}
+
+void DocumentLoader::cancel()
+{
+    m_canceled.storeRelease(1);
+}
+
+bool DocumentLoader::isCanceled() const
+{
+    return m_canceled.loadAcquire() != 0;
+}
+
+bool DocumentLoader::isBinaryFile(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().compare(QLatin1String("qdrw"),Qt::CaseInsensitive) == 0;
+}
+
+bool DocumentLoader::readFile(QFile &file, QByteArray *bytes, QString *error)
+{
+    // a byte array holds at most INT_MAX bytes, a larger size would wrap
+    if ( file.size() > INT_MAX ){
+        *error = tr("%1 is too large to load, %2 bytes").arg(file.fileName()).arg(file.size());
+        return false;
+    }
+    const uchar * data = file.size() > 0 ? file.map(0,file.size()) : NULL;
+    if ( data )
+        *bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data),int(file.size()));
+    else
+        *bytes = file.readAll();
+    return true;
+}
+
+void DocumentLoader::setupBinaryStream(QDataStream &stream)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+void DocumentLoader::writeBinaryHeader(QDataStream &stream, const QSizeF &size)
+{
+    stream << BinaryMagic << BinaryVersion << size.width() << size.height();
+    stream << quint16(RecordCount);
+    for ( int i = 0 ; i < RecordCount ; ++i )
+        stream << shapeRecordName(i);
+}
+
+bool DocumentLoader::readBinaryHeader(QDataStream &stream, QSizeF &size, QVector<int> &kinds)
+{
+    quint32 magic = 0;
+    quint16 version = 0;
+    qreal width = 0, height = 0;
+    stream >> magic >> version;
+    if ( magic != BinaryMagic || version > BinaryVersion )
+        return false;
+    stream >> width >> height;
+    size = QSizeF(width,height);
+
+    quint16 count = 0;
+    stream >> count;
+    kinds.fill(-1,count);
+    for ( int i = 0 ; i < count ; ++i ){
+        QString name;
+        stream >> name;
+        for ( int k = 0 ; k < RecordCount ; ++k ){
+            if ( name == shapeRecordName(k) ){
+                kinds[i] = k;
+                break;
+            }
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+void DocumentLoader::load()
+{
+    QFile file(m_fileName);
+    if ( !file.open(QFile::ReadOnly) ){
+        emit finished(false,file.errorString());
+        return;
+    }
+
+    QByteArray bytes;
+    m_error.clear();
+    if ( !readFile(file,&bytes,&m_error) ){
+        emit finished(false,m_error);
+        return;
+    }
+
+    bool ok = isBinaryFile(m_fileName) ? loadBinary(bytes) : loadXml(bytes);
+    if ( isCanceled() ){
+        ok = false;
+        m_error = tr("Loading canceled");
+    }
+    emit finished(ok,m_error);
+}
+
+bool DocumentLoader::applyJournal(const QByteArray &records, const QVector<int> &kinds, QByteArray *resolved)
+{
+    QDataStream stream(records);
+    setupBinaryStream(stream);
+    QIODevice * device = stream.device();
+
+    // most drawings have no journal, find out by skipping over the records
+    bool found = false;
+    while ( !found && !stream.atEnd() ) {
+        quint8 index = 0;
+        quint32 length = 0;
+        stream >> index >> length;
+        if ( stream.status() != QDataStream::Ok || length > device->bytesAvailable() )
+            break;
+        found = index < kinds.size() && kinds.at(index) == JournalRecord;
+        device->seek(device->pos() + length);
+    }
+    if ( !found )
+        return false;
+    device->seek(0);
+
+    // the records by key, as offset and length into records
+    QMap<quint32,QPair<int,int> > entries;
+    quint32 key = 0;
+    bool journal = false;
+    while ( !stream.atEnd() ) {
+        const qint64 start = device->pos();
+        quint8 index = 0;
+        quint32 length = 0;
+        stream >> index >> length;
+        if ( stream.status() != QDataStream::Ok || length > device->bytesAvailable() ){
+            // an append cut short by a crash, the drawing is complete without it
+            if ( journal )
+                break;
+            return false;
+        }
+        const qint64 end = device->pos() + length;
+        if ( index >= kinds.size() || kinds.at(index) != JournalRecord ){
+            entries.insert(key++,qMakePair(int(start),int(end - start)));
+            device->seek(end);
+            continue;
+        }
+
+        // count times: quint32 key, quint8 present, the shape record if present
+        journal = true;
+        quint32 count = 0;
+        stream >> count;
+        for ( quint32 i = 0 ; i < count && stream.status() == QDataStream::Ok ; ++i ){
+            quint32 shape = 0;
+            quint8 present = 0;
+            stream >> shape >> present;
+            if ( !present ){
+                entries.remove(shape);
+                continue;
+            }
+            const qint64 shapeStart = device->pos();
+            quint8 shapeIndex = 0;
+            quint32 shapeLength = 0;
+            stream >> shapeIndex >> shapeLength;
+            const qint64 shapeEnd = device->pos() + shapeLength;
+            if ( stream.status() != QDataStream::Ok || shapeEnd > end )
+                return false;
+            entries.insert(shape,qMakePair(int(shapeStart),int(shapeEnd - shapeStart)));
+            device->seek(shapeEnd);
+        }
+        device->seek(end);
+    }
+    if ( !journal )
+        return false;
+
+    resolved->clear();
+    QMap<quint32,QPair<int,int> >::const_iterator it = entries.constBegin();
+    for ( ; it != entries.constEnd() ; ++it )
+        resolved->append(records.constData() + it.value().first,it.value().second);
+    return true;
+}
+
+bool DocumentLoader::loadBinary(const QByteArray &bytes)
+{
+    QDataStream header(bytes);
+    setupBinaryStream(header);
+
+    QSizeF size;
+    QVector<int> kinds;
+    if ( !readBinaryHeader(header,size,kinds) ){
+        m_error = tr("Not a binary drawing or unsupported version");
+        return false;
+    }
+    emit started(size,kinds);
+
+    // the journal is applied up front, the view only sees whole shapes
+    const int offset = int(header.device()->pos());
+    QByteArray records = QByteArray::fromRawData(bytes.constData() + offset,bytes.size() - offset);
+    QByteArray resolved;
+    m_hasJournal = applyJournal(records,kinds,&resolved);
+    if ( m_hasJournal )
+        records = resolved;
+
+    // drawings of older versions have no journal kind in their string table
+    const bool appendable = kinds.size() > JournalRecord && kinds.at(JournalRecord) == JournalRecord;
+    int count = 0;
+
+    // records are passed on as they are, the view parses the payloads
+    QDataStream stream(records);
+    setupBinaryStream(stream);
+    QIODevice * device = stream.device();
+    const qint64 total = qMax(1,records.size());
+    while ( !stream.atEnd() ) {
+        if ( isCanceled() )
+            return false;
+        const qint64 start = device->pos();
+        quint8 kind = 0;
+        quint32 length = 0;
+        stream >> kind >> length;
+        if ( stream.status() != QDataStream::Ok || length > device->bytesAvailable() ){
+            m_error = tr("Truncated record at offset %1").arg(offset + start);
+            flush(100,true);
+            return false;
+        }
+        const qint64 end = device->pos() + length;
+        m_batch.append(records.constData() + start, int(end - start));
+        ++m_batchCount;
+        ++count;
+        device->seek(end);
+        flush(int(end * 100 / total),false);
+    }
+    flush(100,true);
+    m_recordCount = appendable ? count : -1;
+    return true;
+}
+
+bool DocumentLoader::loadXml(const QByteArray &bytes)
+{
+    QXmlStreamReader xml(bytes);
+    if ( !xml.readNextStartElement() || xml.name() != QLatin1String("canvas") ){
+        m_error = xml.hasError() ? xml.errorString() : tr("Not a drawing");
+        return false;
+    }
+
+    const QXmlStreamAttributes attributes = xml.attributes();
+    QVector<int> kinds(RecordCount);
+    for ( int i = 0 ; i < RecordCount ; ++i )
+        kinds[i] = i;
+    emit started(QSizeF(attributes.value(QLatin1String("width")).toInt(),
+                        attributes.value(QLatin1String("height")).toInt()),kinds);
+
+    const qint64 total = qMax(1,bytes.size());
+    while ( xml.readNextStartElement() ) {
+        if ( isCanceled() )
+            return false;
+        QByteArray record;
+        QBuffer buffer(&record);
+        buffer.open(QIODevice::WriteOnly);
+        QDataStream out(&buffer);
+        setupBinaryStream(out);
+        if ( convertXmlShape(&xml,&out) ){
+            m_batch.append(record);
+            ++m_batchCount;
+        }
+        flush(int(qMin<qint64>(xml.characterOffset() * 100 / total,100)),false);
+    }
+    flush(100,true);
+    if ( xml.hasError() )
+        m_error = xml.errorString();
+    return !xml.hasError();
+}
+
+// writes the element the reader is positioned on as a binary record,
+// with the same fields the shapes read in loadFromXml
+bool DocumentLoader::convertXmlShape(QXmlStreamReader *xml, QDataStream *out)
+{
+    const int kind = recordKind(xml->name());
+    if ( kind < 0 ){
+        xml->skipCurrentElement();
+        return false;
+    }
+
+    const QXmlStreamAttributes attributes = xml->attributes();
+    qint64 record = beginShapeRecord(out,kind);
+    if ( kind == GroupRecord ){
+        *out << attribute(attributes,"x") << attribute(attributes,"y")
+             << attribute(attributes,"rotate");
+        QIODevice * device = out->device();
+        const qint64 countPos = device->pos();
+        quint32 count = 0;
+        *out << count;
+        while ( xml->readNextStartElement() ) {
+            if ( convertXmlShape(xml,out) )
+                ++count;
+        }
+        const qint64 end = device->pos();
+        device->seek(countPos);
+        *out << count;
+        device->seek(end);
+        endShapeRecord(out,record);
+        return true;
+    }
+
+    *out << attribute(attributes,"x") << attribute(attributes,"y")
+         << attribute(attributes,"z") << attribute(attributes,"rotate")
+         << attribute(attributes,"width") << attribute(attributes,"height");
+
+    switch ( kind ) {
+    case RectRecord:
+        xml->skipCurrentElement();
+        break;
+    case RoundRectRecord:
+        *out << attribute(attributes,"rx") << attribute(attributes,"ry");
+        xml->skipCurrentElement();
+        break;
+    case EllipseRecord:
+        *out << qint32(attributes.value(QLatin1String("startAngle")).toInt())
+             << qint32(attributes.value(QLatin1String("spanAngle")).toInt());
+        xml->skipCurrentElement();
+        break;
+    default:
+    {
+        QPolygonF points;
+        while ( xml->readNextStartElement() ) {
+            if ( xml->name() == QLatin1String("point") ){
+                const QXmlStreamAttributes point = xml->attributes();
+                points.append(QPointF(attribute(point,"x"),attribute(point,"y")));
+            }
+            xml->skipCurrentElement();
+        }
+        *out << quint32(points.size());
+        for ( int i = 0 ; i < points.size() ; ++i )
+            *out << points[i].x() << points[i].y();
+    }
+        break;
+    }
+    endShapeRecord(out,record);
+    return true;
+}
+
+void DocumentLoader::flush(int progress, bool force)
+{
+    if ( m_batchCount == 0 || ( !force && m_batchCount < BatchSize ) )
+        return;
+    emit batchReady(m_batch,progress);
+    m_batch.clear();
+    m_batchCount = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef DOCUMENTLOADER
+#define DOCUMENTLOADER
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QDataStream>
+#include <QSizeF>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QFile;
+class QXmlStreamReader;
+QT_END_NAMESPACE
+
+/*
+ binary document layout, all values little endian, reals as doubles:
+
+   quint32 magic 'QDRW', quint16 version, qreal width, qreal height
+   quint16 count, count * QString     string table, names of the record kinds
+   records until the end of the file:
+   quint8 kind, quint32 size, payload  kind indexes the string table
+
+ group payloads contain their children as nested records, records with an
+ unknown kind are skipped by size.
+
+ saves may append journal records: quint32 count, count * ( quint32 key ,
+ quint8 present , the new shape record if present ). keys number the shape
+ records in file order, a present entry replaces or adds the shape of its
+ key and an absent one removes it.
+*/
+
+// Parses a document on a worker thread. Both formats are turned into
+// batches of binary shape records which the view turns into items.
+class DocumentLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DocumentLoader(const QString & fileName , QObject * parent = 0 );
+    // may be called from any thread, loading stops at the next record
+    void cancel();
+    bool isCanceled() const;
+
+    static bool isBinaryFile( const QString & fileName );
+    // the contents of an open file, mapped where possible: they stay valid
+    // until the file is closed. false for files a byte array cannot hold
+    static bool readFile( QFile & file , QByteArray * bytes , QString * error );
+    static void setupBinaryStream( QDataStream & stream );
+    static void writeBinaryHeader( QDataStream & stream , const QSizeF & size );
+    // kinds maps the string table of the file to ShapeRecord values, -1 if unknown
+    static bool readBinaryHeader( QDataStream & stream , QSizeF & size , QVector<int> & kinds );
+    // replays the journal segments at the end of the records of a binary
+    // drawing into plain records, false if there are none
+    static bool applyJournal( const QByteArray & records , const QVector<int> & kinds , QByteArray * resolved );
+    // whether the loaded drawing had changes appended, valid once finished
+    bool hasJournal() const { return m_hasJournal; }
+    // shape records of a binary drawing that can take a journal, -1 otherwise
+    int recordCount() const { return m_recordCount; }
+
+public slots:
+    void load();
+
+signals:
+    void started( const QSizeF & size , const QVector<int> & kinds );
+    void batchReady( const QByteArray & records , int progress );
+    void finished( bool ok , const QString & error );
+
+private:
+    bool loadBinary( const QByteArray & bytes );
+    bool loadXml( const QByteArray & bytes );
+    bool convertXmlShape( QXmlStreamReader * xml , QDataStream * out );
+    void flush( int progress , bool force );
+
+    QString m_fileName;
+    QString m_error;
+    QAtomicInt m_canceled;
+    QByteArray m_batch;
+    int m_batchCount;
+    bool m_hasJournal;
+    int m_recordCount;
+};
+
+#endif // DOCUMENTLOADER
@@ -0,0 +1,253 @@
+#include "documentwriter.h"
+#include <QFile>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QXmlStreamWriter>
+#include "documentloader.h"
+#include "drawobj.h"
+
+// characters of xml collected before they are written to the file
+static const int ChunkSize = 1 << 16;
+
+static bool writeText( QIODevice * device , QString & text )
+{
+    const QByteArray bytes = text.toUtf8();
+    // keeps the capacity for the next chunk
+    text.resize(0);
+    return device->write(bytes) == bytes.size();
+}
+
+static void writeBaseAttributes( QXmlStreamWriter * xml , qreal x , qreal y , qreal z ,
+                                 qreal angle , qreal width , qreal height )
+{
+    writeNumberAttribute(xml,QStringLiteral("rotate"),angle);
+    writeNumberAttribute(xml,QStringLiteral("x"),x);
+    writeNumberAttribute(xml,QStringLiteral("y"),y);
+    writeNumberAttribute(xml,QStringLiteral("z"),z);
+    writeNumberAttribute(xml,QStringLiteral("width"),width);
+    writeNumberAttribute(xml,QStringLiteral("height"),height);
+}
+
+namespace {
+
+class DocumentWriteJob : public QRunnable
+{
+public:
+    DocumentWriteJob( DocumentWriter * writer , QAtomicInt * pending , const DocumentSnapshot & snapshot ,
+                      const QString & fileName , bool remove )
+        :m_writer(writer),m_pending(pending),m_snapshot(snapshot)
+        ,m_fileName(fileName),m_remove(remove)
+    {}
+    void run() Q_DECL_OVERRIDE
+    {
+        if ( m_remove ){
+            QFile::remove(m_fileName);
+        }else{
+            QString error;
+            const bool ok = DocumentWriter::writeFile(m_snapshot,m_fileName,&error);
+            // the writer waits for its pool before it goes away
+            emit m_writer->finished(m_fileName,ok,error);
+        }
+        m_pending->deref();
+    }
+private:
+    DocumentWriter * m_writer;
+    QAtomicInt * m_pending;
+    DocumentSnapshot m_snapshot;
+    QString m_fileName;
+    bool m_remove;
+};
+
+}
+
+DocumentWriter::DocumentWriter(QObject *parent)
+    :QObject(parent)
+    ,m_pending(0)
+{
+    // a single thread keeps the writes of a file in order
+    m_pool.setMaxThreadCount(1);
+}
+
+DocumentWriter::~DocumentWriter()
+{
+    m_pool.waitForDone();
+}
+
+void DocumentWriter::write(const DocumentSnapshot &snapshot, const QString &fileName)
+{
+    m_pending.ref();
+    m_pool.start(new DocumentWriteJob(this,&m_pending,snapshot,fileName,false));
+}
+
+void DocumentWriter::remove(const QString &fileName)
+{
+    m_pending.ref();
+    m_pool.start(new DocumentWriteJob(this,&m_pending,DocumentSnapshot(),fileName,true));
+}
+
+bool DocumentWriter::isBusy() const
+{
+    return m_pending.loadAcquire() != 0;
+}
+
+void DocumentWriter::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+bool DocumentWriter::writeFile(const DocumentSnapshot &snapshot, const QString &fileName, QString *error)
+{
+    if ( snapshot.appendAt >= 0 )
+        return appendFile(snapshot,fileName,error);
+
+    const bool binary = DocumentLoader::isBinaryFile(fileName);
+    QSaveFile file(fileName);
+    if ( !file.open(binary ? QFile::WriteOnly : QFile::WriteOnly | QFile::Text) ){
+        *error = file.errorString();
+        return false;
+    }
+
+    bool ok;
+    if ( binary ){
+        QDataStream stream(&file);
+        DocumentLoader::setupBinaryStream(stream);
+        DocumentLoader::writeBinaryHeader(stream,snapshot.size);
+        ok = stream.status() == QDataStream::Ok &&
+             file.write(snapshot.records) == snapshot.records.size();
+    }else{
+        ok = writeXml(snapshot,&file);
+    }
+    // only commit replaces the target, a failed write leaves it untouched
+    if ( !ok ){
+        *error = file.error() != QFile::NoError ? file.errorString() : tr("Broken shape records");
+        file.cancelWriting();
+        return false;
+    }
+    if ( !file.commit() ){
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// a crash in the middle leaves a cut off segment that loading ignores, a
+// failed write is cut off right away
+bool DocumentWriter::appendFile(const DocumentSnapshot &snapshot, const QString &fileName, QString *error)
+{
+    if ( snapshot.records.isEmpty() )
+        return true;
+    QFile file(fileName);
+    if ( !file.open(QFile::ReadWrite) ){
+        *error = file.errorString();
+        return false;
+    }
+    if ( file.size() != snapshot.appendAt ){
+        *error = tr("The file was changed by another program");
+        return false;
+    }
+    if ( !file.seek(snapshot.appendAt) || file.write(snapshot.records) != snapshot.records.size() ||
+         !file.flush() ){
+        *error = file.errorString();
+        file.resize(snapshot.appendAt);
+        return false;
+    }
+    return true;
+}
+
+// the writer fills a string that goes to the device in large utf-8 chunks,
+// rather than encoding and writing every attribute on its own
+bool DocumentWriter::writeXml(const DocumentSnapshot &snapshot, QIODevice *device)
+{
+    QString text;
+    text.reserve(ChunkSize + ChunkSize / 4);
+    // a string writer leaves the encoding out of the declaration
+    text.append(QLatin1String("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"));
+    QXmlStreamWriter xml(&text);
+    xml.setAutoFormatting(true);
+    xml.writeDTD(QStringLiteral("<!DOCTYPE qdraw>"));
+    xml.writeStartElement(QStringLiteral("canvas"));
+    xml.writeAttribute(QStringLiteral("width"),QString::number(snapshot.size.width()));
+    xml.writeAttribute(QStringLiteral("height"),QString::number(snapshot.size.height()));
+
+    QDataStream in(snapshot.records);
+    DocumentLoader::setupBinaryStream(in);
+    while ( !in.atEnd() ) {
+        if ( !convertRecord(&in,&xml) )
+            return false;
+        if ( text.size() >= ChunkSize && !writeText(device,text) )
+            return false;
+    }
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    return writeText(device,text);
+}
+
+// writes a record as the element the shapes write in saveToXml, the
+// inverse of DocumentLoader::convertXmlShape
+bool DocumentWriter::convertRecord(QDataStream *in, QXmlStreamWriter *xml)
+{
+    quint8 kind = 0;
+    quint32 size = 0;
+    *in >> kind >> size;
+    if ( in->status() != QDataStream::Ok || kind >= JournalRecord )
+        return false;
+
+    xml->writeStartElement(shapeRecordName(kind));
+    if ( kind == GroupRecord ){
+        qreal x, y, angle;
+        quint32 count = 0;
+        *in >> x >> y >> angle >> count;
+        writeNumberAttribute(xml,QStringLiteral("x"),x);
+        writeNumberAttribute(xml,QStringLiteral("y"),y);
+        writeNumberAttribute(xml,QStringLiteral("rotate"),angle);
+        for ( quint32 i = 0 ; i < count ; ++i ){
+            if ( !convertRecord(in,xml) )
+                return false;
+        }
+        xml->writeEndElement();
+        return in->status() == QDataStream::Ok;
+    }
+
+    qreal x, y, z, angle, width, height;
+    *in >> x >> y >> z >> angle >> width >> height;
+    switch ( kind ) {
+    case RectRecord:
+        writeBaseAttributes(xml,x,y,z,angle,width,height);
+        break;
+    case RoundRectRecord:
+    {
+        qreal rx, ry;
+        *in >> rx >> ry;
+        writeNumberAttribute(xml,QStringLiteral("rx"),rx);
+        writeNumberAttribute(xml,QStringLiteral("ry"),ry);
+        writeBaseAttributes(xml,x,y,z,angle,width,height);
+    }
+        break;
+    case EllipseRecord:
+    {
+        qint32 startAngle, spanAngle;
+        *in >> startAngle >> spanAngle;
+        writeNumberAttribute(xml,QStringLiteral("startAngle"),startAngle);
+        writeNumberAttribute(xml,QStringLiteral("spanAngle"),spanAngle);
+        writeBaseAttributes(xml,x,y,z,angle,width,height);
+    }
+        break;
+    default:
+    {
+        writeBaseAttributes(xml,x,y,z,angle,width,height);
+        quint32 count = 0;
+        *in >> count;
+        for ( quint32 i = 0 ; i < count && in->status() == QDataStream::Ok ; ++i ){
+            qreal px, py;
+            *in >> px >> py;
+            xml->writeStartElement(QStringLiteral("point"));
+            writeNumberAttribute(xml,QStringLiteral("x"),px);
+            writeNumberAttribute(xml,QStringLiteral("y"),py);
+            xml->writeEndElement();
+        }
+    }
+        break;
+    }
+    xml->writeEndElement();
+    return in->status() == QDataStream::Ok;
+}
@@ -0,0 +1,61 @@
+#ifndef DOCUMENTWRITER
+#define DOCUMENTWRITER
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QSizeF>
+#include <QThreadPool>
+
+QT_BEGIN_NAMESPACE
+class QDataStream;
+class QIODevice;
+class QXmlStreamWriter;
+QT_END_NAMESPACE
+
+// The top-level shapes of a document as binary records, without the file
+// header, see DocumentLoader. Taken on the gui thread and only read afterwards.
+struct DocumentSnapshot
+{
+    DocumentSnapshot() : appendAt(-1) {}
+    QSizeF size;
+    QByteArray records;
+    // a journal segment for the end of a binary drawing of this size, -1
+    // for a whole drawing, see Document::saveSnapshot
+    qint64 appendAt;
+};
+
+// Writes document snapshots on a worker thread. A file is written next to
+// its target and renamed over it once complete, so a crash or a full disk
+// in the middle of a save leaves the previous version intact.
+class DocumentWriter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DocumentWriter( QObject * parent = 0 );
+    // waits for the queued writes
+    ~DocumentWriter();
+
+    // the format follows the file name, journal segments are appended in
+    // place. writes and removals run one at a time, in the order they were queued
+    void write( const DocumentSnapshot & snapshot , const QString & fileName );
+    void remove( const QString & fileName );
+    bool isBusy() const;
+    void waitForDone();
+
+    static bool writeFile( const DocumentSnapshot & snapshot , const QString & fileName , QString * error );
+
+signals:
+    // emitted on the worker thread for every write
+    void finished( const QString & fileName , bool ok , const QString & error );
+
+private:
+    static bool appendFile( const DocumentSnapshot & snapshot , const QString & fileName , QString * error );
+    static bool writeXml( const DocumentSnapshot & snapshot , QIODevice * device );
+    static bool convertRecord( QDataStream * in , QXmlStreamWriter * xml );
+
+    QThreadPool m_pool;
+    QAtomicInt m_pending;
+};
+
+#endif // DOCUMENTWRITER
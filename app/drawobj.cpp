@@ -53,6 +53,118 @@ static QPainterPath qt_graphicsItem_shapeFromPath(const QPainterPath &path, cons
     return p;
 }
 
+QString shapeRecordName(int record)
+{
+    static const char * const names[RecordCount] = {
+        "rect", "roundrect", "ellipse", "polygon",
+        "bezier", "polyline", "line", "group", "journal"
+    };
+    if ( record < 0 || record >= RecordCount )
+        return QString();
+    return QLatin1String(names[record]);
+}
+
+void writeNumberAttribute(QXmlStreamWriter *xml, const QString &name, qreal value)
+{
+    // integral values, most of a drawing, are formatted on the stack the way
+    // QString::number does and handed to the writer without a copy
+    if ( qAbs(value) < 1e6 && value == qreal(qint64(value)) ){
+        QChar digits[8];
+        int i = 8;
+        qint64 n = qAbs(qint64(value));
+        do {
+            digits[--i] = QLatin1Char('0' + n % 10);
+            n /= 10;
+        } while ( n );
+        if ( value < 0 )
+            digits[--i] = QLatin1Char('-');
+        xml->writeAttribute(name,QString::fromRawData(digits + i,8 - i));
+        return;
+    }
+    xml->writeAttribute(name,QString::number(value));
+}
+
+qint64 beginShapeRecord(QDataStream *stream, int record)
+{
+    *stream << quint8(record);
+    const qint64 start = stream->device()->pos();
+    // payload size, patched by endShapeRecord
+    *stream << quint32(0);
+    return start;
+}
+
+void endShapeRecord(QDataStream *stream, qint64 start)
+{
+    QIODevice * device = stream->device();
+    const qint64 end = device->pos();
+    device->seek(start);
+    *stream << quint32(end - start - sizeof(quint32));
+    device->seek(end);
+}
+
+static void writePoints( QDataStream * stream , const QPolygonF & points )
+{
+    *stream << quint32(points.size());
+    for ( int i = 0 ; i < points.size() ; ++i )
+        *stream << points[i].x() << points[i].y();
+}
+
+static bool readPoints( QDataStream * stream , QPolygonF & points )
+{
+    quint32 count = 0;
+    *stream >> count;
+    // a corrupt count must not turn into a huge allocation
+    const qint64 available = stream->device()->bytesAvailable();
+    if ( stream->status() != QDataStream::Ok ||
+         count > available / qint64(2 * sizeof(double)) ){
+        stream->setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+    points.resize(count);
+    // the stored layout matches QPointF on little endian hosts, so the
+    // coordinates are copied straight into the polygon storage
+    if ( QSysInfo::ByteOrder == QSysInfo::LittleEndian && sizeof(qreal) == sizeof(double) &&
+         stream->byteOrder() == QDataStream::LittleEndian ){
+        const int size = int(count * 2 * sizeof(double));
+        return stream->readRawData(reinterpret_cast<char*>(points.data()),size) == size;
+    }
+    for ( quint32 i = 0 ; i < count ; ++i ){
+        qreal x, y;
+        *stream >> x >> y;
+        points[i] = QPointF(x,y);
+    }
+    return stream->status() == QDataStream::Ok;
+}
+
+static void updateSceneSelection( QGraphicsItem * item , QGraphicsScene * scene , bool selected )
+{
+    DrawScene * drawScene = qobject_cast<DrawScene*>(scene);
+    if ( drawScene )
+        drawScene->updateSelection(item,selected);
+}
+
+static void updateSceneShape( QGraphicsItem * item , QGraphicsScene * scene , bool topLevel )
+{
+    DrawScene * drawScene = qobject_cast<DrawScene*>(scene);
+    if ( drawScene )
+        drawScene->updateShape(item,topLevel);
+}
+
+static void markSceneShapeChanged( QGraphicsItem * item , QGraphicsScene * scene )
+{
+    DrawScene * drawScene = qobject_cast<DrawScene*>(scene);
+    if ( drawScene )
+        drawScene->markShapeChanged(item);
+}
+
+// handles follow every change of geometry, so do the bounds in the index
+static void updateSceneShapeBounds( QGraphicsItem * item , QGraphicsScene * scene )
+{
+    DrawScene * drawScene = qobject_cast<DrawScene*>(scene);
+    if ( drawScene )
+        drawScene->updateShapeBounds(item);
+}
+
 static void qt_graphicsItem_highlightSelected(
     QGraphicsItem *item, QPainter *painter, const QStyleOptionGraphicsItem *option)
 {
@@ -108,6 +220,27 @@ static void qt_graphicsItem_highlightSelected(
 
 }
 
+// shapes smaller than this many pixels are painted as a filled box
+static const qreal LodBoxPixels = 3;
+// below this size selection decoration is left out and curves are flattened
+static const qreal LodDetailPixels = 12;
+
+static qreal itemPixels( QGraphicsItem * item , QPainter * painter , const QStyleOptionGraphicsItem * option )
+{
+    const QRectF bounds = item->boundingRect();
+    return qMax(bounds.width(),bounds.height()) *
+            option->levelOfDetailFromTransform(painter->worldTransform());
+}
+
+static bool paintLowDetail( QGraphicsItem * item , QPainter * painter , qreal pixels ,
+                            const QPen & pen , const QBrush & brush )
+{
+    if ( pixels >= LodBoxPixels )
+        return false;
+    painter->fillRect(item->boundingRect(),brush.style() != Qt::NoBrush ? brush.color() : pen.color());
+    return true;
+}
+
 GraphicsItem::GraphicsItem(QGraphicsItem *parent)
     :AbstractShapeType<QGraphicsItem>(parent)
 {
@@ -119,10 +252,8 @@ GraphicsItem::GraphicsItem(QGraphicsItem *parent)
    */
     // handles
     m_handles.reserve(Left);
-    for (int i = LeftTop; i <= Left; ++i) {
-        SizeHandleRect *shr = new SizeHandleRect(this,i);
-        m_handles.push_back(shr);
-    }
+    for (int i = LeftTop; i <= Left; ++i)
+        m_handles.push_back(SelectionHandle(i));
 
     setFlag(QGraphicsItem::ItemIsMovable, true);
     setFlag(QGraphicsItem::ItemIsSelectable, true);
@@ -130,6 +261,12 @@ GraphicsItem::GraphicsItem(QGraphicsItem *parent)
     this->setAcceptHoverEvents(true);
 }
 
+GraphicsItem::~GraphicsItem()
+{
+    if ( isSelected() )
+        updateSceneSelection(this,scene(),false);
+    updateSceneShape(this,scene(),false);
+}
 
 QPixmap GraphicsItem::image() {
     QPixmap pixmap(64, 64);
@@ -147,11 +284,12 @@ QPixmap GraphicsItem::image() {
 
 void GraphicsItem::updatehandles()
 {
+    updateSceneShapeBounds(this,scene());
     const QRectF &geom = this->boundingRect();
 
     const Handles::iterator hend =  m_handles.end();
     for (Handles::iterator it = m_handles.begin(); it != hend; ++it) {
-        SizeHandleRect *hndl = *it;;
+        SelectionHandle *hndl = &(*it);
         switch (hndl->dir()) {
         case LeftTop:
             hndl->move(geom.x() , geom.y() );
@@ -200,27 +338,62 @@ bool GraphicsItem::readBaseAttributes(QXmlStreamReader *xml)
     return true;
 }
 
-bool GraphicsItem::writeBaseAttributes(QXmlStreamWriter *xml)
+bool GraphicsItem::writeBaseAttributes(QXmlStreamWriter *xml, const QPointF &position)
 {
-    xml->writeAttribute(tr("rotate"),QString("%1").arg(rotation()));
-    xml->writeAttribute(tr("x"),QString("%1").arg(pos().x()));
-    xml->writeAttribute(tr("y"),QString("%1").arg(pos().y()));
-    xml->writeAttribute(tr("z"),QString("%1").arg(zValue()));
-    xml->writeAttribute(tr("width"),QString("%1").arg(m_width));
-    xml->writeAttribute(tr("height"),QString("%1").arg(m_height));
+    writeNumberAttribute(xml,QStringLiteral("rotate"),rotation());
+    writeNumberAttribute(xml,QStringLiteral("x"),position.x());
+    writeNumberAttribute(xml,QStringLiteral("y"),position.y());
+    writeNumberAttribute(xml,QStringLiteral("z"),zValue());
+    writeNumberAttribute(xml,QStringLiteral("width"),m_width);
+    writeNumberAttribute(xml,QStringLiteral("height"),m_height);
     return true;
 }
 
+bool GraphicsItem::readBaseBinary(QDataStream *stream)
+{
+    qreal x, y, z, angle;
+    *stream >> x >> y >> z >> angle >> m_width >> m_height;
+    setZValue(z);
+    setRotation(angle);
+    setPos(x,y);
+    return stream->status() == QDataStream::Ok;
+}
+
+bool GraphicsItem::writeBaseBinary(QDataStream *stream, const QPointF &position)
+{
+    *stream << position.x() << position.y() << zValue() << rotation() << m_width << m_height;
+    return stream->status() == QDataStream::Ok;
+}
+
 QVariant GraphicsItem::itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant &value)
 {
     if ( change == QGraphicsItem::ItemSelectedHasChanged ) {
         QGraphicsItemGroup *g = dynamic_cast<QGraphicsItemGroup*>(parentItem());
-        if (!g)
-            setState(value.toBool() ? SelectionHandleActive : SelectionHandleOff);
-        else{
+        if ( g ){
             setSelected(false);
             return QVariant::fromValue<bool>(false);
         }
+        updateSceneSelection(this,scene(),value.toBool());
+    }else if ( change == QGraphicsItem::ItemSceneChange ){
+        if ( isSelected() )
+            updateSceneSelection(this,scene(),false);
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),false);
+    }else if ( change == QGraphicsItem::ItemSceneHasChanged ){
+        if ( isSelected() )
+            updateSceneSelection(this,scene(),true);
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),true);
+    }else if ( change == QGraphicsItem::ItemParentChange ){
+        updateSceneShape(this,scene(),false);
+    }else if ( change == QGraphicsItem::ItemParentHasChanged ){
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),true);
+    }else if ( change == QGraphicsItem::ItemPositionHasChanged ||
+               change == QGraphicsItem::ItemRotationHasChanged ||
+               change == QGraphicsItem::ItemZValueHasChanged ||
+               change == QGraphicsItem::ItemTransformHasChanged ){
+        markSceneShapeChanged(this,scene());
     }
     /*
     else if (change == ItemPositionChange && scene()) {
@@ -253,12 +426,9 @@ GraphicsRectItem::GraphicsRectItem(const QRect & rect , bool isRound , QGraphics
     m_localRect = rect;
     m_originPoint = QPointF(0,0);
     if( m_isRound ){
-        SizeHandleRect *shr = new SizeHandleRect(this, 9 , true);
-        m_handles.push_back(shr);
-        shr = new SizeHandleRect(this, 10 , true);
-        m_handles.push_back(shr);
-        //shr = new SizeHandleRect(this, 11 , true);
-        //m_handles.push_back(shr);
+        m_handles.push_back(SelectionHandle(9 , true));
+        m_handles.push_back(SelectionHandle(10 , true));
+        //m_handles.push_back(SelectionHandle(11 , true));
     }
 
     updatehandles();
@@ -427,29 +597,49 @@ bool GraphicsRectItem::loadFromXml(QXmlStreamReader * xml )
     return true;
 }
 
-bool GraphicsRectItem::saveToXml(QXmlStreamWriter * xml)
+bool GraphicsRectItem::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
     if ( m_isRound ){
-        xml->writeStartElement(tr("roundrect"));
-        xml->writeAttribute(tr("rx"),QString("%1").arg(m_fRatioX));
-        xml->writeAttribute(tr("ry"),QString("%1").arg(m_fRatioY));
+        xml->writeStartElement(QStringLiteral("roundrect"));
+        writeNumberAttribute(xml,QStringLiteral("rx"),m_fRatioX);
+        writeNumberAttribute(xml,QStringLiteral("ry"),m_fRatioY);
     }
     else
-        xml->writeStartElement(tr("rect"));
+        xml->writeStartElement(QStringLiteral("rect"));
 
-    writeBaseAttributes(xml);
+    writeBaseAttributes(xml,framePos(frame,m_localRect.center()));
     xml->writeEndElement();
     return true;
 }
 
+bool GraphicsRectItem::loadFromBinary(QDataStream *stream)
+{
+    if ( !readBaseBinary(stream) )
+        return false;
+    if ( m_isRound )
+        *stream >> m_fRatioX >> m_fRatioY;
+    updateCoordinate();
+    return stream->status() == QDataStream::Ok;
+}
+
+bool GraphicsRectItem::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    qint64 record = beginShapeRecord(stream, m_isRound ? RoundRectRecord : RectRecord);
+    writeBaseBinary(stream,framePos(frame,m_localRect.center()));
+    if ( m_isRound )
+        *stream << m_fRatioX << m_fRatioY;
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
 void GraphicsRectItem::updatehandles()
 {
     const QRectF &geom = this->boundingRect();
     GraphicsItem::updatehandles();
     if ( m_isRound ){
-        m_handles[8]->move( geom.right() , geom.top() + geom.height() * m_fRatioY );
-        m_handles[9]->move( geom.right() - geom.width() * m_fRatioX , geom.top());
-        //m_handles[10]->move(m_originPoint.x(),m_originPoint.y());
+        m_handles[8].move( geom.right() , geom.top() + geom.height() * m_fRatioY );
+        m_handles[9].move( geom.right() - geom.width() * m_fRatioX , geom.top());
+        //m_handles[10].move(m_originPoint.x(),m_originPoint.y());
     }
 }
 
@@ -474,6 +664,9 @@ QRectF RecalcBounds(const QPolygonF&  pts)
 
 void GraphicsRectItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
+   const qreal pixels = itemPixels(this,painter,option);
+   if ( paintLowDetail(this,painter,pixels,pen(),brush()) )
+       return;
 
    painter->setPen(pen());
    painter->setBrush(brush());
@@ -492,6 +685,9 @@ void GraphicsRectItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *
    else
        painter->drawRect(rect().toRect());
 
+   if ( pixels < LodDetailPixels )
+       return;
+
    painter->setPen(Qt::blue);
    painter->drawLine(QLine(QPoint(opposite_.x()-6,opposite_.y()),QPoint(opposite_.x()+6,opposite_.y())));
    painter->drawLine(QLine(QPoint(opposite_.x(),opposite_.y()-6),QPoint(opposite_.x(),opposite_.y()+6)));
@@ -526,22 +722,17 @@ GraphicsLineItem::GraphicsLineItem(QGraphicsItem *parent)
 {
     m_pen = QPen(Qt::black);
     // handles
-    m_handles.reserve(Left);
-
-    Handles::iterator hend =  m_handles.end();
-    for (Handles::iterator it = m_handles.begin(); it != hend; ++it)
-       delete (*it);
     m_handles.clear();
 }
 
-QPainterPath GraphicsLineItem::shape() const
+QPainterPath GraphicsLineItem::buildPath() const
 {
     QPainterPath path;
     if ( m_points.size() > 1 ){
         path.moveTo(m_points.at(0));
         path.lineTo(m_points.at(1));
     }
-    return qt_graphicsItem_shapeFromPath(path,pen());
+    return path;
 }
 
 QGraphicsItem *GraphicsLineItem::duplicate() const
@@ -550,6 +741,7 @@ QGraphicsItem *GraphicsLineItem::duplicate() const
     item->m_width = width();
     item->m_height = height();
     item->m_points = m_points;
+    item->invalidatePath();
     item->m_initialPoints = m_initialPoints;
     item->setPos(pos().x(),pos().y());
     item->setPen(pen());
@@ -565,11 +757,12 @@ QGraphicsItem *GraphicsLineItem::duplicate() const
 
 void GraphicsLineItem::addPoint(const QPointF &point)
 {
+    prepareGeometryChange();
     m_points.append(mapFromScene(point));
+    invalidatePath();
     int dir = m_points.count();
-    SizeHandleRect *shr = new SizeHandleRect(this, dir+Left, dir == 1 ? false : true);
-    shr->setState(SelectionHandleActive);
-    m_handles.push_back(shr);
+    m_handles.push_back(SelectionHandle(dir+Left, dir == 1 ? false : true));
+    m_handles.back().move(m_points.last().x(),m_points.last().y());
 }
 
 
@@ -580,8 +773,9 @@ void GraphicsLineItem::endPoint(const QPointF &point)
     if( nPoints > 2 && (m_points[nPoints-1] == m_points[nPoints-2] ||
         m_points[nPoints-1].x() - 1 == m_points[nPoints-2].x() &&
         m_points[nPoints-1].y() == m_points[nPoints-2].y())){
-        delete m_handles[ nPoints-1];
+        prepareGeometryChange();
         m_points.remove(nPoints-1);
+        invalidatePath();
         m_handles.resize(nPoints-1);
     }
     m_initialPoints = m_points;
@@ -596,12 +790,12 @@ QPointF GraphicsLineItem::opposite(int handle)
     case Top:
     case LeftTop:
     case RightTop:
-        pt = m_handles[1]->pos();
+        pt = m_handles[1].pos();
         break;
     case RightBottom:
     case LeftBottom:
     case Bottom:
-        pt = m_handles[0]->pos();
+        pt = m_handles[0].pos();
         break;
      }
     return pt;
@@ -628,6 +822,7 @@ void GraphicsLineItem::stretch(int handle, double sx, double sy, const QPointF &
 
     prepareGeometryChange();
     m_points = trans.map(m_initialPoints);
+    invalidatePath();
     m_localRect = m_points.boundingRect();
     m_width = m_localRect.width();
     m_height = m_localRect.height();
@@ -643,44 +838,69 @@ bool GraphicsLineItem::loadFromXml(QXmlStreamReader *xml)
             qreal y = xml->attributes().value("y").toDouble();
             m_points.append(QPointF(x,y));
             int dir = m_points.count();
-            SizeHandleRect *shr = new SizeHandleRect(this, dir+Left, dir == 1 ? false : true);
-            m_handles.push_back(shr);
+            m_handles.push_back(SelectionHandle(dir+Left, dir == 1 ? false : true));
             xml->skipCurrentElement();
         }else
             xml->skipCurrentElement();
     }
+    invalidatePath();
     updatehandles();
     return true;
 }
 
-bool GraphicsLineItem::saveToXml(QXmlStreamWriter *xml)
+bool GraphicsLineItem::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
-    xml->writeStartElement("line");
-    writeBaseAttributes(xml);
+    xml->writeStartElement(QStringLiteral("line"));
+    writeBaseAttributes(xml,framePos(frame));
     for ( int i = 0 ; i < m_points.count();++i){
-        xml->writeStartElement("point");
-        xml->writeAttribute("x",QString("%1").arg(m_points[i].x()));
-        xml->writeAttribute("y",QString("%1").arg(m_points[i].y()));
+        xml->writeStartElement(QStringLiteral("point"));
+        writeNumberAttribute(xml,QStringLiteral("x"),m_points[i].x());
+        writeNumberAttribute(xml,QStringLiteral("y"),m_points[i].y());
         xml->writeEndElement();
     }
     xml->writeEndElement();
     return true;
 }
 
+bool GraphicsLineItem::loadFromBinary(QDataStream *stream)
+{
+    if ( !readBaseBinary(stream) || !readPoints(stream,m_points) )
+        return false;
+    m_handles.clear();
+    for ( int i = 0 ; i < m_points.size() ; ++i ){
+        int dir = i + 1;
+        m_handles.push_back(SelectionHandle(dir+Left, dir == 1 ? false : true));
+    }
+    invalidatePath();
+    updatehandles();
+    return true;
+}
+
+bool GraphicsLineItem::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    qint64 record = beginShapeRecord(stream,LineRecord);
+    writeBaseBinary(stream,framePos(frame));
+    writePoints(stream,m_points);
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
 void GraphicsLineItem::updatehandles()
 {
+    updateSceneShapeBounds(this,scene());
     for ( int i = 0 ; i < m_points.size() ; ++i ){
-        m_handles[i]->move(m_points[i].x() ,m_points[i].y() );
+        m_handles[i].move(m_points[i].x() ,m_points[i].y() );
     }
 }
 
 void GraphicsLineItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    Q_UNUSED(option);
     Q_UNUSED(widget);
+    if ( paintLowDetail(this,painter,itemPixels(this,painter,option),pen(),QBrush()) )
+        return;
     painter->setPen(pen());
     if ( m_points.size() > 1)
-    painter->drawLine(m_points.at(0),m_points.at(1));
+        painter->drawPath(path());
 }
 
 GraphicsItemGroup::GraphicsItemGroup(QGraphicsItem *parent)
@@ -690,10 +910,8 @@ GraphicsItemGroup::GraphicsItemGroup(QGraphicsItem *parent)
     itemsBoundingRect = QRectF();
     // handles
     m_handles.reserve(Left);
-    for (int i = LeftTop; i <= Left; ++i) {
-        SizeHandleRect *shr = new SizeHandleRect(this, i);
-        m_handles.push_back(shr);
-    }
+    for (int i = LeftTop; i <= Left; ++i)
+        m_handles.push_back(SelectionHandle(i));
     setFlag(QGraphicsItem::ItemIsMovable, true);
     setFlag(QGraphicsItem::ItemIsSelectable, true);
     setFlag(QGraphicsItem::ItemSendsGeometryChanges, true);
@@ -708,7 +926,9 @@ QRectF GraphicsItemGroup::boundingRect() const
 
 GraphicsItemGroup::~GraphicsItemGroup()
 {
-
+    if ( isSelected() )
+        updateSceneSelection(this,scene(),false);
+    updateSceneShape(this,scene(),false);
 }
 
 bool GraphicsItemGroup::loadFromXml(QXmlStreamReader *xml)
@@ -717,26 +937,57 @@ bool GraphicsItemGroup::loadFromXml(QXmlStreamReader *xml)
     return true;
 }
 
-bool GraphicsItemGroup::saveToXml(QXmlStreamWriter *xml)
+bool GraphicsItemGroup::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
-    xml->writeStartElement("group");
-    xml->writeAttribute(tr("x"),QString("%1").arg(pos().x()));
-    xml->writeAttribute(tr("y"),QString("%1").arg(pos().y()));
-    xml->writeAttribute(tr("rotate"),QString("%1").arg(rotation()));
+    const QPointF position = framePos(frame);
+    xml->writeStartElement(QStringLiteral("group"));
+    writeNumberAttribute(xml,QStringLiteral("x"),position.x());
+    writeNumberAttribute(xml,QStringLiteral("y"),position.y());
+    writeNumberAttribute(xml,QStringLiteral("rotate"),rotation());
 
+    const QTransform children = childFrame(frame);
     foreach (QGraphicsItem * item , childItems()) {
-        removeFromGroup(item);
         AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
-        if ( ab &&!qgraphicsitem_cast<SizeHandleRect*>(ab)){
-            ab->updateCoordinate();
-            ab->saveToXml(xml);
-        }
-        addToGroup(item);
+        if ( ab)
+            ab->saveToXml(xml,children);
     }
     xml->writeEndElement();
     return true;
 }
 
+bool GraphicsItemGroup::loadFromBinary(QDataStream *stream)
+{
+    // the children are read by the view, see Document::loadGroupFromBinary
+    Q_UNUSED(stream);
+    return true;
+}
+
+bool GraphicsItemGroup::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    const QPointF position = framePos(frame);
+    qint64 record = beginShapeRecord(stream,GroupRecord);
+    *stream << position.x() << position.y() << rotation();
+
+    const QTransform children = childFrame(frame);
+    QList<QGraphicsItem *> items = childItems();
+    *stream << quint32(items.count());
+    foreach (QGraphicsItem * item , items) {
+        AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
+        if ( ab)
+            ab->saveToBinary(stream,children);
+    }
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
+// the loader places the children top-level and then rotates their group
+// about its center, so they are saved through the group's transform and
+// position alone. the scene is left untouched, snapshots are taken often
+QTransform GraphicsItemGroup::childFrame(const QTransform &frame) const
+{
+    return transform() * QTransform::fromTranslate(pos().x(),pos().y()) * frame;
+}
+
 QGraphicsItem *GraphicsItemGroup::duplicate() const
 {
     GraphicsItemGroup *item = 0;
@@ -784,7 +1035,7 @@ void GraphicsItemGroup::stretch(int handle, double sx, double sy, const QPointF
 
     foreach (QGraphicsItem *item , childItems()) {
          AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
-         if (ab && !qgraphicsitem_cast<SizeHandleRect*>(ab)){
+         if (ab){
              ab->stretch(handle,sx,sy,ab->mapFromParent(origin));
          }
     }
@@ -822,7 +1073,7 @@ void GraphicsItemGroup::updateCoordinate()
 
     foreach (QGraphicsItem *item , childItems()) {
          AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
-         if (ab && !qgraphicsitem_cast<SizeHandleRect*>(ab))
+         if (ab)
              ab->updateCoordinate();
     }
     updatehandles();
@@ -877,7 +1128,7 @@ QList<QGraphicsItem *> GraphicsItemGroup::duplicateItems() const
     QList<QGraphicsItem*> copylist ;
     foreach (QGraphicsItem * shape , childItems() ) {
         AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(shape);
-        if ( ab && !qgraphicsitem_cast<SizeHandleRect*>(ab)){
+        if ( ab){
             QGraphicsItem * cp = ab->duplicate();
             //if ( !cp->scene() )
             //    scene()->addItem(cp);
@@ -889,11 +1140,12 @@ QList<QGraphicsItem *> GraphicsItemGroup::duplicateItems() const
 
 void GraphicsItemGroup::updatehandles()
 {
+    updateSceneShapeBounds(this,scene());
     const QRectF &geom = this->boundingRect();
 
     const Handles::iterator hend =  m_handles.end();
     for (Handles::iterator it = m_handles.begin(); it != hend; ++it) {
-        SizeHandleRect *hndl = *it;;
+        SelectionHandle *hndl = &(*it);
         switch (hndl->dir()) {
         case LeftTop:
             hndl->move(geom.x() , geom.y() );
@@ -932,15 +1184,34 @@ QVariant GraphicsItemGroup::itemChange(QGraphicsItem::GraphicsItemChange change,
 {
     if ( change == QGraphicsItem::ItemSelectedHasChanged ) {
         QGraphicsItemGroup *g = dynamic_cast<QGraphicsItemGroup*>(parentItem());
-        if (!g)
-            setState(value.toBool() ? SelectionHandleActive : SelectionHandleOff);
-        else{
+        if ( g ){
             setSelected(false);
             return QVariant::fromValue<bool>(false);
         }
         if( value.toBool()){
             updateCoordinate();
         }
+        updateSceneSelection(this,scene(),value.toBool());
+    }else if ( change == QGraphicsItem::ItemSceneChange ){
+        if ( isSelected() )
+            updateSceneSelection(this,scene(),false);
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),false);
+    }else if ( change == QGraphicsItem::ItemSceneHasChanged ){
+        if ( isSelected() )
+            updateSceneSelection(this,scene(),true);
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),true);
+    }else if ( change == QGraphicsItem::ItemParentChange ){
+        updateSceneShape(this,scene(),false);
+    }else if ( change == QGraphicsItem::ItemParentHasChanged ){
+        if ( !parentItem() )
+            updateSceneShape(this,scene(),true);
+    }else if ( change == QGraphicsItem::ItemPositionHasChanged ||
+               change == QGraphicsItem::ItemRotationHasChanged ||
+               change == QGraphicsItem::ItemZValueHasChanged ||
+               change == QGraphicsItem::ItemTransformHasChanged ){
+        markSceneShapeChanged(this,scene());
     }
     /*
     else if (change == ItemPositionChange && scene()) {
@@ -964,7 +1235,7 @@ void GraphicsItemGroup::paint(QPainter *painter, const QStyleOptionGraphicsItem
 //    Q_UNUSED(option);
     Q_UNUSED(widget);
 //    Q_UNUSED(painter);
-    if (option->state & QStyle::State_Selected)
+    if ((option->state & QStyle::State_Selected) && itemPixels(this,painter,option) >= LodDetailPixels)
         qt_graphicsItem_highlightSelected(this, painter, option);
 }
 
@@ -975,9 +1246,11 @@ GraphicsBezier::GraphicsBezier(bool bbezier,QGraphicsItem *parent)
     m_brush = QBrush(Qt::NoBrush);
 }
 
-QPainterPath GraphicsBezier::shape() const
+QPainterPath GraphicsBezier::buildPath() const
 {
     QPainterPath path;
+    if ( m_points.isEmpty() )
+        return path;
     path.moveTo(m_points.at(0));
     int i=1;
     while (m_isBezier && ( i + 2 < m_points.size())) {
@@ -988,8 +1261,7 @@ QPainterPath GraphicsBezier::shape() const
         path.lineTo(m_points.at(i));
         ++i;
     }
-
-    return qt_graphicsItem_shapeFromPath(path,pen());
+    return path;
 }
 
 QGraphicsItem *GraphicsBezier::duplicate() const
@@ -999,8 +1271,9 @@ QGraphicsItem *GraphicsBezier::duplicate() const
     item->m_height = height();
     item->m_points = m_points;
     item->m_isBezier = m_isBezier;
+    item->invalidatePath();
     for ( int i = 0 ; i < m_points.size() ; ++i ){
-        item->m_handles.push_back(new SizeHandleRect(item,Left+i+1,true));
+        item->m_handles.push_back(SelectionHandle(Left+i+1,true));
     }
     item->setPos(pos().x(),pos().y());
     item->setPen(pen());
@@ -1017,22 +1290,23 @@ QGraphicsItem *GraphicsBezier::duplicate() const
 bool GraphicsBezier::loadFromXml(QXmlStreamReader *xml)
 {
     m_isBezier = (xml->name() == tr("bezier"));
+    invalidatePath();
     return GraphicsPolygonItem::loadFromXml(xml);
 }
 
-bool GraphicsBezier::saveToXml(QXmlStreamWriter *xml)
+bool GraphicsBezier::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
     if ( m_isBezier )
-        xml->writeStartElement("bezier");
+        xml->writeStartElement(QStringLiteral("bezier"));
     else
-        xml->writeStartElement("polyline");
+        xml->writeStartElement(QStringLiteral("polyline"));
 
-    writeBaseAttributes(xml);
+    writeBaseAttributes(xml,framePos(frame));
 
     for ( int i = 0 ; i < m_points.count();++i){
-        xml->writeStartElement("point");
-        xml->writeAttribute("x",QString("%1").arg(m_points[i].x()));
-        xml->writeAttribute("y",QString("%1").arg(m_points[i].y()));
+        xml->writeStartElement(QStringLiteral("point"));
+        writeNumberAttribute(xml,QStringLiteral("x"),m_points[i].x());
+        writeNumberAttribute(xml,QStringLiteral("y"),m_points[i].y());
         xml->writeEndElement();
     }
     xml->writeEndElement();
@@ -1040,26 +1314,50 @@ bool GraphicsBezier::saveToXml(QXmlStreamWriter *xml)
     return true;
 }
 
+bool GraphicsBezier::loadFromBinary(QDataStream *stream)
+{
+    invalidatePath();
+    return GraphicsPolygonItem::loadFromBinary(stream);
+}
+
+bool GraphicsBezier::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    qint64 record = beginShapeRecord(stream, m_isBezier ? BezierRecord : PolylineRecord);
+    writeBaseBinary(stream,framePos(frame));
+    writePoints(stream,m_points);
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
 void GraphicsBezier::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    Q_UNUSED(option);
     Q_UNUSED(widget);
 
-    QPainterPath path;
+    const qreal pixels = itemPixels(this,painter,option);
+    if ( paintLowDetail(this,painter,pixels,pen(),brush()) )
+        return;
+
     painter->setPen(pen());
     painter->setBrush(brush());
-    path.moveTo(m_points.at(0));
-
-    int i=1;
-    while (m_isBezier && ( i + 2 < m_points.size())) {
-        path.cubicTo(m_points.at(i), m_points.at(i+1), m_points.at(i+2));
-        i += 3;
-    }
-    while (i < m_points.size()) {
-        path.lineTo(m_points.at(i));
-        ++i;
+    if ( m_isBezier && pixels < LodDetailPixels ){
+        // too small for the curvature to show, connect the end points of the segments
+        QPolygonF anchors;
+        if ( !m_points.isEmpty() )
+            anchors.append(m_points.at(0));
+        int i = 1;
+        while ( i + 2 < m_points.size() ) {
+            anchors.append(m_points.at(i+2));
+            i += 3;
+        }
+        while ( i < m_points.size() )
+            anchors.append(m_points.at(i++));
+        painter->drawPolyline(anchors);
+        return;
     }
-    painter->drawPath(path);
+    painter->drawPath(path());
+
+    if ( pixels < LodDetailPixels )
+        return;
 
    if (option->state & QStyle::State_Selected){
        painter->setPen(QPen(Qt::lightGray, 0, Qt::SolidLine));
@@ -1077,10 +1375,8 @@ GraphicsEllipseItem::GraphicsEllipseItem(const QRect & rect ,QGraphicsItem *pare
 {
     m_startAngle = 40;
     m_spanAngle  = 400;
-    SizeHandleRect *shr = new SizeHandleRect(this, 9 , true);
-    m_handles.push_back(shr);
-    shr = new SizeHandleRect(this, 10 , true);
-    m_handles.push_back(shr);
+    m_handles.push_back(SelectionHandle(9 , true));
+    m_handles.push_back(SelectionHandle(10 , true));
     updatehandles();
 }
 
@@ -1177,17 +1473,38 @@ bool GraphicsEllipseItem::loadFromXml(QXmlStreamReader *xml)
     return true;
 }
 
-bool GraphicsEllipseItem::saveToXml(QXmlStreamWriter * xml)
+bool GraphicsEllipseItem::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
-    xml->writeStartElement(tr("ellipse"));
-    xml->writeAttribute("startAngle",QString("%1").arg(m_startAngle));
-    xml->writeAttribute("spanAngle",QString("%1").arg(m_spanAngle));
+    xml->writeStartElement(QStringLiteral("ellipse"));
+    writeNumberAttribute(xml,QStringLiteral("startAngle"),m_startAngle);
+    writeNumberAttribute(xml,QStringLiteral("spanAngle"),m_spanAngle);
 
-    writeBaseAttributes(xml);
+    writeBaseAttributes(xml,framePos(frame,m_localRect.center()));
     xml->writeEndElement();
     return true;
 }
 
+bool GraphicsEllipseItem::loadFromBinary(QDataStream *stream)
+{
+    qint32 startAngle, spanAngle;
+    if ( !readBaseBinary(stream) )
+        return false;
+    *stream >> startAngle >> spanAngle;
+    m_startAngle = startAngle;
+    m_spanAngle = spanAngle;
+    updateCoordinate();
+    return stream->status() == QDataStream::Ok;
+}
+
+bool GraphicsEllipseItem::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    qint64 record = beginShapeRecord(stream,EllipseRecord);
+    writeBaseBinary(stream,framePos(frame,m_localRect.center()));
+    *stream << qint32(m_startAngle) << qint32(m_spanAngle);
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
 
 void GraphicsEllipseItem::updatehandles()
 {
@@ -1198,16 +1515,18 @@ void GraphicsEllipseItem::updatehandles()
     qreal x = (m_width/2) * cos( -m_startAngle * M_PI / 180 );
     qreal y = (m_height/2) * sin( -m_startAngle * M_PI / 180);
 
-    m_handles.at(8)->move(x-delta.x(),y-delta.y());
+    m_handles[8].move(x-delta.x(),y-delta.y());
     x = (m_width/2) * cos( -m_spanAngle * M_PI / 180);
     y = (m_height/2) * sin(-m_spanAngle * M_PI / 180);
-    m_handles.at(9)->move(x-delta.x(),y-delta.y());
+    m_handles[9].move(x-delta.x(),y-delta.y());
 }
 
 void GraphicsEllipseItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    Q_UNUSED(option);
     Q_UNUSED(widget);
+    const qreal pixels = itemPixels(this,painter,option);
+    if ( paintLowDetail(this,painter,pixels,pen(),brush()) )
+        return;
     QColor c = brushColor();
     QRectF rc = m_localRect;
 
@@ -1237,7 +1556,7 @@ void GraphicsEllipseItem::paint(QPainter *painter, const QStyleOptionGraphicsIte
         painter->drawPie(m_localRect, startAngle * 16 , (endAngle-startAngle) * 16);
 
 
-    if (option->state & QStyle::State_Selected)
+    if ((option->state & QStyle::State_Selected) && pixels >= LodDetailPixels)
         qt_graphicsItem_highlightSelected(this, painter, option);
 }
 
@@ -1247,36 +1566,74 @@ GraphicsPolygonItem::GraphicsPolygonItem(QGraphicsItem *parent)
     // handles
     m_points.clear();
     m_pen = QPen(Qt::black);
+    m_pathDirty = true;
 }
 
 QRectF GraphicsPolygonItem::boundingRect() const
 {
-    return shape().controlPointRect();
+    updatePathCache();
+    return m_boundingRect;
 }
 
 QPainterPath GraphicsPolygonItem::shape() const
+{
+    updatePathCache();
+    return m_shape;
+}
+
+void GraphicsPolygonItem::setPen(const QPen &pen)
+{
+    prepareGeometryChange();
+    GraphicsItem::setPen(pen);
+    invalidatePath();
+}
+
+QPainterPath GraphicsPolygonItem::buildPath() const
 {
     QPainterPath path;
     path.addPolygon(m_points);
     path.closeSubpath();
-    return qt_graphicsItem_shapeFromPath(path,pen());
+    return path;
+}
+
+void GraphicsPolygonItem::invalidatePath()
+{
+    m_pathDirty = true;
+}
+
+const QPainterPath &GraphicsPolygonItem::path() const
+{
+    updatePathCache();
+    return m_path;
+}
+
+void GraphicsPolygonItem::updatePathCache() const
+{
+    if ( !m_pathDirty )
+        return;
+    m_path = buildPath();
+    m_shape = qt_graphicsItem_shapeFromPath(m_path,pen());
+    m_boundingRect = m_shape.controlPointRect();
+    m_pathDirty = false;
 }
 
 void GraphicsPolygonItem::addPoint(const QPointF &point)
 {
+    prepareGeometryChange();
     m_points.append(mapFromScene(point));
+    invalidatePath();
     int dir = m_points.count();
-    SizeHandleRect *shr = new SizeHandleRect(this, dir+Left, true);
-    shr->setState(SelectionHandleActive);
-    m_handles.push_back(shr);
+    m_handles.push_back(SelectionHandle(dir+Left, true));
+    m_handles.back().move(m_points.last().x(),m_points.last().y());
 }
 
 void GraphicsPolygonItem::control(int dir, const QPointF &delta)
 {
     QPointF pt = mapFromScene(delta);
     if ( dir <= Left ) return ;
-    m_points[dir - Left -1] = pt;
     prepareGeometryChange();
+    m_points[dir - Left -1] = pt;
+    invalidatePath();
     m_localRect = m_points.boundingRect();
     m_width = m_localRect.width();
     m_height = m_localRect.height();
@@ -1305,6 +1662,7 @@ void GraphicsPolygonItem::stretch(int handle, double sx, double sy, const QPoint
 
     prepareGeometryChange();
     m_points = trans.map(m_initialPoints);
+    invalidatePath();
     m_localRect = m_points.boundingRect();
     m_width = m_localRect.width();
     m_height = m_localRect.height();
@@ -1328,6 +1686,7 @@ void GraphicsPolygonItem::updateCoordinate()
         prepareGeometryChange();
 
         m_points = mapFromScene(pts);
+        invalidatePath();
         m_localRect = m_points.boundingRect();
         m_width = m_localRect.width();
         m_height = m_localRect.height();
@@ -1351,30 +1710,50 @@ bool GraphicsPolygonItem::loadFromXml(QXmlStreamReader *xml)
             qreal y = xml->attributes().value("y").toDouble();
             m_points.append(QPointF(x,y));
             int dir = m_points.count();
-            SizeHandleRect *shr = new SizeHandleRect(this, dir+Left, true);
-            m_handles.push_back(shr);
+            m_handles.push_back(SelectionHandle(dir+Left, true));
             xml->skipCurrentElement();
         }else
             xml->skipCurrentElement();
     }
+    invalidatePath();
     updateCoordinate();
     return true;
 }
 
-bool GraphicsPolygonItem::saveToXml(QXmlStreamWriter *xml)
+bool GraphicsPolygonItem::saveToXml(QXmlStreamWriter *xml, const QTransform &frame)
 {
-    xml->writeStartElement("polygon");
-    writeBaseAttributes(xml);
+    xml->writeStartElement(QStringLiteral("polygon"));
+    writeBaseAttributes(xml,framePos(frame));
     for ( int i = 0 ; i < m_points.count();++i){
-        xml->writeStartElement("point");
-        xml->writeAttribute("x",QString("%1").arg(m_points[i].x()));
-        xml->writeAttribute("y",QString("%1").arg(m_points[i].y()));
+        xml->writeStartElement(QStringLiteral("point"));
+        writeNumberAttribute(xml,QStringLiteral("x"),m_points[i].x());
+        writeNumberAttribute(xml,QStringLiteral("y"),m_points[i].y());
         xml->writeEndElement();
     }
     xml->writeEndElement();
     return true;
 }
 
+bool GraphicsPolygonItem::loadFromBinary(QDataStream *stream)
+{
+    if ( !readBaseBinary(stream) || !readPoints(stream,m_points) )
+        return false;
+    for ( int i = 0 ; i < m_points.size() ; ++i )
+        m_handles.push_back(SelectionHandle(Left+i+1, true));
+    invalidatePath();
+    updateCoordinate();
+    return true;
+}
+
+bool GraphicsPolygonItem::saveToBinary(QDataStream *stream, const QTransform &frame)
+{
+    qint64 record = beginShapeRecord(stream,PolygonRecord);
+    writeBaseBinary(stream,framePos(frame));
+    writePoints(stream,m_points);
+    endShapeRecord(stream,record);
+    return stream->status() == QDataStream::Ok;
+}
+
 void GraphicsPolygonItem::endPoint(const QPointF & point)
 {
     Q_UNUSED(point);
@@ -1382,8 +1761,9 @@ void GraphicsPolygonItem::endPoint(const QPointF & point)
     if( nPoints > 2 && (m_points[nPoints-1] == m_points[nPoints-2] ||
         m_points[nPoints-1].x() - 1 == m_points[nPoints-2].x() &&
         m_points[nPoints-1].y() == m_points[nPoints-2].y())){
-        delete m_handles[Left + nPoints-1];
+        prepareGeometryChange();
         m_points.remove(nPoints-1);
+        invalidatePath();
         m_handles.resize(Left + nPoints-1);
     }
     m_initialPoints = m_points;
@@ -1395,9 +1775,10 @@ QGraphicsItem *GraphicsPolygonItem::duplicate() const
     item->m_width = width();
     item->m_height = height();
     item->m_points = m_points;
+    item->invalidatePath();
 
     for ( int i = 0 ; i < m_points.size() ; ++i ){
-        item->m_handles.push_back(new SizeHandleRect(item,Left+i+1,true));
+        item->m_handles.push_back(SelectionHandle(Left+i+1,true));
     }
 
     item->setPos(pos().x(),pos().y());
@@ -1417,15 +1798,18 @@ void GraphicsPolygonItem::updatehandles()
     GraphicsItem::updatehandles();
 
     for ( int i = 0 ; i < m_points.size() ; ++i ){
-        m_handles[Left+i]->move(m_points[i].x() ,m_points[i].y() );
+        m_handles[Left+i].move(m_points[i].x() ,m_points[i].y() );
     }
 }
 
 void GraphicsPolygonItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    Q_UNUSED(option);
     Q_UNUSED(widget);
 
+    const qreal pixels = itemPixels(this,painter,option);
+    if ( paintLowDetail(this,painter,pixels,pen(),brush()) )
+        return;
+
     QColor c = brushColor();
     QLinearGradient result(boundingRect().topLeft(), boundingRect().topRight());
     result.setColorAt(0, c.dark(150));
@@ -1434,9 +1818,9 @@ void GraphicsPolygonItem::paint(QPainter *painter, const QStyleOptionGraphicsIte
     painter->setBrush(result);
 
     painter->setPen(pen());
-    painter->drawPolygon(m_points);
+    painter->drawPath(path());
 
-    if (option->state & QStyle::State_Selected)
+    if ((option->state & QStyle::State_Selected) && pixels >= LodDetailPixels)
         qt_graphicsItem_highlightSelected(this, painter, option);
 }
 
@@ -12,6 +12,7 @@
 #include <vector>
 #include <QMimeData>
 #include <QXmlStreamReader>
+#include <QDataStream>
 
 class ShapeMimeData : public QMimeData
 {
@@ -24,6 +25,30 @@ private:
     QList<QGraphicsItem * > m_items;
 };
 
+// record kinds of the binary document format, see DocumentLoader
+enum ShapeRecord
+{
+    RectRecord = 0,
+    RoundRectRecord,
+    EllipseRecord,
+    PolygonRecord,
+    BezierRecord,
+    PolylineRecord,
+    LineRecord,
+    GroupRecord,
+    // not a shape, changes appended to a binary document, see Document::saveSnapshot
+    JournalRecord,
+    RecordCount
+};
+
+// name of a record kind as stored in the string table of a binary document
+QString shapeRecordName( int record );
+// every record is a kind byte and a payload size, see beginShapeRecord
+qint64 beginShapeRecord( QDataStream * stream , int record );
+void endShapeRecord( QDataStream * stream , qint64 start );
+// writes value as QString::number does, without allocating for whole numbers
+void writeNumberAttribute( QXmlStreamWriter * xml , const QString & name , qreal value );
+
 template < typename BaseType = QGraphicsItem >
 class AbstractShapeType : public BaseType
 {
@@ -45,15 +70,33 @@ public:
     virtual QGraphicsItem * duplicate() const { return NULL;}
     virtual int handleCount() const { return m_handles.size();}
     virtual bool loadFromXml(QXmlStreamReader * xml ) = 0;
-    virtual bool saveToXml( QXmlStreamWriter * xml ) = 0 ;
-    int collidesWithHandle( const QPointF & point ) const
+    // frame maps the parent coordinates of the shape to the ones it is saved
+    // in, see GraphicsItemGroup::saveToBinary
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() ) = 0 ;
+    virtual bool loadFromBinary(QDataStream * stream ) = 0;
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() ) = 0;
+    // the position the shape is saved at in frame: where its point anchor
+    // lands, the point the loader puts at the origin of the shape
+    QPointF framePos( const QTransform & frame , const QPointF & anchor = QPointF() ) const
+    {
+        if ( frame.isIdentity() )
+            return this->pos();
+        return frame.map(this->mapToParent(anchor));
+    }
+    typedef std::vector<SelectionHandle> Handles;
+    const Handles & handles() const { return m_handles; }
+    // viewTransform is the transform of the view the point comes from
+    int collidesWithHandle( const QPointF & point , const QTransform & viewTransform ) const
     {
+        const QSizeF size = SelectionHandle::sceneSize(viewTransform);
         const Handles::const_reverse_iterator hend =  m_handles.rend();
         for (Handles::const_reverse_iterator it = m_handles.rbegin(); it != hend; ++it)
         {
-            QPointF pt = (*it)->mapFromScene(point);
-            if ((*it)->contains(pt) ){
-                return (*it)->dir();
+            const QPointF pt = this->mapToScene(it->pos());
+            const QRectF rc(pt.x() - size.width() / 2, pt.y() - size.height() / 2,
+                            size.width(), size.height());
+            if (rc.contains(point) ){
+                return it->dir();
             }
         }
         return Handle_None;
@@ -63,8 +106,8 @@ public:
         const Handles::const_reverse_iterator hend =  m_handles.rend();
         for (Handles::const_reverse_iterator it = m_handles.rbegin(); it != hend; ++it)
         {
-            if ((*it)->dir() == handle ){
-                return (*it)->pos();
+            if (it->dir() == handle ){
+                return it->pos();
             }
         }
         return QPointF();
@@ -130,28 +173,28 @@ public:
         QPointF pt;
         switch (handle) {
         case Right:
-            pt = m_handles.at(Left-1)->pos();
+            pt = m_handles.at(Left-1).pos();
             break;
         case RightTop:
-            pt = m_handles[LeftBottom-1]->pos();
+            pt = m_handles[LeftBottom-1].pos();
             break;
         case RightBottom:
-            pt = m_handles[LeftTop-1]->pos();
+            pt = m_handles[LeftTop-1].pos();
             break;
         case LeftBottom:
-            pt = m_handles[RightTop-1]->pos();
+            pt = m_handles[RightTop-1].pos();
             break;
         case Bottom:
-            pt = m_handles[Top-1]->pos();
+            pt = m_handles[Top-1].pos();
             break;
         case LeftTop:
-            pt = m_handles[RightBottom-1]->pos();
+            pt = m_handles[RightBottom-1].pos();
             break;
         case Left:
-            pt = m_handles[Right-1]->pos();
+            pt = m_handles[Right-1].pos();
             break;
         case Top:
-            pt = m_handles[Bottom-1]->pos();
+            pt = m_handles[Bottom-1].pos();
             break;
          }
         return pt;
@@ -161,7 +204,7 @@ public:
     QBrush brush() const {return m_brush;}
     QPen   pen() const {return m_pen;}
     QColor penColor() const {return m_pen.color();}
-    void   setPen(const QPen & pen ) { m_pen = pen;}
+    virtual void setPen(const QPen & pen ) { m_pen = pen;}
     void   setBrush( const QBrush & brush ) { m_brush = brush ; }
     void   setBrushColor( const QColor & color ) { m_brush.setColor(color);}
     qreal  width() const { return m_width ; }
@@ -179,15 +222,8 @@ public:
 
 protected:
     virtual void updatehandles(){}
-    void setState(SelectionHandleState st)
-    {
-        const Handles::iterator hend =  m_handles.end();
-        for (Handles::iterator it = m_handles.begin(); it != hend; ++it)
-            (*it)->setState(st);
-    }
     QBrush m_brush;
     QPen   m_pen ;
-    typedef std::vector<SizeHandleRect*> Handles;
     Handles m_handles;
     QRectF m_localRect;
     qreal m_width;
@@ -208,6 +244,7 @@ class GraphicsItem : public QObject,
 
 public:
     GraphicsItem(QGraphicsItem * parent );
+    ~GraphicsItem();
     enum {Type = UserType+1};
     int  type() const { return Type; }
     virtual QPixmap image() ;
@@ -220,7 +257,10 @@ protected:
     void contextMenuEvent(QGraphicsSceneContextMenuEvent *event);
 
     bool readBaseAttributes(QXmlStreamReader * xml );
-    bool writeBaseAttributes( QXmlStreamWriter * xml );
+    // position is where the record puts the shape, see framePos
+    bool writeBaseAttributes( QXmlStreamWriter * xml , const QPointF & position );
+    bool readBaseBinary(QDataStream * stream );
+    bool writeBaseBinary( QDataStream * stream , const QPointF & position );
 
 };
 
@@ -239,7 +279,9 @@ public:
     QString displayName() const { return tr("rectangle"); }
 
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
 
 protected:
     void updatehandles();
@@ -262,7 +304,9 @@ public:
     QGraphicsItem *duplicate() const;
     QString displayName() const { return tr("ellipse"); }
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
 protected:
     void updatehandles();
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
@@ -290,7 +334,9 @@ public:
     QString displayName() const { return tr("group"); }
 
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
 
     QGraphicsItem *duplicate () const ;
     void control(int dir, const QPointF & delta);
@@ -302,6 +348,7 @@ signals:
 protected:
     GraphicsItemGroup * createGroup(const QList<QGraphicsItem *> &items) const;
     QList<QGraphicsItem *> duplicateItems() const;
+    QTransform childFrame( const QTransform & frame ) const;
     void updatehandles();
     QVariant itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant &value);
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
@@ -321,22 +368,35 @@ public:
     void control(int dir, const QPointF & delta);
     void stretch( int handle , double sx , double sy , const QPointF & origin );
     void updateCoordinate ();
+    void setPen(const QPen & pen );
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
     QString displayName() const { return tr("polygon"); }
     QGraphicsItem *duplicate() const;
 protected:
+    // outline through m_points in local coordinates, before stroking
+    virtual QPainterPath buildPath() const;
+    // must be called whenever m_points or the pen changed
+    void invalidatePath();
+    const QPainterPath & path() const;
     void updatehandles();
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
     QPolygonF m_points;
     QPolygonF m_initialPoints;
+private:
+    void updatePathCache() const;
+    mutable QPainterPath m_path;
+    mutable QPainterPath m_shape;
+    mutable QRectF m_boundingRect;
+    mutable bool m_pathDirty;
 };
 
 class GraphicsLineItem : public GraphicsPolygonItem
 {
 public:
     GraphicsLineItem(QGraphicsItem * parent = 0);
-    QPainterPath shape() const;
     QGraphicsItem *duplicate() const;
     void addPoint( const QPointF & point ) ;
     void endPoint(const QPointF & point );
@@ -345,9 +405,12 @@ public:
     int handleCount() const { return m_handles.size() + Left;}
     void stretch( int handle , double sx , double sy , const QPointF & origin );
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
     QString displayName() const { return tr("line"); }
 protected:
+    QPainterPath buildPath() const;
     void updatehandles();
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
@@ -357,12 +420,14 @@ class GraphicsBezier : public GraphicsPolygonItem
 {
 public:
     GraphicsBezier(bool bbezier = true , QGraphicsItem * parent = 0);
-    QPainterPath shape() const;
     QGraphicsItem *duplicate() const;
     virtual bool loadFromXml(QXmlStreamReader * xml );
-    virtual bool saveToXml( QXmlStreamWriter * xml );
+    virtual bool saveToXml( QXmlStreamWriter * xml , const QTransform & frame = QTransform() );
+    virtual bool loadFromBinary(QDataStream * stream );
+    virtual bool saveToBinary( QDataStream * stream , const QTransform & frame = QTransform() );
     QString displayName() const { return tr("bezier"); }
 protected:
+    QPainterPath buildPath() const;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 private:
     bool m_isBezier;
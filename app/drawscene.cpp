@@ -3,9 +3,16 @@
 #include<QGraphicsRectItem>
 #include <QDebug>
 #include <QKeyEvent>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QTimerEvent>
+#include <QGraphicsView>
+#include <QPainterPath>
 #include "drawobj.h"
 #include <vector>
+#include <algorithm>
 #include <QPainter>
+#include <QtMath>
 
 
 GridTool::GridTool(const QSize & grid , const QSize & space )
@@ -15,28 +22,87 @@ GridTool::GridTool(const QSize & grid , const QSize & space )
 }
 
 
-void GridTool::paintGrid(QPainter *painter, const QRect &rect)
+// grid lines closer than this many pixels are not drawn
+static const qreal MinGridPixels = 4;
+// approximate size of a cached grid tile in pixels
+static const int GridTilePixels = 256;
+
+QImage GridTool::gridTile(qreal scale, QSizeF &tileSize)
+{
+    const int cols = qMax(1,qRound(GridTilePixels / (m_sizeGridSpace.width() * scale)));
+    const int rows = qMax(1,qRound(GridTilePixels / (m_sizeGridSpace.height() * scale)));
+    tileSize = QSizeF(cols * m_sizeGridSpace.width(), rows * m_sizeGridSpace.height());
+
+    const qint64 key = qRound64(scale * 1000);
+    QHash<qint64,QImage>::const_iterator it = m_tiles.constFind(key);
+    if ( it != m_tiles.constEnd() )
+        return it.value();
+
+    const QSize size(qCeil(tileSize.width() * scale), qCeil(tileSize.height() * scale));
+    QImage tile(size,QImage::Format_RGB32);
+    tile.fill(Qt::white);
+    QPainter painter(&tile);
+    QPen p(Qt::darkCyan);
+    p.setStyle(Qt::DashLine);
+    p.setCosmetic(true);
+    painter.setPen(p);
+    // one line per cell at its leading edge, the next tile draws the far edges
+    for ( int i = 0 ; i < cols ; ++i ){
+        int x = qRound(i * m_sizeGridSpace.width() * scale);
+        painter.drawLine(x,0,x,size.height());
+    }
+    for ( int i = 0 ; i < rows ; ++i ){
+        int y = qRound(i * m_sizeGridSpace.height() * scale);
+        painter.drawLine(0,y,size.width(),y);
+    }
+    painter.end();
+
+    if ( m_tiles.size() > 8 )
+        m_tiles.clear();
+    m_tiles.insert(key,tile);
+    return tile;
+}
+
+void GridTool::paintGrid(QPainter *painter, const QRect &rect, const QRectF &exposed)
 {
+    const QRectF area = exposed & QRectF(rect);
+    if ( area.isEmpty() )
+        return;
+
     QColor c(Qt::darkCyan);
     QPen p(c);
     p.setStyle(Qt::DashLine);
     p.setWidthF(0.2);
-    painter->setPen(p);
 
     painter->save();
     painter->setRenderHints(QPainter::Antialiasing,false);
-
-    painter->fillRect(rect,Qt::white);
-    for (int x=rect.left() ;x <rect.right()  ;x+=(int)(m_sizeGridSpace.width())) {
-        painter->drawLine(x,rect.top(),x,rect.bottom());
-
-    }
-    for (int y=rect.top();y<rect.bottom() ;y+=(int)(m_sizeGridSpace.height()))
-    {
-        painter->drawLine(rect.left(),y,rect.right(),y);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform,false);
+    painter->setClipRect(area,Qt::IntersectClip);
+
+    const QTransform & trans = painter->worldTransform();
+    const qreal scale = qSqrt(qAbs(trans.determinant()));
+    if ( m_sizeGridSpace.width() * scale < MinGridPixels ||
+         m_sizeGridSpace.height() * scale < MinGridPixels ){
+        painter->fillRect(area,Qt::white);
+    }else{
+        // tiles start on grid lines so their content stays in phase
+        QSizeF tileSize;
+        const QImage tile = gridTile(scale,tileSize);
+        const int left = qFloor((area.left() - rect.left()) / tileSize.width());
+        const int right = qCeil((area.right() - rect.left()) / tileSize.width());
+        const int top = qFloor((area.top() - rect.top()) / tileSize.height());
+        const int bottom = qCeil((area.bottom() - rect.top()) / tileSize.height());
+        for ( int ty = top ; ty < bottom ; ++ty ){
+            for ( int tx = left ; tx < right ; ++tx ){
+                QRectF target(rect.left() + tx * tileSize.width(),
+                              rect.top() + ty * tileSize.height(),
+                              tileSize.width(),tileSize.height());
+                painter->drawImage(target,tile,QRectF(tile.rect()));
+            }
+        }
     }
-    p.setStyle(Qt::SolidLine);
-    p.setColor(Qt::black);
+
+    painter->setPen(p);
     painter->drawLine(rect.right(),rect.top(),rect.right(),rect.bottom());
     painter->drawLine(rect.left(),rect.bottom(),rect.right(),rect.bottom());
 
@@ -85,6 +151,15 @@ DrawScene::DrawScene(QObject *parent)
     m_view = NULL;
     m_dx=m_dy=0;
     m_grid = new GridTool();
+    m_gridVisible = true;
+    m_selectionSerial = 0;
+    m_selectionDirty = false;
+    m_shapeSerial = 0;
+    m_shapesDirty = false;
+    m_dragFrameTool = NULL;
+    m_bulkInsert = 0;
+    m_bulkIndexMethod = BspTreeIndex;
+    m_bulkBspDepth = 0;
     QGraphicsItem * item = addRect(QRectF(0,0,0,0));
     item->setAcceptHoverEvents(true);
 
@@ -92,12 +167,435 @@ DrawScene::DrawScene(QObject *parent)
 
 DrawScene::~DrawScene()
 {
+    qDeleteAll(m_tools);
     delete m_grid;
 }
 
+void DrawScene::setGridVisible(bool visible)
+{
+    if ( m_gridVisible == visible )
+        return;
+    m_gridVisible = visible;
+    update();
+}
+
+QList<QGraphicsItem *> DrawScene::selectedShapes() const
+{
+    if ( m_selectionDirty ){
+        m_selectedShapes = m_selection.values();
+        m_selectionDirty = false;
+    }
+    return m_selectedShapes;
+}
+
+void DrawScene::updateSelection(QGraphicsItem *item, bool selected)
+{
+    if ( selected ){
+        if ( m_selectionIndex.contains(item) )
+            return;
+        m_selection.insert(m_selectionSerial,item);
+        m_selectionIndex.insert(item,m_selectionSerial);
+        ++m_selectionSerial;
+    }else{
+        QHash<QGraphicsItem*,quint64>::iterator it = m_selectionIndex.find(item);
+        if ( it == m_selectionIndex.end() )
+            return;
+        m_selection.remove(it.value());
+        m_selectionIndex.erase(it);
+    }
+    m_selectionDirty = true;
+}
+
+QList<QGraphicsItem *> DrawScene::shapes() const
+{
+    if ( m_shapesDirty ){
+        m_shapeList = m_shapes.values();
+        m_shapesDirty = false;
+    }
+    return m_shapeList;
+}
+
+void DrawScene::updateShape(QGraphicsItem *item, bool topLevel)
+{
+    if ( topLevel ){
+        if ( m_shapeIndex.contains(item) )
+            return;
+        m_shapes.insert(m_shapeSerial,item);
+        m_shapeIndex.insert(item,m_shapeSerial);
+        ++m_shapeSerial;
+        m_boundsDirty.insert(item);
+        m_changedShapes.insert(item);
+        m_joinedShapes.insert(item);
+        m_removedShapes.remove(item);
+    }else{
+        QHash<QGraphicsItem*,quint64>::iterator it = m_shapeIndex.find(item);
+        if ( it == m_shapeIndex.end() )
+            return;
+        m_shapes.remove(it.value());
+        m_shapeIndex.erase(it);
+        m_index.remove(item);
+        m_snap.remove(item);
+        m_boundsDirty.remove(item);
+        // a deleted shape must not stay behind as changed
+        m_changedShapes.remove(item);
+        m_joinedShapes.remove(item);
+        m_removedShapes.insert(item);
+    }
+    m_shapesDirty = true;
+}
+
+void DrawScene::markShapeChanged(QGraphicsItem *item)
+{
+    QGraphicsItem * shape = item->topLevelItem();
+    if ( !m_shapeIndex.contains(shape) )
+        return;
+    m_boundsDirty.insert(shape);
+    m_changedShapes.insert(shape);
+}
+
+QList<QGraphicsItem *> DrawScene::changedShapes() const
+{
+    QMap<quint64,QGraphicsItem*> ordered;
+    foreach (QGraphicsItem *item, m_changedShapes) {
+        ordered.insert(m_shapeIndex.value(item),item);
+    }
+    return ordered.values();
+}
+
+void DrawScene::clearShapeChanges()
+{
+    m_changedShapes.clear();
+    m_joinedShapes.clear();
+    m_removedShapes.clear();
+}
+
+// snap distance in pixels on screen
+static const qreal SnapPixels = 6;
+
+static QRectF sceneBounds( QGraphicsItem * item )
+{
+    return item->mapRectToScene(item->boundingRect() | item->childrenBoundingRect());
+}
+
+// a group is hit through its children as well as its own shape
+static bool shapeContains( QGraphicsItem * item , const QPointF & pos )
+{
+    if ( item->contains(item->mapFromScene(pos)) )
+        return true;
+    foreach (QGraphicsItem *child, item->childItems()) {
+        if ( shapeContains(child,pos) )
+            return true;
+    }
+    return false;
+}
+
+class StackingOrder
+{
+public:
+    explicit StackingOrder( const QHash<QGraphicsItem*,quint64> & serials )
+        :serials_(serials) {}
+    // the shape painted last comes first
+    bool operator()( QGraphicsItem * a , QGraphicsItem * b ) const
+    {
+        if ( a->zValue() != b->zValue() )
+            return a->zValue() > b->zValue();
+        return serials_.value(a) > serials_.value(b);
+    }
+    const QHash<QGraphicsItem*,quint64> & serials_;
+};
+
+void DrawScene::updateShapeBounds(QGraphicsItem *item)
+{
+    QGraphicsItem * shape = item->topLevelItem();
+    if ( m_shapeIndex.contains(shape) )
+        m_boundsDirty.insert(shape);
+}
+
+// a loaded drawing or a change of most shapes packs the index again,
+// single edits move their entries
+void DrawScene::updateIndex() const
+{
+    if ( m_boundsDirty.isEmpty() )
+        return;
+    if ( m_boundsDirty.size() > m_index.size() ){
+        QVector<ShapeIndex::Entry> entries;
+        entries.reserve(m_shapeIndex.size());
+        m_snap.clear();
+        QHash<QGraphicsItem*,quint64>::const_iterator it = m_shapeIndex.constBegin();
+        for ( ; it != m_shapeIndex.constEnd() ; ++it ){
+            ShapeIndex::Entry entry;
+            entry.item = it.key();
+            entry.bounds = sceneBounds(it.key());
+            entries.append(entry);
+            m_snap.insert(entry.item,entry.bounds);
+        }
+        m_index.load(entries);
+    }else{
+        foreach (QGraphicsItem *item, m_boundsDirty) {
+            const QRectF bounds = sceneBounds(item);
+            m_index.insert(item,bounds);
+            m_snap.insert(item,bounds);
+        }
+    }
+    m_boundsDirty.clear();
+}
+
+QList<QGraphicsItem *> DrawScene::selectedShapesIn(const QRectF &rect) const
+{
+    // a few selected shapes are tested directly, a large selection
+    // through the index, so the cost follows the shapes around rect
+    static const int SmallSelection = 64;
+    QList<QGraphicsItem *> items;
+    if ( m_selectionIndex.size() <= SmallSelection ){
+        foreach (QGraphicsItem *item, selectedShapes()) {
+            if ( sceneBounds(item).intersects(rect) )
+                items.append(item);
+        }
+    }else{
+        updateIndex();
+        foreach (QGraphicsItem *item, m_index.intersecting(rect)) {
+            if ( item->isSelected() )
+                items.append(item);
+        }
+    }
+    return sortShapes(items);
+}
+
+QList<QGraphicsItem *> DrawScene::sortShapes(QList<QGraphicsItem *> items) const
+{
+    std::sort(items.begin(),items.end(),StackingOrder(m_shapeIndex));
+    return items;
+}
+
+QList<QGraphicsItem *> DrawScene::shapesAt(const QPointF &pos) const
+{
+    updateIndex();
+    QList<QGraphicsItem *> items;
+    foreach (QGraphicsItem *item, m_index.containing(pos)) {
+        if ( shapeContains(item,pos) )
+            items.append(item);
+    }
+    return sortShapes(items);
+}
+
+QGraphicsItem *DrawScene::shapeAt(const QPointF &pos) const
+{
+    const QList<QGraphicsItem *> items = shapesAt(pos);
+    return items.isEmpty() ? NULL : items.first();
+}
+
+QList<QGraphicsItem *> DrawScene::shapesIn(const QRectF &rect) const
+{
+    updateIndex();
+    QPainterPath area;
+    area.addRect(rect);
+    QList<QGraphicsItem *> items;
+    foreach (QGraphicsItem *item, m_index.intersecting(rect)) {
+        if ( item->collidesWithPath(item->mapFromScene(area)) )
+            items.append(item);
+    }
+    return sortShapes(items);
+}
+
+QGraphicsItem *DrawScene::nearestShape(const QPointF &pos) const
+{
+    updateIndex();
+    return m_index.nearest(pos);
+}
+
+QList<QGraphicsItem *> DrawScene::collidingShapes(QGraphicsItem *item) const
+{
+    updateIndex();
+    QList<QGraphicsItem *> items;
+    foreach (QGraphicsItem *other, m_index.intersecting(sceneBounds(item))) {
+        if ( other != item && item->collidesWithItem(other) )
+            items.append(other);
+    }
+    return sortShapes(items);
+}
+
+void DrawScene::selectShapes(const QRectF &rect, const QList<QGraphicsItem *> &keep)
+{
+    QSet<QGraphicsItem *> chosen;
+    foreach (QGraphicsItem *item, keep) {
+        chosen.insert(item);
+    }
+    foreach (QGraphicsItem *item, shapesIn(rect)) {
+        chosen.insert(item);
+    }
+
+    // one notification for the whole band instead of one per shape
+    bool changed = false;
+    const bool blocked = blockSignals(true);
+    foreach (QGraphicsItem *item, selectedShapes()) {
+        if ( !chosen.contains(item) ){
+            item->setSelected(false);
+            changed = true;
+        }
+    }
+    foreach (QGraphicsItem *item, chosen) {
+        if ( !item->isSelected() ){
+            item->setSelected(true);
+            changed = true;
+        }
+    }
+    blockSignals(blocked);
+    if ( changed )
+        emit selectionChanged();
+}
+
+void DrawScene::setSelectionBand(const QRectF &rect)
+{
+    if ( rect == m_selectionBand )
+        return;
+    updateViewports(m_selectionBand | rect);
+    m_selectionBand = rect;
+}
+
+void DrawScene::setDragPreview(const QPainterPath &path, const QTransform &transform)
+{
+    if ( !m_dragPreview.isEmpty() )
+        updateViewports(m_dragPreviewTransform.mapRect(m_dragPreview.boundingRect()));
+    m_dragPreview = path;
+    m_dragPreviewTransform = transform;
+    if ( !path.isEmpty() )
+        updateViewports(transform.mapRect(path.boundingRect()));
+}
+
+// the band, the guides and the drag preview are painted over the cached
+// tiles, changing them repaints the views without touching the scene
+void DrawScene::updateViewports(const QRectF &rect) const
+{
+    foreach (QGraphicsView *view, views()) {
+        view->viewport()->update(view->mapFromScene(rect).boundingRect().adjusted(-2,-2,2,2));
+    }
+}
+
+QRectF DrawScene::shapeBounds(const QList<QGraphicsItem *> &items) const
+{
+    QRectF bounds;
+    foreach (QGraphicsItem *item, items) {
+        bounds |= sceneBounds(item);
+    }
+    return bounds;
+}
+
+void DrawScene::beginSnap(const QList<QGraphicsItem *> &dragged)
+{
+    m_snapExclude.clear();
+    foreach (QGraphicsItem *item, dragged) {
+        m_snapExclude.insert(item);
+    }
+}
+
+void DrawScene::endSnap()
+{
+    m_snapExclude.clear();
+    clearGuides();
+}
+
+QPointF DrawScene::snapPoint(const QPointF &pos)
+{
+    return pos + snap(QVector<qreal>() << pos.x(),QVector<qreal>() << pos.y(),QRectF(pos,pos));
+}
+
+QPointF DrawScene::snapOffset(const QRectF &rect)
+{
+    const QPointF center = rect.center();
+    return snap(QVector<qreal>() << rect.left() << center.x() << rect.right(),
+                QVector<qreal>() << rect.top() << center.y() << rect.bottom(),rect);
+}
+
+void DrawScene::clearGuides()
+{
+    setGuides(QVector<QLineF>());
+}
+
+qreal DrawScene::snapTolerance() const
+{
+    QGraphicsView * view = m_view;
+    if ( !view && !views().isEmpty() )
+        view = views().first();
+    const qreal scale = view ? qSqrt(qAbs(view->transform().determinant())) : 1;
+    return scale > 0 ? SnapPixels / scale : SnapPixels;
+}
+
+// other shapes win over the grid, the closest target on an axis wins
+bool DrawScene::snapAxis(Qt::Orientation axis, const QVector<qreal> &values, qreal tolerance,
+                         SnapEngine::Guide *guide) const
+{
+    if ( m_snap.snap(axis,values,tolerance,m_snapExclude,guide) )
+        return true;
+    if ( !m_grid || !m_gridVisible )
+        return false;
+
+    const bool horizontal = axis == Qt::Horizontal;
+    const qreal origin = horizontal ? sceneRect().left() : sceneRect().top();
+    const qreal space = horizontal ? m_grid->gridSpace().width() : m_grid->gridSpace().height();
+    if ( space <= 0 )
+        return false;
+    bool found = false;
+    foreach (qreal value, values) {
+        const qreal target = origin + qFloor((value - origin) / space + 0.5) * space;
+        const qreal offset = target - value;
+        if ( qAbs(offset) <= tolerance && (!found || qAbs(offset) < qAbs(guide->offset)) ){
+            guide->item = NULL;
+            guide->target = target;
+            guide->offset = offset;
+            found = true;
+        }
+    }
+    return found;
+}
+
+QPointF DrawScene::snap(const QVector<qreal> &xs, const QVector<qreal> &ys, const QRectF &rect)
+{
+    updateIndex();
+    const qreal tolerance = snapTolerance();
+    SnapEngine::Guide gx;
+    SnapEngine::Guide gy;
+    QPointF offset;
+    if ( snapAxis(Qt::Horizontal,xs,tolerance,&gx) )
+        offset.setX(gx.offset);
+    if ( snapAxis(Qt::Vertical,ys,tolerance,&gy) )
+        offset.setY(gy.offset);
+
+    // a guide spans the snapped rect and the shape it lines up with, the
+    // grid needs none
+    const QRectF moved = rect.translated(offset);
+    QVector<QLineF> guides;
+    if ( gx.item ){
+        const QRectF target = m_snap.bounds(gx.item);
+        guides.append(QLineF(gx.target,qMin(moved.top(),target.top()),
+                             gx.target,qMax(moved.bottom(),target.bottom())));
+    }
+    if ( gy.item ){
+        const QRectF target = m_snap.bounds(gy.item);
+        guides.append(QLineF(qMin(moved.left(),target.left()),gy.target,
+                             qMax(moved.right(),target.right()),gy.target));
+    }
+    setGuides(guides);
+    return offset;
+}
+
+void DrawScene::setGuides(const QVector<QLineF> &guides)
+{
+    if ( guides == m_guides )
+        return;
+    foreach (const QLineF & line, m_guides) {
+        updateViewports(QRectF(line.p1(),line.p2()).normalized());
+    }
+    m_guides = guides;
+    foreach (const QLineF & line, m_guides) {
+        updateViewports(QRectF(line.p1(),line.p2()).normalized());
+    }
+}
+
 void DrawScene::align(AlignType alignType)
 {
-    AbstractShape * firstItem = qgraphicsitem_cast<AbstractShape*>(selectedItems().first());
+    QList<QGraphicsItem *> items = selectedShapes();
+    if ( items.isEmpty() ) return;
+    AbstractShape * firstItem = qgraphicsitem_cast<AbstractShape*>(items.first());
     if ( !firstItem ) return;
     QRectF rectref = firstItem->mapRectToScene(firstItem->boundingRect());
     int nLeft, nRight, nTop, nBottom;
@@ -109,7 +607,7 @@ void DrawScene::align(AlignType alignType)
     QPointF pt = rectref.center();
     if ( alignType == HORZEVEN_ALIGN || alignType == VERTEVEN_ALIGN ){
         std::vector< BBoxSort  > sorted;
-        foreach (QGraphicsItem *item , selectedItems()) {
+        foreach (QGraphicsItem *item , items) {
             QGraphicsItemGroup *g = dynamic_cast<QGraphicsItemGroup*>(item->parentItem());
             if ( g )
                 continue;
@@ -153,7 +651,7 @@ void DrawScene::align(AlignType alignType)
     }
 
     int i = 0;
-    foreach (QGraphicsItem *item , selectedItems()) {
+    foreach (QGraphicsItem *item , items) {
         QGraphicsItemGroup *g = dynamic_cast<QGraphicsItemGroup*>(item->parentItem());
         if ( g )
             continue;
@@ -231,6 +729,17 @@ void DrawScene::align(AlignType alignType)
     }
 }
 
+DrawTool *DrawScene::tool(DrawShape shape)
+{
+    if ( shape < 0 )
+        return NULL;
+    if ( shape >= m_tools.size() )
+        m_tools.resize(shape + 1);
+    if ( !m_tools.at(shape) )
+        m_tools[shape] = DrawTool::createTool(shape,this);
+    return m_tools.at(shape);
+}
+
 void DrawScene::mouseEvent(QGraphicsSceneMouseEvent *mouseEvent)
 {
     switch( mouseEvent->type() ){
@@ -294,6 +803,41 @@ GraphicsItemGroup *DrawScene::createGroup(const QList<QGraphicsItem *> &items,bo
     return group;
 }
 
+void DrawScene::addItems(const QList<QGraphicsItem *> &items)
+{
+    // below this the index updates are cheaper than a rebuild
+    static const int BulkInsertMinimum = 512;
+    // the rebuild covers the whole scene, not only the new items
+    if ( m_bulkInsert > 0 || items.count() < BulkInsertMinimum ||
+         items.count() < m_shapeIndex.size() ){
+        foreach (QGraphicsItem *item, items)
+            addItem(item);
+        return;
+    }
+
+    beginBulkInsert();
+    foreach (QGraphicsItem *item, items)
+        addItem(item);
+    endBulkInsert();
+}
+
+void DrawScene::beginBulkInsert()
+{
+    if ( m_bulkInsert++ > 0 )
+        return;
+    m_bulkIndexMethod = itemIndexMethod();
+    m_bulkBspDepth = bspTreeDepth();
+    setItemIndexMethod(NoIndex);
+}
+
+void DrawScene::endBulkInsert()
+{
+    if ( m_bulkInsert == 0 || --m_bulkInsert > 0 )
+        return;
+    setItemIndexMethod(m_bulkIndexMethod);
+    setBspTreeDepth(m_bulkBspDepth);
+}
+
 void DrawScene::destroyGroup(QGraphicsItemGroup *group)
 {
     group->setSelected(false);
@@ -308,42 +852,82 @@ void DrawScene::destroyGroup(QGraphicsItemGroup *group)
 void DrawScene::drawBackground(QPainter *painter, const QRectF &rect)
 {
     QGraphicsScene::drawBackground(painter,rect);
-    painter->fillRect(sceneRect(),Qt::white);
-    if( m_grid ){
-        m_grid->paintGrid(painter,sceneRect().toRect());
-    }
+    if( m_grid && m_gridVisible ){
+        m_grid->paintGrid(painter,sceneRect().toRect(),rect);
+    }else
+        painter->fillRect(sceneRect() & rect,Qt::white);
 }
 
 void DrawScene::mousePressEvent(QGraphicsSceneMouseEvent *mouseEvent)
 {
-
-    DrawTool * tool = DrawTool::findTool( DrawTool::c_drawShape );
+    DrawShape shape = m_toolState.drawShape;
+    DrawTool * tool = currentTool();
     if ( tool )
         tool->mousePressEvent(mouseEvent,this);
+    if ( shape != m_toolState.drawShape )
+        emit toolChanged();
 }
 
 void DrawScene::mouseMoveEvent(QGraphicsSceneMouseEvent *mouseEvent)
 {
-    DrawTool * tool = DrawTool::findTool( DrawTool::c_drawShape );
+    DrawTool * tool = currentTool();
     if ( tool )
         tool->mouseMoveEvent(mouseEvent,this);
 }
 
 void DrawScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *mouseEvent)
 {
-    DrawTool * tool = DrawTool::findTool( DrawTool::c_drawShape );
+    DrawShape shape = m_toolState.drawShape;
+    DrawTool * tool = currentTool();
     if ( tool )
         tool->mouseReleaseEvent(mouseEvent,this);
+    if ( shape != m_toolState.drawShape )
+        emit toolChanged();
 }
 
 void DrawScene::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *mouseEvet)
 {
-    DrawTool * tool = DrawTool::findTool( DrawTool::c_drawShape );
+    DrawShape shape = m_toolState.drawShape;
+    DrawTool * tool = currentTool();
     if ( tool )
         tool->mouseDoubleClickEvent(mouseEvet,this);
+    if ( shape != m_toolState.drawShape )
+        emit toolChanged();
 
 }
 
+void DrawScene::requestDragFrame(DrawTool *tool)
+{
+    m_dragFrameTool = tool;
+    if ( m_dragFrameTimer.isActive() )
+        return;
+    // pointers report far more often than the screen refreshes
+    int interval = 16;
+    QScreen * screen = QGuiApplication::primaryScreen();
+    if ( screen && screen->refreshRate() > 0 )
+        interval = qMax(1,qRound(1000 / screen->refreshRate()));
+    m_dragFrameTimer.start(interval,Qt::PreciseTimer,this);
+}
+
+void DrawScene::flushDragFrame()
+{
+    if ( !m_dragFrameTimer.isActive() )
+        return;
+    m_dragFrameTimer.stop();
+    DrawTool * tool = m_dragFrameTool;
+    m_dragFrameTool = NULL;
+    if ( tool )
+        tool->dragFrame(this);
+}
+
+void DrawScene::timerEvent(QTimerEvent *event)
+{
+    if ( event->timerId() == m_dragFrameTimer.timerId() )
+        flushDragFrame();
+    else
+        QGraphicsScene::timerEvent(event);
+}
+
 void DrawScene::keyPressEvent(QKeyEvent *e)
 {
     qreal dx=0,dy=0;
@@ -374,7 +958,7 @@ void DrawScene::keyPressEvent(QKeyEvent *e)
     m_dx += dx;
     m_dy += dy;
     if ( m_moved )
-    foreach (QGraphicsItem *item, selectedItems()) {
+    foreach (QGraphicsItem *item, selectedShapes()) {
        item->moveBy(dx,dy);
     }
     QGraphicsScene::keyPressEvent(e);
@@ -382,7 +966,7 @@ void DrawScene::keyPressEvent(QKeyEvent *e)
 
 void DrawScene::keyReleaseEvent(QKeyEvent *e)
 {
-    if (m_moved && selectedItems().count()>0)
+    if (m_moved && !selectedShapes().isEmpty())
     emit itemMoved(NULL,QPointF(m_dx,m_dy));
     m_dx=m_dy=0;
     QGraphicsScene::keyReleaseEvent(e);
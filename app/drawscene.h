@@ -2,8 +2,19 @@
 #define DRAWSCENE
 
 #include <QGraphicsScene>
+#include <QBasicTimer>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QImage>
+#include <QLineF>
+#include <QPainterPath>
+#include <QTransform>
+#include <QVector>
 #include "drawtool.h"
 #include "drawobj.h"
+#include "shapeindex.h"
+#include "snapengine.h"
 
 QT_BEGIN_NAMESPACE
 class QGraphicsSceneMouseEvent;
@@ -15,6 +26,7 @@ class QGraphicsTextItem;
 class QColor;
 class QKeyEvent;
 class QPainter;
+class QTimerEvent;
 QT_END_NAMESPACE
 
 enum AlignType
@@ -37,10 +49,16 @@ class GridTool
 {
 public:
     GridTool(const QSize &grid = QSize(3200,2400) , const QSize & space = QSize(20,20) );
-    void paintGrid(QPainter *painter,const QRect & rect );
+    // paints the page rect, limited to the exposed part of it
+    void paintGrid(QPainter *painter,const QRect & rect , const QRectF & exposed );
+    QSize gridSpace() const { return m_sizeGridSpace; }
 protected:
+    QImage gridTile( qreal scale , QSizeF & tileSize );
     QSize m_sizeGrid;
     QSize m_sizeGridSpace;
+    // pre-rendered tiles of grid cells, keyed by zoom level. images rather
+    // than pixmaps so copies of the tool can paint on worker threads
+    QHash<qint64,QImage> m_tiles;
 };
 
 class GraphicsItemGroup;
@@ -53,16 +71,95 @@ public:
     ~DrawScene();
     void setView(QGraphicsView * view ) { m_view = view ; }
     QGraphicsView * view() { return m_view; }
+    GridTool * grid() const { return m_grid; }
+    void setGridVisible( bool visible );
+    bool isGridVisible() const { return m_gridVisible; }
     void align(AlignType alignType );
     void mouseEvent(QGraphicsSceneMouseEvent *mouseEvent );
+    // the tools of this scene by shape, created on first use. drawShape
+    // picks the one the mouse events go to
+    DrawTool * tool( DrawShape shape );
+    DrawTool * currentTool() { return tool(m_toolState.drawShape); }
+    DrawShape drawShape() const { return m_toolState.drawShape; }
+    void setDrawShape( DrawShape shape ) { m_toolState.drawShape = shape; }
+    DrawTool::State & toolState() { return m_toolState; }
     GraphicsItemGroup * createGroup(const QList<QGraphicsItem *> &items ,bool isAdd = true);
     void destroyGroup(QGraphicsItemGroup *group);
+    // adds many items at once. a batch at least as large as the scene is
+    // added with the item index off, which is rebuilt in one pass afterwards
+    void addItems( const QList<QGraphicsItem *> & items );
+    // a load adds its items in many batches, the item index stays off for
+    // all of them and is rebuilt once at the end. calls nest
+    void beginBulkInsert();
+    void endBulkInsert();
+    // selected shapes in selection order, maintained by the shapes themselves
+    QList<QGraphicsItem *> selectedShapes() const;
+    // the selected shapes whose bounds touch rect, and with them their
+    // handles. topmost first
+    QList<QGraphicsItem *> selectedShapesIn( const QRectF & rect ) const;
+    void updateSelection( QGraphicsItem * item , bool selected );
+    // shapes without a parent group in the order they joined the top level,
+    // the document model that save walks instead of items()
+    QList<QGraphicsItem *> shapes() const;
+    void updateShape( QGraphicsItem * item , bool topLevel );
+    // shapes that joined the top level or changed and the ones that left it
+    // since the last clearShapeChanges, for saves that append the changes.
+    // changed shapes come in the order of shapes(), joined ones are the
+    // changed shapes that (re)joined the top level and stack above the rest
+    void markShapeChanged( QGraphicsItem * item );
+    QList<QGraphicsItem *> changedShapes() const;
+    QSet<QGraphicsItem *> joinedShapes() const { return m_joinedShapes; }
+    QSet<QGraphicsItem *> removedShapes() const { return m_removedShapes; }
+    void clearShapeChanges();
+    // a drag tool keeps the pointer positions and asks for a frame, its
+    // dragFrame runs once per display refresh at most. the tool asking may
+    // not be the current one, the rect tool drags through the select tool
+    void requestDragFrame( DrawTool * tool );
+    // runs a pending frame right away, before the drag ends
+    void flushDragFrame();
+    // the top-level shapes are indexed by their scene bounds in an R-tree
+    // of their own. changed bounds are marked here and the index catches
+    // up before the next query. shape lists are topmost first
+    void updateShapeBounds( QGraphicsItem * item );
+    QList<QGraphicsItem *> shapesAt( const QPointF & pos ) const;
+    QGraphicsItem * shapeAt( const QPointF & pos ) const;
+    QList<QGraphicsItem *> shapesIn( const QRectF & rect ) const;
+    QGraphicsItem * nearestShape( const QPointF & pos ) const;
+    QList<QGraphicsItem *> collidingShapes( QGraphicsItem * item ) const;
+    // selects the shapes touching rect and the ones in keep, changing only
+    // the shapes whose state differs. emits selectionChanged once
+    void selectShapes( const QRectF & rect , const QList<QGraphicsItem *> & keep );
+    // the rubber band of the select tool, painted by the views
+    void setSelectionBand( const QRectF & rect );
+    QRectF selectionBand() const { return m_selectionBand; }
+    // the outline of the shapes a drag moves or turns, in scene coordinates
+    // mapped through transform, painted by the views. empty when no drag
+    void setDragPreview( const QPainterPath & path , const QTransform & transform = QTransform() );
+    QPainterPath dragPreview() const { return m_dragPreview; }
+    QTransform dragPreviewTransform() const { return m_dragPreviewTransform; }
+    // the bounds the index keeps for the shapes together
+    QRectF shapeBounds( const QList<QGraphicsItem *> & items ) const;
+    // snapping to the visible grid and to the edges and centers of other
+    // shapes, a few pixels on screen away. the dragged shapes are no
+    // targets until endSnap, which also hides the guides
+    void beginSnap( const QList<QGraphicsItem *> & dragged );
+    void endSnap();
+    QPointF snapPoint( const QPointF & pos );
+    // the offset that brings an edge or the center of rect onto a target
+    QPointF snapOffset( const QRectF & rect );
+    // lines from the last snap to the shapes it lined up with, painted by
+    // the views
+    QVector<QLineF> guides() const { return m_guides; }
+    void clearGuides();
 signals:
     void itemMoved( QGraphicsItem * item , const QPointF & oldPosition );
     void itemRotate(QGraphicsItem * item , const qreal oldAngle );
+    // the shapes were turned by angle about center
+    void itemsRotate(const QList<QGraphicsItem *> & items , const QPointF & center , qreal angle );
     void itemAdded(QGraphicsItem * item );
     void itemResize(QGraphicsItem * item , int handle , const QPointF& scale );
     void itemControl(QGraphicsItem * item , int handle , const QPointF & newPos , const QPointF& lastPos_ );
+    void toolChanged();
 
 protected:
     void drawBackground(QPainter *painter, const QRectF &rect) Q_DECL_OVERRIDE;
@@ -72,12 +169,55 @@ protected:
     void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *mouseEvet) Q_DECL_OVERRIDE;
     void keyPressEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
     void keyReleaseEvent(QKeyEvent *e) Q_DECL_OVERRIDE;
+    void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
     QGraphicsView * m_view;
 
     qreal m_dx;
     qreal m_dy;
     bool  m_moved;
     GridTool *m_grid;
+    bool m_gridVisible;
+
+    QMap<quint64,QGraphicsItem*> m_selection;
+    QHash<QGraphicsItem*,quint64> m_selectionIndex;
+    quint64 m_selectionSerial;
+    mutable QList<QGraphicsItem*> m_selectedShapes;
+    mutable bool m_selectionDirty;
+
+    QMap<quint64,QGraphicsItem*> m_shapes;
+    QHash<QGraphicsItem*,quint64> m_shapeIndex;
+    quint64 m_shapeSerial;
+    mutable QList<QGraphicsItem*> m_shapeList;
+    mutable bool m_shapesDirty;
+    QSet<QGraphicsItem*> m_changedShapes;
+    QSet<QGraphicsItem*> m_joinedShapes;
+    QSet<QGraphicsItem*> m_removedShapes;
+    QBasicTimer m_dragFrameTimer;
+    int m_bulkInsert;
+    ItemIndexMethod m_bulkIndexMethod;
+    int m_bulkBspDepth;
+    DrawTool * m_dragFrameTool;
+
+private:
+    void updateIndex() const;
+    QList<QGraphicsItem *> sortShapes( QList<QGraphicsItem *> items ) const;
+    void updateViewports( const QRectF & rect ) const;
+    qreal snapTolerance() const;
+    bool snapAxis( Qt::Orientation axis , const QVector<qreal> & values , qreal tolerance ,
+                   SnapEngine::Guide * guide ) const;
+    QPointF snap( const QVector<qreal> & xs , const QVector<qreal> & ys , const QRectF & rect );
+    void setGuides( const QVector<QLineF> & guides );
+
+    mutable ShapeIndex m_index;
+    mutable QSet<QGraphicsItem*> m_boundsDirty;
+    QRectF m_selectionBand;
+    QPainterPath m_dragPreview;
+    QTransform m_dragPreviewTransform;
+    mutable SnapEngine m_snap;
+    QVector<DrawTool*> m_tools;
+    DrawTool::State m_toolState;
+    QSet<QGraphicsItem*> m_snapExclude;
+    QVector<QLineF> m_guides;
 };
 
 #endif // DRAWSCENE
@@ -1,4 +1,5 @@
 #include "drawtool.h"
+#include "drawscene.h"
 #include "drawobj.h"
 #include <QDebug>
 #include <QGraphicsSceneMouseEvent>
@@ -8,68 +9,121 @@
 #include "drawobj.h"
 #define PI 3.1416
 
-QList<DrawTool*> DrawTool::c_tools;
-QPointF DrawTool::c_down;
-QPointF DrawTool::c_last;
-quint32 DrawTool::c_nDownFlags;
+static QVector<DrawTool::Factory> builtinTools()
+{
+    QVector<DrawTool::Factory> factories(userShape);
+    factories[selection] = &DrawTool::create<SelectTool>;
+    factories[rotation]  = &DrawTool::create<RotationTool>;
+    factories[rectangle] = &DrawTool::create<RectTool>;
+    factories[roundrect] = &DrawTool::create<RectTool>;
+    factories[ellipse]   = &DrawTool::create<RectTool>;
+    factories[line]      = &DrawTool::create<PolygonTool>;
+    factories[polygon]   = &DrawTool::create<PolygonTool>;
+    factories[bezier]    = &DrawTool::create<PolygonTool>;
+    factories[polyline]  = &DrawTool::create<PolygonTool>;
+    return factories;
+}
 
-DrawShape DrawTool::c_drawShape = selection;
+// indexed by shape. a function static, so tools may register from static
+// initializers of other files and still replace the built-in ones
+static QVector<DrawTool::Factory> & toolFactories()
+{
+    static QVector<DrawTool::Factory> factories = builtinTools();
+    return factories;
+}
 
-static SelectTool selectTool;
-static RectTool   rectTool(rectangle);
-static RectTool   roundRectTool(roundrect);
-static RectTool   ellipseTool(ellipse);
+static void setCursor(DrawScene * scene , const QCursor & cursor )
+{
+    QGraphicsView * view = scene->view();
+    if (view)
+        view->setCursor(cursor);
+}
 
-static PolygonTool lineTool(line);
-static PolygonTool polygonTool(polygon);
-static PolygonTool bezierTool(bezier);
-static PolygonTool polylineTool(polyline);
+// handles are hit at the zoom of the view the event comes from
+static QTransform viewTransform( QGraphicsSceneMouseEvent * event )
+{
+    QWidget * viewport = event->widget();
+    QGraphicsView * view = viewport ? qobject_cast<QGraphicsView*>(viewport->parentWidget()) : 0;
+    return view ? view->transform() : QTransform();
+}
 
-static RotationTool rotationTool;
+// the pointer moved onto the grid or a guide nearby, alt drags freely
+static QPointF snapPoint( DrawScene * scene , QGraphicsSceneMouseEvent * event , const QPointF & pos )
+{
+    if ( event->modifiers() & Qt::AltModifier ){
+        scene->clearGuides();
+        return pos;
+    }
+    return scene->snapPoint(pos);
+}
 
-enum SelectMode
+static QPointF snapOffset( DrawScene * scene , QGraphicsSceneMouseEvent * event , const QRectF & rect )
 {
-    none,
-    netSelect,
-    move,
-    size,
-    rotate,
-    editor,
-};
+    if ( event->modifiers() & Qt::AltModifier ){
+        scene->clearGuides();
+        return QPointF();
+    }
+    return scene->snapOffset(rect);
+}
 
-SelectMode selectMode = none;
+// the outline of the shapes as one path in scene coordinates, moved or
+// turned as a whole during a drag while the shapes stay where they are.
+// the views paint it over their cached tiles, so a frame of the drag
+// renders no shapes. many shapes show their bounds rather than their
+// stroked outlines
+static QPainterPath previewPath( const QList<QGraphicsItem *> & items )
+{
+    QPainterPath path;
+    if ( items.count() == 1 ){
+        path = items.first()->sceneTransform().map(items.first()->shape());
+    }else{
+        foreach (QGraphicsItem *item, items) {
+            QPolygonF outline = item->mapToScene(item->boundingRect());
+            outline.append(outline.first());
+            path.addPolygon(outline);
+        }
+    }
+    return path;
+}
 
-int nDragHandle = Handle_None;
+void DrawTool::registerTool(DrawShape shape, Factory factory)
+{
+    QVector<Factory> & factories = toolFactories();
+    if ( shape >= factories.size() )
+        factories.resize(shape + 1);
+    factories[shape] = factory;
+}
 
-static void setCursor(DrawScene * scene , const QCursor & cursor )
+DrawTool *DrawTool::createTool(DrawShape shape, DrawScene *scene)
 {
-    QGraphicsView * view = scene->view();
-    if (view)
-        view->setCursor(cursor);
+    const QVector<Factory> & factories = toolFactories();
+    if ( shape < 0 || shape >= factories.size() || !factories.at(shape) )
+        return NULL;
+    return factories.at(shape)(shape,scene);
 }
 
-DrawTool::DrawTool(DrawShape shape)
+DrawTool::DrawTool(DrawShape shape, DrawScene *scene)
+    :m_state(scene->toolState())
 {
     m_drawShape = shape ;
     m_hoverSizer = false;
-    c_tools.push_back(this);
 }
 
 void DrawTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
-    c_down = event->scenePos();
-    c_last = event->scenePos();
+    m_state.down = event->scenePos();
+    m_state.last = event->scenePos();
 }
 
 void DrawTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
-    c_last = event->scenePos();
+    m_state.last = event->scenePos();
 }
 
 void DrawTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
-    if (event->scenePos() == c_down )
-        c_drawShape = selection;
+    if (event->scenePos() == m_state.down )
+        m_state.drawShape = selection;
     setCursor(scene,Qt::ArrowCursor);
 }
 
@@ -78,22 +132,19 @@ void DrawTool::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event, DrawScene
 
 }
 
-DrawTool *DrawTool::findTool(DrawShape drawShape)
+void DrawTool::dragFrame(DrawScene *scene)
 {
-    QList<DrawTool*>::const_iterator iter = c_tools.constBegin();
-    for ( ; iter != c_tools.constEnd() ; ++iter ){
-        if ((*iter)->m_drawShape == drawShape )
-            return (*iter);
-    }
-    return 0;
+    Q_UNUSED(scene);
 }
 
-SelectTool::SelectTool()
-    :DrawTool(selection)
+SelectTool::SelectTool(DrawShape shape, DrawScene *scene)
+    :DrawTool(shape,scene)
 {
-    dashRect = 0;
     selLayer = 0;
     opposite_ = QPointF();
+    handleOffset = QPointF();
+    dragApplied = false;
+    clickedShape = 0;
 }
 
 void SelectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
@@ -102,12 +153,23 @@ void SelectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
 
     if ( event->button() != Qt::LeftButton ) return;
 
-    if (!m_hoverSizer)
-       scene->mouseEvent(event);
+    // hit-tested through the scene's shape index, ctrl toggles on release
+    clickedShape = 0;
+    if (!m_hoverSizer){
+        const bool multiSelect = event->modifiers() & Qt::ControlModifier;
+        clickedShape = scene->shapeAt(event->scenePos());
+        if ( clickedShape && !multiSelect && !clickedShape->isSelected() ){
+            scene->clearSelection();
+            clickedShape->setSelected(true);
+        }else if ( !clickedShape && !multiSelect ){
+            scene->clearSelection();
+        }
+    }
 
-    nDragHandle = Handle_None;
-    selectMode = none;
-    QList<QGraphicsItem *> items = scene->selectedItems();
+    m_state.dragHandle = Handle_None;
+    m_state.selectMode = none;
+    handleOffset = QPointF();
+    QList<QGraphicsItem *> items = scene->selectedShapes();
     AbstractShape *item = 0;
 
     if ( items.count() == 1 )
@@ -115,33 +177,35 @@ void SelectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
 
     if ( item != 0 ){
 
-        nDragHandle = item->collidesWithHandle(event->scenePos());
-        if ( nDragHandle != Handle_None && nDragHandle <= Left )
-             selectMode = size;
-        else if ( nDragHandle > Left )
-            selectMode = editor;
+        m_state.dragHandle = item->collidesWithHandle(event->scenePos(),viewTransform(event));
+        if ( m_state.dragHandle != Handle_None && m_state.dragHandle <= Left )
+             m_state.selectMode = size;
+        else if ( m_state.dragHandle > Left )
+            m_state.selectMode = editor;
         else
-            selectMode =  move;
+            m_state.selectMode =  move;
 
-        if ( nDragHandle!= Handle_None && nDragHandle <= Left ){
-            opposite_ = item->opposite(nDragHandle);
+        if ( m_state.dragHandle!= Handle_None && m_state.dragHandle <= Left ){
+            opposite_ = item->opposite(m_state.dragHandle);
             if( opposite_.x() == 0 )
                 opposite_.setX(1);
             if (opposite_.y() == 0 )
                 opposite_.setY(1);
+            // the stretch starts at the handle, so a snapped pointer puts
+            // the handle right on the target
+            handleOffset = item->mapToScene(item->handlePos(m_state.dragHandle)) - m_state.down;
+            m_state.down += handleOffset;
+            m_state.last = m_state.down;
         }
 
         setCursor(scene,Qt::ClosedHandCursor);
 
     }else if ( items.count() > 1 )
-        selectMode =  move;
+        m_state.selectMode =  move;
 
-    if( selectMode == none ){
-        selectMode = netSelect;
-        if ( scene->view() ){
-            QGraphicsView * view = scene->view();
-            view->setDragMode(QGraphicsView::RubberBandDrag);
-        }
+    if( m_state.selectMode == none ){
+        m_state.selectMode = netSelect;
+        keptSelection = scene->selectedShapes();
 #if 0
         if ( selLayer ){
             scene->destroyGroup(selLayer);
@@ -150,65 +214,32 @@ void SelectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
 #endif
     }
 
-    if ( selectMode == move && items.count() == 1 ){
+    if ( m_state.selectMode == move ){
 
-        if (dashRect ){
-            scene->removeItem(dashRect);
-            delete dashRect;
-            dashRect = 0;
-        }
-
-        dashRect = new QGraphicsPathItem(item->shape());
-        dashRect->setPen(Qt::DashLine);
-        dashRect->setPos(item->pos());
-        dashRect->setTransformOriginPoint(item->transformOriginPoint());
-        dashRect->setTransform(item->transform());
-        dashRect->setRotation(item->rotation());
-        dashRect->setScale(item->scale());
-        dashRect->setZValue(item->zValue());
-        scene->addItem(dashRect);
-
-        initialPositions = item->pos();
+        scene->setDragPreview(previewPath(items));
+        dragBounds = scene->shapeBounds(items);
+        if ( item )
+            initialPositions = item->pos();
     }
+    if ( m_state.selectMode != netSelect )
+        scene->beginSnap(items);
 }
 
 void SelectTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
     DrawTool::mouseMoveEvent(event,scene);
-    QList<QGraphicsItem *> items = scene->selectedItems();
+    QList<QGraphicsItem *> items = scene->selectedShapes();
     AbstractShape * item = 0;
     if ( items.count() == 1 ){
         item = qgraphicsitem_cast<AbstractShape*>(items.first());
         if ( item != 0 ){
-            if ( nDragHandle != Handle_None && selectMode == size ){
-                if (opposite_.isNull()){
-                    opposite_ = item->opposite(nDragHandle);
-                    if( opposite_.x() == 0 )
-                        opposite_.setX(1);
-                    if (opposite_.y() == 0 )
-                        opposite_.setY(1);
-                }
-
-                QPointF new_delta = item->mapFromScene(c_last) - opposite_;
-                QPointF initial_delta = item->mapFromScene(c_down) - opposite_;
-
-                double sx = new_delta.x() / initial_delta.x();
-                double sy = new_delta.y() / initial_delta.y();
-
-                item->stretch(nDragHandle, sx , sy , opposite_);
-
-                emit scene->itemResize(item,nDragHandle,QPointF(sx,sy));
-
-              //  qDebug()<<"scale:"<<nDragHandle<< item->mapToScene(opposite_)<< sx << " ，" << sy
-              //         << new_delta << item->mapFromScene(c_last)
-              //         << initial_delta << item->mapFromScene(c_down) << item->boundingRect();
-
-            } else if ( nDragHandle > Left  && selectMode == editor ){
-                item->control(nDragHandle,c_last);
-                emit scene->itemControl(item,nDragHandle,c_last,c_down);
+            if ( m_state.dragHandle != Handle_None && (m_state.selectMode == size || m_state.selectMode == editor) ){
+                // m_state.last holds the pointer, the shape follows once per frame
+                m_state.last = snapPoint(scene,event,m_state.last + handleOffset);
+                scene->requestDragFrame(this);
             }
-            else if(nDragHandle == Handle_None ){
-                 int handle = item->collidesWithHandle(event->scenePos());
+            else if(m_state.dragHandle == Handle_None ){
+                 int handle = item->collidesWithHandle(event->scenePos(),viewTransform(event));
                  if ( handle != Handle_None){
                      setCursor(scene,Qt::OpenHandCursor);
                      m_hoverSizer = true;
@@ -220,19 +251,59 @@ void SelectTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scen
         }
     }
 
-    if ( selectMode == move ){
+    if ( m_state.selectMode == move ){
         setCursor(scene,Qt::ClosedHandCursor);
-        if ( dashRect ){
-            dashRect->setPos(initialPositions + c_last - c_down);
+        if ( !scene->dragPreview().isEmpty() ){
+            // the outline snaps as a whole, the release moves the shapes as far
+            QPointF delta = m_state.last - m_state.down;
+            delta += snapOffset(scene,event,dragBounds.translated(delta));
+            m_state.last = m_state.down + delta;
+            scene->setDragPreview(scene->dragPreview(),QTransform::fromTranslate(delta.x(),delta.y()));
         }
+    }else if ( m_state.selectMode == netSelect ){
+        scene->requestDragFrame(this);
     }
+}
 
-    if ( selectMode != size  && items.count() > 1)
-    {
-        scene->mouseEvent(event);
-
+void SelectTool::dragFrame(DrawScene *scene)
+{
+    if ( m_state.selectMode == netSelect ){
+        const QRectF band = QRectF(m_state.down,m_state.last).normalized();
+        scene->setSelectionBand(band);
+        scene->selectShapes(band,keptSelection);
+        return;
     }
 
+    QList<QGraphicsItem *> items = scene->selectedShapes();
+    if ( items.count() != 1 || m_state.dragHandle == Handle_None )
+        return;
+    AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(items.first());
+    if ( !item )
+        return;
+
+    if ( m_state.selectMode == size ){
+        if (opposite_.isNull()){
+            opposite_ = item->opposite(m_state.dragHandle);
+            if( opposite_.x() == 0 )
+                opposite_.setX(1);
+            if (opposite_.y() == 0 )
+                opposite_.setY(1);
+        }
+
+        QPointF new_delta = item->mapFromScene(m_state.last) - opposite_;
+        QPointF initial_delta = item->mapFromScene(m_state.down) - opposite_;
+
+        double sx = new_delta.x() / initial_delta.x();
+        double sy = new_delta.y() / initial_delta.y();
+
+        // relative to the shape at the press, updateCoordinate comes on release
+        item->stretch(m_state.dragHandle, sx , sy , opposite_);
+        lastScale = QPointF(sx,sy);
+        dragApplied = true;
+    } else if ( m_state.dragHandle > Left && m_state.selectMode == editor ){
+        item->control(m_state.dragHandle,m_state.last);
+        dragApplied = true;
+    }
 }
 
 void SelectTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
@@ -242,190 +313,202 @@ void SelectTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *s
 
     if ( event->button() != Qt::LeftButton ) return;
 
-    QList<QGraphicsItem *> items = scene->selectedItems();
+    scene->flushDragFrame();
+    QList<QGraphicsItem *> items = scene->selectedShapes();
     if ( items.count() == 1 ){
         AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(items.first());
-        if ( item != 0  && selectMode == move && c_last != c_down ){
-             item->setPos(initialPositions + c_last - c_down);
-             emit scene->itemMoved(item , c_last - c_down );
-         }else if ( item !=0 && (selectMode == size || selectMode ==editor) && c_last != c_down ){
-
+        if ( item != 0  && m_state.selectMode == move && m_state.last != m_state.down ){
+             item->setPos(initialPositions + m_state.last - m_state.down);
+             emit scene->itemMoved(item , m_state.last - m_state.down );
+         }else if ( item !=0 && (m_state.selectMode == size || m_state.selectMode ==editor) && m_state.last != m_state.down ){
+            // the whole drag as one undo step
+            if ( dragApplied && m_state.selectMode == size )
+                emit scene->itemResize(item,m_state.dragHandle,lastScale);
+            else if ( dragApplied )
+                emit scene->itemControl(item,m_state.dragHandle,m_state.last,m_state.down);
             item->updateCoordinate();
         }
-    }else if ( items.count() > 1 && selectMode == move && c_last != c_down ){
-          emit scene->itemMoved(NULL , c_last - c_down );
+    }else if ( items.count() > 1 && m_state.selectMode == move && m_state.last != m_state.down ){
+        const QPointF delta = m_state.last - m_state.down;
+        foreach (QGraphicsItem *item, items) {
+            item->moveBy(delta.x(),delta.y());
+        }
+        emit scene->itemMoved(NULL , delta );
     }
 
-    if (selectMode == netSelect ){
-
-        if ( scene->view() ){
-            QGraphicsView * view = scene->view();
-            view->setDragMode(QGraphicsView::NoDrag);
+    if ( clickedShape && m_state.last == m_state.down ){
+        if ( event->modifiers() & Qt::ControlModifier ){
+            clickedShape->setSelected(!clickedShape->isSelected());
+        }else if ( scene->selectedShapes().count() > 1 ){
+            scene->clearSelection();
+            clickedShape->setSelected(true);
         }
+    }
+
+    if (m_state.selectMode == netSelect ){
+        scene->setSelectionBand(QRectF());
+        keptSelection.clear();
 #if 0
-        if ( scene->selectedItems().count() > 1 ){
-            selLayer = scene->createGroup(scene->selectedItems());
+        if ( scene->selectedShapes().count() > 1 ){
+            selLayer = scene->createGroup(scene->selectedShapes());
             selLayer->setSelected(true);
         }
 #endif
     }
-    if (dashRect ){
-        scene->removeItem(dashRect);
-        delete dashRect;
-        dashRect = 0;
-    }
-    selectMode = none;
-    nDragHandle = Handle_None;
+    scene->setDragPreview(QPainterPath());
+    m_state.selectMode = none;
+    m_state.dragHandle = Handle_None;
     m_hoverSizer = false;
     opposite_ = QPointF();
-    scene->mouseEvent(event);
+    handleOffset = QPointF();
+    dragApplied = false;
+    clickedShape = 0;
+    scene->endSnap();
 }
 
-RotationTool::RotationTool()
-    :DrawTool(rotation)
+RotationTool::RotationTool(DrawShape shape, DrawScene *scene)
+    :DrawTool(shape,scene)
 {
     lastAngle = 0;
-    dashRect = 0;
 }
 
-void RotationTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
+// a handle of a selected shape under the pointer, found the way the view
+// finds the one it highlights
+static int rotateHandleAt( DrawScene * scene , QGraphicsSceneMouseEvent * event )
 {
-    DrawTool::mousePressEvent(event,scene);
-    if ( event->button() != Qt::LeftButton ) return;
+    const QTransform trans = viewTransform(event);
+    const QSizeF size = SelectionHandle::sceneSize(trans);
+    const QPointF pt = event->scenePos();
+    const QRectF near(pt.x() - size.width() / 2,pt.y() - size.height() / 2,
+                      size.width(),size.height());
+    foreach (QGraphicsItem *item, scene->selectedShapesIn(near)) {
+        int handle = Handle_None;
+        if ( GraphicsItemGroup * group = qgraphicsitem_cast<GraphicsItemGroup*>(item) )
+            handle = group->collidesWithHandle(pt,trans);
+        else if ( GraphicsItem * shape = qgraphicsitem_cast<GraphicsItem*>(item) )
+            handle = shape->collidesWithHandle(pt,trans);
+        if ( handle != Handle_None )
+            return handle;
+    }
+    return Handle_None;
+}
 
-    if (!m_hoverSizer)
-      scene->mouseEvent(event);
+static qreal wrapAngle( qreal angle )
+{
+    if ( angle > 360 )
+        angle -= 360;
+    if ( angle < -360 )
+        angle += 360;
+    return angle;
+}
 
-    QList<QGraphicsItem *> items = scene->selectedItems();
-    if ( items.count() == 1 ){
-        AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(items.first());
-        if ( item != 0 ){
-            nDragHandle = item->collidesWithHandle(event->scenePos());
-            if ( nDragHandle !=Handle_None)
-            {
-                QPointF origin = item->mapToScene(item->boundingRect().center());
-
-                qreal len_y = c_last.y() - origin.y();
-                qreal len_x = c_last.x() - origin.x();
-
-                qreal angle = atan2(len_y,len_x)*180/PI;
-
-                lastAngle = angle;
-                selectMode = rotate;
-
-                if (dashRect ){
-                    scene->removeItem(dashRect);
-                    delete dashRect;
-                    dashRect = 0;
-                }
-
-                dashRect = new QGraphicsPathItem(item->shape());
-                dashRect->setPen(Qt::DashLine);
-                dashRect->setPos(item->pos());
-                dashRect->setTransformOriginPoint(item->transformOriginPoint());
-                dashRect->setTransform(item->transform());
-                dashRect->setRotation(item->rotation());
-                dashRect->setScale(item->scale());
-                dashRect->setZValue(item->zValue());
-                scene->addItem(dashRect);
-                setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
-            }
-            else{
-                    c_drawShape = selection;
-                    selectTool.mousePressEvent(event,scene);
-                }
-        }
-    }
+qreal RotationTool::pointerAngle() const
+{
+    qreal len_y = m_state.last.y() - previewOrigin.y();
+    qreal len_x = m_state.last.x() - previewOrigin.x();
+    return atan2(len_y,len_x)*180/PI;
 }
 
-void RotationTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
+// whole degrees the pointer turned about previewOrigin since the press
+qreal RotationTool::dragAngle() const
 {
-    DrawTool::mouseMoveEvent(event,scene);
-    QList<QGraphicsItem *> items = scene->selectedItems();
-    if ( items.count() == 1 ){
-        AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(items.first());
-        if ( item != 0  && nDragHandle !=Handle_None && selectMode == rotate ){
+    return int(pointerAngle() - lastAngle);
+}
 
-             QPointF origin = item->mapToScene(item->boundingRect().center());
+QTransform RotationTool::dragTurn() const
+{
+    QTransform turn;
+    turn.translate(previewOrigin.x(),previewOrigin.y());
+    turn.rotate(dragAngle());
+    turn.translate(-previewOrigin.x(),-previewOrigin.y());
+    return turn;
+}
 
-             qreal len_y = c_last.y() - origin.y();
-             qreal len_x = c_last.x() - origin.x();
-             qreal angle = atan2(len_y,len_x)*180/PI;
+// a press away from the handles picks, moves and bands the shapes as the
+// select tool does, outline preview and all
+void RotationTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
+{
+    DrawTool::mousePressEvent(event,scene);
+    if ( event->button() != Qt::LeftButton ) return;
 
-             angle = item->rotation() + int(angle - lastAngle) ;
+    m_state.dragHandle = rotateHandleAt(scene,event);
+    if ( m_state.dragHandle == Handle_None ){
+        scene->tool(selection)->mousePressEvent(event,scene);
+        return;
+    }
 
-             if ( angle > 360 )
-                 angle -= 360;
-             if ( angle < -360 )
-                 angle+=360;
+    // one shape turns about its own origin, a selection about its center
+    QList<QGraphicsItem *> items = scene->selectedShapes();
+    if ( items.count() == 1 )
+        previewOrigin = items.first()->mapToScene(items.first()->transformOriginPoint());
+    else
+        previewOrigin = scene->shapeBounds(items).center();
+    lastAngle = pointerAngle();
+    m_state.selectMode = rotate;
+    scene->setDragPreview(previewPath(items));
+    setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
+}
 
-             if ( dashRect ){
-                 //dashRect->setTransform(QTransform::fromTranslate(15,15),true);
-                 //dashRect->setTransform(QTransform().rotate(angle));
-                 //dashRect->setTransform(QTransform::fromTranslate(-15,-15),true);
-                 dashRect->setRotation( angle );
-             }
+void RotationTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
+{
+    if ( m_state.selectMode != none && m_state.selectMode != rotate ){
+        scene->tool(selection)->mouseMoveEvent(event,scene);
+        return;
+    }
+    DrawTool::mouseMoveEvent(event,scene);
 
-             setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
-        }
-        else if ( item )
-        {
-            int handle = item->collidesWithHandle(event->scenePos());
-            if ( handle != Handle_None){
-                setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
-                m_hoverSizer = true;
-            }else{
-                setCursor(scene,Qt::ArrowCursor);
-                m_hoverSizer = false;
-            }
-        }
+    if ( m_state.selectMode == rotate ){
+        // the outline turns as a whole, the shapes follow on release
+        scene->setDragPreview(scene->dragPreview(),dragTurn());
+        setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
+        return;
     }
-    scene->mouseEvent(event);
+
+    m_hoverSizer = rotateHandleAt(scene,event) != Handle_None;
+    if ( m_hoverSizer )
+        setCursor(scene,QCursor((QPixmap(":/icons/rotate.png"))));
+    else
+        setCursor(scene,Qt::ArrowCursor);
 }
 
 void RotationTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
+    if ( m_state.selectMode != none && m_state.selectMode != rotate ){
+        scene->tool(selection)->mouseReleaseEvent(event,scene);
+        return;
+    }
     DrawTool::mouseReleaseEvent(event,scene);
     if ( event->button() != Qt::LeftButton ) return;
 
-    QList<QGraphicsItem *> items = scene->selectedItems();
-    if ( items.count() == 1 ){
-        AbstractShape * item = qgraphicsitem_cast<AbstractShape*>(items.first());
-        if ( item != 0  && nDragHandle !=Handle_None && selectMode == rotate ){
-
-             QPointF origin = item->mapToScene(item->boundingRect().center());
-             QPointF delta = c_last - origin ;
-             qreal len_y = c_last.y() - origin.y();
-             qreal len_x = c_last.x() - origin.x();
-             qreal angle = atan2(len_y,len_x)*180/PI,oldAngle = item->rotation();
-             angle = item->rotation() + int(angle - lastAngle) ;
-
-             if ( angle > 360 )
-                 angle -= 360;
-             if ( angle < -360 )
-                 angle+=360;
-
-             item->setRotation( angle );
-             emit scene->itemRotate(item , oldAngle);
-             qDebug()<<"rotate:"<<angle<<item->boundingRect();
+    const qreal angle = m_state.selectMode == rotate ? dragAngle() : 0;
+    QList<QGraphicsItem *> items = scene->selectedShapes();
+    if ( angle != 0 && items.count() == 1 ){
+        QGraphicsItem * item = items.first();
+        const qreal oldAngle = item->rotation();
+        item->setRotation(wrapAngle(oldAngle + angle));
+        emit scene->itemRotate(item , oldAngle);
+    }else if ( angle != 0 && items.count() > 1 ){
+        // every shape moves with its origin and turns about it as far
+        const QTransform turn = dragTurn();
+        foreach (QGraphicsItem *item, items) {
+            const QPointF anchor = item->mapToScene(item->transformOriginPoint());
+            const QPointF delta = turn.map(anchor) - anchor;
+            item->moveBy(delta.x(),delta.y());
+            item->setRotation(wrapAngle(item->rotation() + angle));
         }
+        emit scene->itemsRotate(items,previewOrigin,angle);
     }
 
     setCursor(scene,Qt::ArrowCursor);
-    selectMode = none;
-    nDragHandle = Handle_None;
+    m_state.selectMode = none;
+    m_state.dragHandle = Handle_None;
     lastAngle = 0;
     m_hoverSizer = false;
-    if (dashRect ){
-        scene->removeItem(dashRect);
-        delete dashRect;
-        dashRect = 0;
-    }
-    scene->mouseEvent(event);
+    scene->setDragPreview(QPainterPath());
 }
 
-RectTool::RectTool(DrawShape drawShape)
-    :DrawTool(drawShape)
+RectTool::RectTool(DrawShape drawShape, DrawScene *scene)
+    :DrawTool(drawShape,scene)
 {
     item = 0;
 }
@@ -437,7 +520,10 @@ void RectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene
 
     scene->clearSelection();
     DrawTool::mousePressEvent(event,scene);
-    switch ( c_drawShape ){
+    scene->beginSnap(QList<QGraphicsItem *>());
+    const QPointF pos = snapPoint(scene,event,m_state.down);
+    m_state.down = m_state.last = pos;
+    switch ( m_state.drawShape ){
     case rectangle:
         item = new GraphicsRectItem(QRect(1,1,1,1));
         break;
@@ -449,13 +535,14 @@ void RectTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene
         break;
     }
     if ( item == 0) return;
-    c_down+=QPoint(2,2);
-    item->setPos(event->scenePos());
+    m_state.down+=QPoint(2,2);
+    item->setPos(pos);
     scene->addItem(item);
     item->setSelected(true);
+    scene->beginSnap(QList<QGraphicsItem *>() << item);
 
-    selectMode = size;
-    nDragHandle = RightBottom;
+    m_state.selectMode = size;
+    m_state.dragHandle = RightBottom;
 
 }
 
@@ -463,14 +550,15 @@ void RectTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
     setCursor(scene,Qt::CrossCursor);
 
-    selectTool.mouseMoveEvent(event,scene);
+    scene->tool(selection)->mouseMoveEvent(event,scene);
 }
 
 void RectTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
-    selectTool.mouseReleaseEvent(event,scene);
+    scene->tool(selection)->mouseReleaseEvent(event,scene);
 
-    if ( event->scenePos() == (c_down-QPoint(2,2))){
+    // the press may have snapped, a click is a release where it started
+    if ( event->scenePos() == event->buttonDownScenePos(Qt::LeftButton) ){
 
        if ( item != 0){
          item->setSelected(false);
@@ -482,12 +570,12 @@ void RectTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
     }else if( item ){
         emit scene->itemAdded( item );
     }
-  c_drawShape = selection;
+  m_state.drawShape = selection;
 }
 
 
-PolygonTool::PolygonTool(DrawShape shape)
-    :DrawTool(shape)
+PolygonTool::PolygonTool(DrawShape shape, DrawScene *scene)
+    :DrawTool(shape,scene)
 {
     item = NULL;
     m_nPoints = 0;
@@ -499,40 +587,45 @@ void PolygonTool::mousePressEvent(QGraphicsSceneMouseEvent *event, DrawScene *sc
 
     if ( event->button() != Qt::LeftButton ) return;
 
+    if ( item == NULL )
+        scene->beginSnap(QList<QGraphicsItem *>());
+    m_state.down = m_state.last = snapPoint(scene,event,m_state.down);
+
     if ( item == NULL ){
-        if ( c_drawShape == polygon ){
+        if ( m_state.drawShape == polygon ){
         item = new GraphicsPolygonItem(NULL);
-        }else if (c_drawShape == bezier ){
+        }else if (m_state.drawShape == bezier ){
             item = new GraphicsBezier();
-        }else if ( c_drawShape == polyline ){
+        }else if ( m_state.drawShape == polyline ){
             item = new GraphicsBezier(false);
-        }else if ( c_drawShape == line ){
+        }else if ( m_state.drawShape == line ){
             item = new GraphicsLineItem(0);
         }
-        item->setPos(event->scenePos());
+        item->setPos(m_state.down);
         scene->addItem(item);
-        initialPositions = c_down;
-        item->addPoint(c_down);
+        scene->beginSnap(QList<QGraphicsItem *>() << item);
+        initialPositions = m_state.down;
+        item->addPoint(m_state.down);
         item->setSelected(true);
         m_nPoints++;
 
-    }else if ( c_down == c_last ){
+    }else if ( m_state.down == m_state.last ){
         /*
         if ( item != NULL )
         {
             scene->removeItem(item);
             delete item;
             item = NULL ;
-            c_drawShape = selection;
-            selectMode = none;
+            m_state.drawShape = selection;
+            m_state.selectMode = none;
             return ;
         }
         */
     }
-    item->addPoint(c_down+QPoint(1,0));
+    item->addPoint(m_state.down+QPoint(1,0));
     m_nPoints++;
-    selectMode = size ;
-    nDragHandle = item->handleCount();
+    m_state.selectMode = size ;
+    m_state.dragHandle = item->handleCount();
 }
 
 void PolygonTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
@@ -543,8 +636,9 @@ void PolygonTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
 //    selectTool.mouseMoveEvent(event,scene);
 
     if ( item != 0 ){
-        if ( nDragHandle != Handle_None && selectMode == size ){
-            item->control(nDragHandle,c_last);
+        if ( m_state.dragHandle != Handle_None && m_state.selectMode == size ){
+            m_state.last = snapPoint(scene,event,m_state.last);
+            item->control(m_state.dragHandle,m_state.last);
         }
     }
 
@@ -553,14 +647,15 @@ void PolygonTool::mouseMoveEvent(QGraphicsSceneMouseEvent *event, DrawScene *sce
 void PolygonTool::mouseReleaseEvent(QGraphicsSceneMouseEvent *event, DrawScene *scene)
 {
     DrawTool::mousePressEvent(event,scene);
-    if ( c_drawShape == line ){
+    if ( m_state.drawShape == line ){
         item->endPoint(event->scenePos());
         item->updateCoordinate();
         emit scene->itemAdded( item );
         item = NULL;
-        selectMode = none;
-        c_drawShape = selection;
+        m_state.selectMode = none;
+        m_state.drawShape = selection;
         m_nPoints = 0;
+        scene->endSnap();
     }
 }
 
@@ -571,7 +666,8 @@ void PolygonTool::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event, DrawSce
     item->updateCoordinate();
     emit scene->itemAdded( item );
     item = NULL;
-    selectMode = none;
-    c_drawShape = selection;
+    m_state.selectMode = none;
+    m_state.drawShape = selection;
     m_nPoints = 0;
+    scene->endSnap();
 }
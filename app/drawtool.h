@@ -3,7 +3,6 @@
 
 
 #include "drawobj.h"
-#include "drawscene.h"
 
 QT_BEGIN_NAMESPACE
 class QGraphicsScene;
@@ -31,55 +30,110 @@ enum DrawShape
     bezier,
     polygon,
     polyline,
+    // the first shape free for tools registered from outside
+    userShape = 32
 };
 
+// A tool handles the mouse for one DrawShape. Every scene creates its own
+// tools on first use from the factories registered here, so documents in
+// several windows never share a drag, and finds them by shape in constant
+// time.
 class DrawTool
 {
 public:
-    DrawTool( DrawShape shape );
+    enum SelectMode
+    {
+        none,
+        netSelect,
+        move,
+        size,
+        rotate,
+        editor,
+    };
+
+    // the drag state the tools of one scene share, owned by the scene.
+    // drawShape is the current tool of the scene
+    struct State
+    {
+        State() : drawShape(selection), selectMode(none), dragHandle(Handle_None) {}
+        QPointF down;
+        QPointF last;
+        DrawShape drawShape;
+        SelectMode selectMode;
+        int dragHandle;
+    };
+
+    typedef DrawTool * (*Factory)( DrawShape shape , DrawScene * scene );
+    // makes a tool available to the scenes that have not used the shape yet,
+    // replacing the factory registered before. shapes from userShape on are
+    // free for new tools
+    static void registerTool( DrawShape shape , Factory factory );
+    // NULL if no tool is registered for the shape
+    static DrawTool * createTool( DrawShape shape , DrawScene * scene );
+    template <class Tool>
+    static DrawTool * create( DrawShape shape , DrawScene * scene )
+    {
+        return new Tool(shape,scene);
+    }
+
+    DrawTool( DrawShape shape , DrawScene * scene );
+    virtual ~DrawTool() {}
     virtual void mousePressEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene );
     virtual void mouseDoubleClickEvent(QGraphicsSceneMouseEvent * event ,DrawScene *scene );
+    // applies the pointer positions gathered since the last frame, see
+    // DrawScene::requestDragFrame
+    virtual void dragFrame(DrawScene * scene );
     DrawShape m_drawShape;
     bool m_hoverSizer;
 
-    static DrawTool * findTool( DrawShape drawShape );
-    static QList<DrawTool*> c_tools;
-    static QPointF c_down;
-    static quint32 c_nDownFlags;
-    static QPointF c_last;
-    static DrawShape c_drawShape;
+protected:
+    State & m_state;
 };
 
 class SelectTool : public DrawTool
 {
 public:
-    SelectTool();
+    SelectTool( DrawShape shape , DrawScene * scene );
     virtual void mousePressEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene );
+    void dragFrame(DrawScene * scene );
     QPointF initialPositions;
     QPointF opposite_;
-    QGraphicsPathItem * dashRect;
+    // what the handle drag applied last, recorded as one command on release
+    QPointF lastScale;
+    bool dragApplied;
+    // from the pointer to the handle dragged, and the bounds of the shapes
+    // moved, both snapped rather than the pointer itself
+    QPointF handleOffset;
+    QRectF dragBounds;
+    // the shape under the press and the selection a band adds to
+    QGraphicsItem * clickedShape;
+    QList<QGraphicsItem *> keptSelection;
     GraphicsItemGroup * selLayer;
 };
 
 class  RotationTool : public DrawTool
 {
 public:
-    RotationTool();
+    RotationTool( DrawShape shape , DrawScene * scene );
     virtual void mousePressEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene );
+    qreal pointerAngle() const;
+    qreal dragAngle() const;
+    QTransform dragTurn() const;
     qreal lastAngle;
-    QGraphicsPathItem * dashRect;
+    // what the shapes turn about, the pointer angle is taken around it too
+    QPointF previewOrigin;
 };
 
 class RectTool : public DrawTool
 {
 public:
-    RectTool(DrawShape drawShape);
+    RectTool( DrawShape drawShape , DrawScene * scene );
     virtual void mousePressEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene );
@@ -89,7 +143,7 @@ public:
 class PolygonTool : public DrawTool
 {
 public:
-    PolygonTool(DrawShape shape );
+    PolygonTool( DrawShape shape , DrawScene * scene );
     virtual void mousePressEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene ) ;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent * event , DrawScene * scene );
@@ -1,13 +1,47 @@
 #include "drawview.h"
 #include "drawscene.h"
-#include <QSvgGenerator>
-#include <QXmlStreamWriter>
-#include <QXmlStreamReader>
+#include <QBuffer>
+#include <QThread>
+#include <QProgressDialog>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QDir>
+#include <QLockFile>
+#include <QStandardPaths>
+#include "documentloader.h"
+
+// time the gui thread spends turning loaded records into items per slice
+static const int LoadTimeSlice = 15;
+// missing tiles painted on the gui thread, more are handed to the workers
+static const int SyncTiles = 4;
+// selected shapes smaller than this many pixels get no handles
+static const qreal HandlePixels = 3;
+// milliseconds between autosaves of a modified drawing
+static const int AutoSaveInterval = 60 * 1000;
 
 //http://www.w3.org/TR/SVG/Overview.html
 
+static const AbstractShape::Handles * shapeHandles( QGraphicsItem * item )
+{
+    if ( GraphicsItemGroup * group = qgraphicsitem_cast<GraphicsItemGroup*>(item) )
+        return &group->handles();
+    if ( GraphicsItem * shape = qgraphicsitem_cast<GraphicsItem*>(item) )
+        return &shape->handles();
+    return 0;
+}
+
+static int handleAt( QGraphicsItem * item , const QPointF & scenePos , const QTransform & trans )
+{
+    if ( GraphicsItemGroup * group = qgraphicsitem_cast<GraphicsItemGroup*>(item) )
+        return group->collidesWithHandle(scenePos,trans);
+    if ( GraphicsItem * shape = qgraphicsitem_cast<GraphicsItem*>(item) )
+        return shape->collidesWithHandle(scenePos,trans);
+    return Handle_None;
+}
+
 DrawView::DrawView(QGraphicsScene *scene)
     :QGraphicsView(scene)
+    ,m_document(dynamic_cast<DrawScene*>(scene))
 {
     m_hruler = new QtRuleBar(Qt::Horizontal,this,this);
     m_vruler = new QtRuleBar(Qt::Vertical,this,this);
@@ -18,6 +52,49 @@ DrawView::DrawView(QGraphicsScene *scene)
     isUntitled = true;
 
     modified = false;
+    m_hoverItem = NULL;
+    m_hoverHandle = Handle_None;
+
+    m_loadThread = NULL;
+    m_loader = NULL;
+    m_loadProgress = NULL;
+    m_loadOffset = 0;
+    m_loading = m_loadDone = m_loadOk = m_loadScheduled = m_loadJournal = false;
+    m_loadRecords = -1;
+
+    m_renderer = new TileRenderer(this);
+    m_generation = 1;
+    m_snapshotGeneration = 0;
+    connect(m_renderer,SIGNAL(tileReady(QImage,QTransform,int,int,quint64)),
+            this,SLOT(tileRendered(QImage,QTransform,int,int,quint64)));
+    // selection handles are painted outside of the shapes' bounding rects
+    connect(scene,SIGNAL(changed(QList<QRectF>)),this,SLOT(updateHandles(QList<QRectF>)));
+    connect(scene,SIGNAL(changed(QList<QRectF>)),this,SLOT(invalidateTiles(QList<QRectF>)));
+    connect(scene,SIGNAL(sceneRectChanged(QRectF)),this,SLOT(clearTiles()));
+
+    static int autoSaveId = 1;
+    m_autoSaveId = autoSaveId++;
+    m_revision = m_autoSavedRevision = 0;
+    m_saveFailed = false;
+    m_writer = new DocumentWriter(this);
+    connect(m_writer,SIGNAL(finished(QString,bool,QString)),
+            this,SLOT(saveFinished(QString,bool,QString)));
+    m_autoSaveTimer = new QTimer(this);
+    connect(m_autoSaveTimer,SIGNAL(timeout()),this,SLOT(autoSave()));
+    m_autoSaveTimer->start(AutoSaveInterval);
+}
+
+DrawView::~DrawView()
+{
+    if ( m_loader ){
+        m_loader->cancel();
+        m_loadThread->quit();
+        m_loadThread->wait();
+        delete m_loader;
+    }
+    // waits for running tiles and writes before the view goes away
+    delete m_renderer;
+    delete m_writer;
 }
 
 void DrawView::zoomIn()
@@ -39,33 +116,20 @@ void DrawView::newFile()
     isUntitled = true;
     curFile = tr("drawing%1.xml").arg(sequenceNumber++);
     setWindowTitle(curFile + "[*]");
+    updateAutoSaveFile();
 }
 
 bool DrawView::loadFile(const QString &fileName)
 {
-    QFile file(fileName);
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+    if ( !m_document.load(fileName) ){
         QMessageBox::warning(this, tr("Qt Drawing"),
                              tr("Cannot read file %1:\n%2.")
                              .arg(fileName)
-                             .arg(file.errorString()));
+                             .arg(m_document.errorString()));
         return false;
     }
-
-    QXmlStreamReader xml(&file);
-    if (xml.readNextStartElement()) {
-        if ( xml.name() == tr("canvas"))
-        {
-            int width = xml.attributes().value(tr("width")).toInt();
-            int height = xml.attributes().value(tr("height")).toInt();
-            scene()->setSceneRect(0,0,width,height);
-            loadCanvas(&xml);
-        }
-    }
-
     setCurrentFile(fileName);
-    qDebug()<<xml.errorString();
-    return !xml.error();
+    return true;
 }
 
 bool DrawView::save()
@@ -80,63 +144,39 @@ bool DrawView::save()
 bool DrawView::saveAs()
 {
     QString fileName = QFileDialog::getSaveFileName(this, tr("Save As"),
-                                                    curFile);
+                                                    curFile,
+                                                    tr("Drawings (*.xml);;Binary drawings (*.qdrw)"));
     if (fileName.isEmpty())
         return false;
 
-    return saveFile(fileName);
+    // a new file, or the same one rewritten without its journal
+    return saveFile(fileName,true);
 
 }
 
-bool DrawView::saveFile(const QString &fileName)
+bool DrawView::saveFile(const QString &fileName, bool compact)
 {
+    m_writer->write(m_document.saveSnapshot(fileName,compact),fileName);
+    setCurrentFile(fileName);
+    return true;
+}
 
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text)) {
+bool DrawView::recoverFile(const QString &fileName)
+{
+    if ( !m_document.load(fileName) ){
         QMessageBox::warning(this, tr("Qt Drawing"),
-                             tr("Cannot write file %1:\n%2.")
+                             tr("Cannot read file %1:\n%2.")
                              .arg(fileName)
-                             .arg(file.errorString()));
+                             .arg(m_document.errorString()));
         return false;
     }
-
-    QXmlStreamWriter xml(&file);
-    xml.setAutoFormatting(true);
-    xml.writeStartDocument();
-    xml.writeDTD("<!DOCTYPE qdraw>");
-    xml.writeStartElement("canvas");
-    xml.writeAttribute("width",QString("%1").arg(scene()->width()));
-    xml.writeAttribute("height",QString("%1").arg(scene()->height()));
-
-    foreach (QGraphicsItem *item , scene()->items()) {
-        AbstractShape * ab = qgraphicsitem_cast<AbstractShape*>(item);
-        QGraphicsItemGroup *g = dynamic_cast<QGraphicsItemGroup*>(item->parentItem());
-        if ( ab &&!qgraphicsitem_cast<SizeHandleRect*>(ab) && !g ){
-            ab->saveToXml(&xml);
-        }
-    }
-    xml.writeEndElement();
-    xml.writeEndDocument();
-#if 0
-    QSvgGenerator generator;
-    generator.setFileName(fileName);
-    generator.setSize(QSize(800, 600));
-    generator.setTitle(tr("SVG Generator Example Drawing"));
-    generator.setDescription(tr("An SVG drawing created by the SVG Generator "
-                                "Example provided with Qt."));
-//![configure SVG generator]
-//![begin painting]
-    QPainter painter;
-    painter.begin(&generator);
-//![begin painting]
-//!
-    scene()->clearSelection();
-    scene()->render(&painter);
-//![end painting]
-    painter.end();
-//![end painting]
-#endif
-    setCurrentFile(fileName);
+    // autosaves are named pid-id-drawing.qdrw
+    isUntitled = true;
+    curFile = QFileInfo(fileName).completeBaseName().section(QLatin1Char('-'),2);
+    setModified(true);
+    setWindowModified(true);
+    setWindowTitle(curFile + "[*]");
+    updateAutoSaveFile();
     return true;
 }
 
@@ -145,9 +185,110 @@ QString DrawView::userFriendlyCurrentFile()
     return strippedName(curFile);
 }
 
+QString DrawView::autoSaveDirectory()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("autosave");
+}
+
+// autosaves are named pid-id-drawing.qdrw, the lock of a program pid.lock
+static QString autoSaveLockFile( const QString & pid )
+{
+    return QDir(DrawView::autoSaveDirectory()).filePath(pid + ".lock");
+}
+
+bool DrawView::lockAutoSaves()
+{
+    static QLockFile * lock = 0;
+    if ( lock )
+        return true;
+    if ( !QDir().mkpath(autoSaveDirectory()) )
+        return false;
+    QLockFile * file = new QLockFile(autoSaveLockFile(QString::number(QCoreApplication::applicationPid())));
+    // a lock left by a crashed program of the same pid is taken over as stale
+    if ( !file->tryLock(0) ){
+        delete file;
+        return false;
+    }
+    lock = file;
+    return true;
+}
+
+bool DrawView::isAutoSaveOrphaned(const QString &fileName)
+{
+    const QString pid = QFileInfo(fileName).completeBaseName().section(QLatin1Char('-'),0,0);
+    if ( pid == QString::number(QCoreApplication::applicationPid()) )
+        return false;
+    // QLockFile takes over the locks of programs that no longer run
+    QLockFile lock(autoSaveLockFile(pid));
+    return lock.tryLock(0);
+}
+
+void DrawView::autoSave()
+{
+    if ( !isModified() || m_loading || m_revision == m_autoSavedRevision || m_writer->isBusy() )
+        return;
+    if ( !lockAutoSaves() )
+        return;
+    m_autoSavedRevision = m_revision;
+    m_writer->write(m_document.snapshot(),m_autoSaveFile);
+}
+
+void DrawView::saveFinished(const QString &fileName, bool ok, const QString &error)
+{
+    // a failed autosave is tried again with the next change
+    if ( fileName.startsWith(autoSaveDirectory()) ){
+        if ( !ok )
+            m_autoSavedRevision = 0;
+        return;
+    }
+    if ( !ok ){
+        // the journal may not match the file any more
+        m_document.resetJournal(QString());
+        m_saveFailed = true;
+        setModified(true);
+        setWindowModified(true);
+        QMessageBox::warning(this, tr("Qt Drawing"),
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(fileName)
+                             .arg(error));
+        return;
+    }
+    // nothing left to recover once the drawing is saved
+    if ( !isModified() )
+        m_writer->remove(m_autoSaveFile);
+}
+
+bool DrawView::finishSaving()
+{
+    m_saveFailed = false;
+    if ( m_writer->isBusy() ){
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        m_writer->waitForDone();
+        QApplication::restoreOverrideCursor();
+    }
+    // delivers the results of the writes while the view is still there
+    QCoreApplication::sendPostedEvents(this,QEvent::MetaCall);
+    return !m_saveFailed;
+}
+
+void DrawView::updateAutoSaveFile()
+{
+    const QString fileName = QDir(autoSaveDirectory()).filePath(
+                QString("%1-%2-%3.qdrw").arg(QCoreApplication::applicationPid())
+                .arg(m_autoSaveId).arg(strippedName(curFile)));
+    if ( fileName == m_autoSaveFile )
+        return;
+    if ( !m_autoSaveFile.isEmpty() )
+        m_writer->remove(m_autoSaveFile);
+    m_autoSaveFile = fileName;
+    m_autoSavedRevision = 0;
+}
+
 void DrawView::closeEvent(QCloseEvent *event)
 {
-    if (maybeSave()) {
+    if (maybeSave() && finishSaving()) {
+        // closed on purpose, nothing to recover
+        m_writer->remove(m_autoSaveFile);
         event->accept();
     } else {
         event->ignore();
@@ -160,9 +301,268 @@ void DrawView::mouseMoveEvent(QMouseEvent *event)
     m_hruler->updatePosition(event->pos());
     m_vruler->updatePosition(event->pos());
     emit positionChanged( pt.x() , pt.y() );
+
+    QGraphicsItem * hoverItem = NULL;
+    int hoverHandle = Handle_None;
+    DrawScene * drawScene = dynamic_cast<DrawScene*>(scene());
+    if ( drawScene ){
+        // only the selected shapes near the pointer can have a handle under it
+        const QSizeF size = SelectionHandle::sceneSize(transform());
+        const QRectF near(pt.x() - size.width() / 2,pt.y() - size.height() / 2,
+                          size.width(),size.height());
+        foreach (QGraphicsItem *item , drawScene->selectedShapesIn(near)) {
+            hoverHandle = handleAt(item,pt,transform());
+            if ( hoverHandle != Handle_None ){
+                hoverItem = item;
+                break;
+            }
+        }
+    }
+    if ( hoverItem != m_hoverItem || hoverHandle != m_hoverHandle ){
+        const int margin = SELECTION_HANDLE_SIZE;
+        QRect rc(event->pos() - QPoint(margin,margin),QSize(margin * 2,margin * 2));
+        viewport()->update(m_hoverRect);
+        viewport()->update(rc);
+        m_hoverRect = hoverItem ? rc : QRect();
+        m_hoverItem = hoverItem;
+        m_hoverHandle = hoverHandle;
+    }
     QGraphicsView::mouseMoveEvent(event);
 }
 
+void DrawView::drawForeground(QPainter *painter, const QRectF &rect)
+{
+    QGraphicsView::drawForeground(painter,rect);
+    DrawScene * drawScene = dynamic_cast<DrawScene*>(scene());
+    if ( !drawScene ) return;
+
+    const QTransform trans = viewportTransform();
+    const QRectF exposed = trans.mapRect(rect);
+    const qreal half = SELECTION_HANDLE_SIZE / 2;
+
+    QVector<QRectF> rects;
+    QVector<QRectF> controls;
+    QRectF hover;
+    // handles overlapping the exposed rect belong to shapes whose bounds do
+    const QSizeF size = SelectionHandle::sceneSize(transform());
+    const QRectF area = rect.adjusted(-size.width(),-size.height(),size.width(),size.height());
+    foreach (QGraphicsItem *item , drawScene->selectedShapesIn(area)) {
+        const AbstractShape::Handles * handles = shapeHandles(item);
+        if ( !handles ) continue;
+        const QTransform itemTrans = item->sceneTransform() * trans;
+        const QRectF bounds = itemTrans.mapRect(item->boundingRect());
+        if ( qMax(bounds.width(),bounds.height()) < HandlePixels )
+            continue;
+        AbstractShape::Handles::const_iterator it = handles->begin();
+        for ( ; it != handles->end() ; ++it ){
+            const QPointF pt = itemTrans.map(it->pos());
+            const QRectF rc(pt.x() - half, pt.y() - half,
+                            SELECTION_HANDLE_SIZE, SELECTION_HANDLE_SIZE);
+            if ( !exposed.intersects(rc) )
+                continue;
+            if ( it->isControlPoint() )
+                controls.append(rc);
+            else if ( item == m_hoverItem && it->dir() == m_hoverHandle )
+                hover = rc;
+            else
+                rects.append(rc);
+        }
+    }
+
+    const QPainterPath preview = drawScene->dragPreview();
+    if ( !preview.isEmpty() ){
+        painter->save();
+        QPen pen(Qt::DashLine);
+        pen.setCosmetic(true);
+        painter->setPen(pen);
+        painter->setBrush(Qt::NoBrush);
+        painter->setTransform(drawScene->dragPreviewTransform(),true);
+        painter->drawPath(preview);
+        painter->restore();
+    }
+
+    const QVector<QLineF> guides = drawScene->guides();
+    if ( !guides.isEmpty() ){
+        painter->save();
+        QPen pen(Qt::magenta);
+        pen.setCosmetic(true);
+        painter->setPen(pen);
+        painter->drawLines(guides);
+        painter->restore();
+    }
+
+    painter->save();
+    painter->resetTransform();
+    SelectionHandle::paint(painter,rects,controls,hover);
+    painter->restore();
+}
+
+void DrawView::updateHandles(const QList<QRectF> &region)
+{
+    const int margin = SELECTION_HANDLE_SIZE;
+    foreach (const QRectF & rc, region) {
+        viewport()->update(mapFromScene(rc).boundingRect().adjusted(-margin,-margin,margin,margin));
+    }
+}
+
+void DrawView::invalidateTiles(const QList<QRectF> &region)
+{
+    if ( region.isEmpty() )
+        return;
+    foreach (const QRectF & rc, region) {
+        m_tiles.invalidate(rc);
+    }
+    cancelTiles();
+}
+
+void DrawView::clearTiles()
+{
+    m_tiles.clear();
+    cancelTiles();
+    viewport()->update();
+}
+
+void DrawView::cancelTiles()
+{
+    ++m_generation;
+    if ( !m_pendingTiles.isEmpty() ){
+        m_renderer->cancel();
+        m_pendingTiles.clear();
+    }
+}
+
+void DrawView::tileRendered(const QImage &image, const QTransform &trans, int x, int y, quint64 generation)
+{
+    m_pendingTiles.remove(TileKey(TileCache::levelOf(trans),x,y));
+    if ( generation != m_generation )
+        return;
+    m_tiles.insert(trans,x,y,QPixmap::fromImage(image));
+    if ( TileCache::levelOf(trans) == TileCache::levelOf(transform()) )
+        viewport()->update(TileCache::tileRect(x,y).translated(tileOffset()));
+}
+
+QPoint DrawView::tileOffset() const
+{
+    const QTransform trans = transform();
+    const QTransform viewTrans = viewportTransform();
+    return QPoint(qRound(viewTrans.dx() - trans.dx()),qRound(viewTrans.dy() - trans.dy()));
+}
+
+QColor DrawView::tileBackground() const
+{
+    return viewport()->palette().color(viewport()->backgroundRole());
+}
+
+// only the shapes of the tiles asked for are copied, a scroll to tiles
+// outside the snapshot takes a new one
+bool DrawView::updateSnapshot(const QRectF &area)
+{
+    // a scene that cannot be copied is not tried again before it changes
+    if ( m_snapshotGeneration != m_generation || (m_snapshot && !m_snapshot->covers(area)) ){
+        m_snapshot = SceneSnapshot::create(scene(),area);
+        m_snapshotGeneration = m_generation;
+    }
+    return !m_snapshot.isNull();
+}
+
+void DrawView::requestTile(const QTransform &trans, int x, int y)
+{
+    const TileKey key(TileCache::levelOf(trans),x,y);
+    if ( m_pendingTiles.contains(key) )
+        return;
+    m_pendingTiles.insert(key);
+    m_renderer->request(m_snapshot,trans,x,y,m_generation,tileBackground());
+}
+
+// the scene is painted from cached tiles, only tiles touched by a change
+// are rendered again. scrolling and partial updates just blit pixmaps.
+void DrawView::paintEvent(QPaintEvent *event)
+{
+    const QTransform trans = transform();
+    if ( !scene() || trans.isRotating() ){
+        QGraphicsView::paintEvent(event);
+        return;
+    }
+
+    const QTransform viewTrans = viewportTransform();
+    const QPoint offset = tileOffset();
+
+    QPainter painter(viewport());
+    painter.setClipRegion(event->region());
+
+    QList<QPoint> missing;
+    const QRect range = TileCache::tileRange(event->rect().translated(-offset));
+    for ( int y = range.top() ; y <= range.bottom() ; ++y ){
+        for ( int x = range.left() ; x <= range.right() ; ++x ){
+            const QRect target = TileCache::tileRect(x,y).translated(offset);
+            if ( !event->region().intersects(target) )
+                continue;
+            QPixmap * tile = m_tiles.tile(trans,x,y);
+            if ( tile )
+                painter.drawPixmap(target.topLeft(),*tile);
+            else
+                missing.append(QPoint(x,y));
+        }
+    }
+
+    // a few tiles after an edit are cheaper to paint right away than to
+    // copy their shapes for the workers
+    QRectF area;
+    if ( missing.size() > SyncTiles ){
+        const QTransform inverted = trans.inverted();
+        foreach (const QPoint & pt, missing) {
+            area |= inverted.mapRect(QRectF(TileCache::tileRect(pt.x(),pt.y())));
+        }
+    }
+    if ( missing.size() > SyncTiles && !m_loading && updateSnapshot(area) ){
+        foreach (const QPoint & pt, missing) {
+            painter.fillRect(TileCache::tileRect(pt.x(),pt.y()).translated(offset),tileBackground());
+            requestTile(trans,pt.x(),pt.y());
+        }
+    }else{
+        foreach (const QPoint & pt, missing) {
+            const QPixmap rendered = renderTile(trans,pt.x(),pt.y());
+            m_tiles.insert(trans,pt.x(),pt.y(),rendered);
+            painter.drawPixmap(TileCache::tileRect(pt.x(),pt.y()).translated(offset).topLeft(),rendered);
+        }
+    }
+
+    painter.setRenderHints(renderHints());
+    painter.setWorldTransform(viewTrans);
+    drawForeground(&painter,mapToScene(event->rect()).boundingRect());
+
+    // the select tool keeps its band in the scene
+    QRect band = rubberBandRect();
+    DrawScene * drawScene = dynamic_cast<DrawScene*>(scene());
+    if ( band.isEmpty() && drawScene && !drawScene->selectionBand().isNull() )
+        band = viewTrans.mapRect(drawScene->selectionBand()).toAlignedRect();
+    if ( !band.isEmpty() ){
+        painter.resetTransform();
+        QStyleOptionRubberBand option;
+        option.initFrom(viewport());
+        option.rect = band;
+        option.shape = QRubberBand::Rectangle;
+        QStyleHintReturnMask mask;
+        if ( viewport()->style()->styleHint(QStyle::SH_RubberBand_Mask,&option,viewport(),&mask) )
+            painter.setClipRegion(mask.region,Qt::IntersectClip);
+        viewport()->style()->drawControl(QStyle::CE_RubberBand,&option,&painter,viewport());
+    }
+}
+
+QPixmap DrawView::renderTile(const QTransform &trans, int x, int y)
+{
+    const QRect rect = TileCache::tileRect(x,y);
+    QPixmap tile(rect.size());
+    tile.fill(viewport()->palette().color(viewport()->backgroundRole()));
+
+    QPainter painter(&tile);
+    painter.setRenderHints(renderHints());
+    painter.setWorldTransform(trans * QTransform::fromTranslate(-rect.left(),-rect.top()));
+    const QRectF source = trans.inverted().mapRect(QRectF(rect));
+    scene()->render(&painter,source,source,Qt::IgnoreAspectRatio);
+    return tile;
+}
+
 void DrawView::resizeEvent(QResizeEvent *event)
 {
     QGraphicsView::resizeEvent(event);
@@ -224,11 +624,14 @@ bool DrawView::maybeSave()
 
 void DrawView::setCurrentFile(const QString &fileName)
 {
-    curFile = QFileInfo(fileName).canonicalFilePath();
+    // a file saved in the background may not exist yet
+    const QFileInfo info(fileName);
+    curFile = info.exists() ? info.canonicalFilePath() : info.absoluteFilePath();
     isUntitled = false;
     setModified(false);
     setWindowModified(false);
     setWindowTitle(userFriendlyCurrentFile() + "[*]");
+    updateAutoSaveFile();
 }
 
 QString DrawView::strippedName(const QString &fullFileName)
@@ -237,79 +640,154 @@ QString DrawView::strippedName(const QString &fullFileName)
 
 }
 
-void DrawView::loadCanvas( QXmlStreamReader *xml)
-{
-    Q_ASSERT(xml->isStartElement() && xml->name() == "canvas");
-
-    while (xml->readNextStartElement()) {
-        AbstractShape * item = NULL;
-        if (xml->name() == tr("rect")){
-            item = new GraphicsRectItem(QRect(0,0,1,1));
-        }else if (xml->name() == tr("roundrect")){
-            item = new GraphicsRectItem(QRect(0,0,1,1),true);
-        }else if (xml->name() == tr("ellipse"))
-            item = new GraphicsEllipseItem(QRect(0,0,1,1));
-        else if (xml->name()==tr("polygon"))
-            item = new GraphicsPolygonItem();
-        else if ( xml->name()==tr("bezier"))
-            item = new GraphicsBezier();
-        else if ( xml->name() == tr("polyline"))
-            item = new GraphicsBezier(false);
-        else if ( xml->name() == tr("line"))
-            item = new GraphicsLineItem();
-        else if ( xml->name() == tr("group"))
-            item =qgraphicsitem_cast<AbstractShape*>(loadGroupFromXML(xml));
-        else
-            xml->skipCurrentElement();
-
-        if (item && item->loadFromXml(xml))
-            scene()->addItem(item);
-        else if ( item )
-            delete item;
+bool DrawView::startLoading(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        QMessageBox::warning(this, tr("Qt Drawing"),
+                             tr("Cannot read file %1:\n%2.")
+                             .arg(fileName)
+                             .arg(file.errorString()));
+        return false;
     }
+    file.close();
+
+    m_loadBatches.clear();
+    m_loadMarks.clear();
+    m_loadOffset = 0;
+    m_loadError.clear();
+    m_loading = true;
+    m_loadDone = m_loadOk = false;
+
+    m_loadThread = new QThread(this);
+    m_loader = new DocumentLoader(fileName);
+    m_loader->moveToThread(m_loadThread);
+    connect(m_loadThread,SIGNAL(started()),m_loader,SLOT(load()));
+    connect(m_loader,SIGNAL(started(QSizeF,QVector<int>)),this,SLOT(loadStarted(QSizeF,QVector<int>)));
+    connect(m_loader,SIGNAL(batchReady(QByteArray,int)),this,SLOT(loadBatch(QByteArray,int)));
+    connect(m_loader,SIGNAL(finished(bool,QString)),this,SLOT(loadDone(bool,QString)));
+
+    m_loadProgress = new QProgressDialog(tr("Loading %1").arg(strippedName(fileName)),
+                                         tr("Cancel"),0,100,this);
+    m_loadProgress->setWindowModality(Qt::NonModal);
+    m_loadProgress->setMinimumDuration(500);
+    m_loadProgress->setAutoClose(false);
+    m_loadProgress->setAutoReset(false);
+    m_loadProgress->setValue(0);
+    connect(m_loadProgress,SIGNAL(canceled()),this,SLOT(cancelLoading()));
+
+    setCurrentFile(fileName);
+    // the batches go in with the item index off, see finishLoading
+    m_document.scene()->beginBulkInsert();
+    m_loadThread->start();
+    return true;
 }
 
-GraphicsItemGroup *DrawView::loadGroupFromXML(QXmlStreamReader *xml)
+void DrawView::loadStarted(const QSizeF &size, const QVector<int> &kinds)
 {
-    QList<QGraphicsItem*> items;
-    qreal angle = xml->attributes().value(tr("rotate")).toDouble();
-    while (xml->readNextStartElement()) {
-        AbstractShape * item = NULL;
-        if (xml->name() == tr("rect")){
-            item = new GraphicsRectItem(QRect(0,0,1,1));
-        }else if (xml->name() == tr("roundrect")){
-            item = new GraphicsRectItem(QRect(0,0,1,1),true);
-        }else if (xml->name() == tr("ellipse"))
-            item = new GraphicsEllipseItem(QRect(0,0,1,1));
-        else if (xml->name()==tr("polygon"))
-            item = new GraphicsPolygonItem();
-        else if ( xml->name()==tr("bezier"))
-            item = new GraphicsBezier();
-        else if ( xml->name() == tr("polyline"))
-            item = new GraphicsBezier(false);
-        else if ( xml->name() == tr("line"))
-            item = new GraphicsLineItem();
-        else if ( xml->name() == tr("group"))
-            item =qgraphicsitem_cast<AbstractShape*>(loadGroupFromXML(xml));
-        else
-            xml->skipCurrentElement();
-        if (item && item->loadFromXml(xml)){
-            scene()->addItem(item);
-            items.append(item);
-        }else if ( item )
-            delete item;
+    scene()->setSceneRect(QRectF(QPointF(0,0),size));
+    m_loadKinds = kinds;
+}
+
+void DrawView::loadBatch(const QByteArray &records, int progress)
+{
+    if ( !m_loader || m_loader->isCanceled() )
+        return;
+    m_loadBatches.append(records);
+    m_loadMarks.append(progress);
+    scheduleLoadBatches();
+}
+
+void DrawView::loadDone(bool ok, const QString &error)
+{
+    m_loadThread->quit();
+    m_loadThread->wait();
+    m_loadJournal = m_loader->hasJournal();
+    m_loadRecords = m_loader->recordCount();
+    delete m_loader;
+    m_loader = NULL;
+    m_loadThread->deleteLater();
+    m_loadThread = NULL;
+
+    m_loadDone = true;
+    m_loadOk = ok;
+    m_loadError = error;
+    if ( m_loadBatches.isEmpty() )
+        finishLoading();
+}
+
+void DrawView::cancelLoading()
+{
+    if ( m_loader )
+        m_loader->cancel();
+    m_loadBatches.clear();
+    m_loadMarks.clear();
+    m_loadOffset = 0;
+    if ( m_loadDone ){
+        m_loadOk = false;
+        m_loadError = tr("Loading canceled");
+        finishLoading();
     }
+}
+
+void DrawView::scheduleLoadBatches()
+{
+    if ( m_loadScheduled )
+        return;
+    m_loadScheduled = true;
+    QTimer::singleShot(0,this,SLOT(processLoadBatches()));
+}
 
-    if ( items.count() > 0 ){
-        DrawScene * s = dynamic_cast<DrawScene*>(scene());
-        GraphicsItemGroup * group = s->createGroup(items,false);
-        if (group){
-            group->setRotation(angle);
-            group->updateCoordinate();
-            //qDebug()<<"angle:" <<angle;
+void DrawView::processLoadBatches()
+{
+    m_loadScheduled = false;
+    QElapsedTimer timer;
+    timer.start();
+
+    // add items for a short slice only so that painting and input keep going
+    QList<QGraphicsItem*> items;
+    while ( !m_loadBatches.isEmpty() && timer.elapsed() < LoadTimeSlice ) {
+        QBuffer buffer(&m_loadBatches.first());
+        buffer.open(QIODevice::ReadOnly);
+        buffer.seek(m_loadOffset);
+        QDataStream stream(&buffer);
+        DocumentLoader::setupBinaryStream(stream);
+        while ( !stream.atEnd() && stream.status() == QDataStream::Ok &&
+                timer.elapsed() < LoadTimeSlice ) {
+            AbstractShape * item = m_document.loadShapeFromBinary(&stream,m_loadKinds);
+            if ( item )
+                items.append(item);
         }
-        return group;
+        if ( stream.atEnd() || stream.status() != QDataStream::Ok ){
+            m_loadBatches.removeFirst();
+            if ( m_loadProgress )
+                m_loadProgress->setValue(m_loadMarks.takeFirst());
+            m_loadOffset = 0;
+        }else
+            m_loadOffset = buffer.pos();
     }
-    return 0;
+    m_document.scene()->addItems(items);
+
+    if ( !m_loadBatches.isEmpty() )
+        scheduleLoadBatches();
+    else if ( m_loadDone )
+        finishLoading();
 }
 
+void DrawView::finishLoading()
+{
+    if ( !m_loading )
+        return;
+    m_loading = false;
+    m_document.scene()->endBulkInsert();
+    if ( m_loadProgress ){
+        m_loadProgress->deleteLater();
+        m_loadProgress = NULL;
+    }
+    // a partially loaded drawing must not overwrite the file on save
+    if ( !m_loadOk )
+        isUntitled = true;
+    // edits made while loading are not in the file
+    m_document.resetJournal(m_loadOk && !m_loadJournal && !isModified() ? curFile : QString(),m_loadRecords);
+    emit loadFinished(m_loadOk,m_loadError);
+}
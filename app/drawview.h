@@ -4,31 +4,73 @@
 
 #include "rulebar.h"
 #include "drawobj.h"
+#include "tilecache.h"
+#include "tilerenderer.h"
+#include "document.h"
+#include <QSet>
 
 class QMouseEvent;
+class QProgressDialog;
+class DocumentLoader;
+class QTimer;
 
 class DrawView : public QGraphicsView
 {
     Q_OBJECT
 public:
     DrawView(QGraphicsScene *scene);
+    ~DrawView();
     void zoomIn();
     void zoomOut();
 
     void newFile();
     bool loadFile(const QString &fileName);
+    // parses the file on a worker thread, the scene fills in while the view stays usable
+    bool startLoading(const QString &fileName);
+    bool isLoading() const { return m_loading; }
     bool save();
      bool saveAs();
-    bool saveFile(const QString &fileName);
+    // the shapes are copied here and written on a worker thread, failures
+    // are reported when the write is done
+    bool saveFile(const QString &fileName , bool compact = false);
+    // opens an autosave as an untitled, modified drawing
+    bool recoverFile(const QString &fileName);
     QString userFriendlyCurrentFile();
+    static QString autoSaveDirectory();
+    // a lock file per running program marks its autosaves as live, taken
+    // before the first autosave and held until the program exits
+    static bool lockAutoSaves();
+    // the program that wrote the autosave is gone, so it is left to recover
+    static bool isAutoSaveOrphaned(const QString &fileName);
 
     QString currentFile() { return curFile; }
-    void setModified( bool value ) { modified = value ; }
+    void setModified( bool value ) { modified = value ; if ( value ) ++m_revision; }
     bool isModified() const { return modified; }
 signals:
     void positionChanged(int x , int y );
+    void loadFinished(bool ok , const QString & error );
+protected slots:
+    void updateHandles(const QList<QRectF> & region );
+    void invalidateTiles(const QList<QRectF> & region );
+    void clearTiles();
+    void tileRendered(const QImage & image , const QTransform & trans , int x , int y , quint64 generation );
+    void loadStarted(const QSizeF & size , const QVector<int> & kinds );
+    void loadBatch(const QByteArray & records , int progress );
+    void loadDone(bool ok , const QString & error );
+    void processLoadBatches();
+    void cancelLoading();
+    void autoSave();
+    void saveFinished(const QString & fileName , bool ok , const QString & error );
 protected:
     void closeEvent(QCloseEvent *event) Q_DECL_OVERRIDE;
+    void drawForeground(QPainter *painter, const QRectF &rect) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    QPixmap renderTile(const QTransform & trans , int x , int y );
+    QPoint tileOffset() const;
+    QColor tileBackground() const;
+    bool updateSnapshot(const QRectF & area );
+    void requestTile(const QTransform & trans , int x , int y );
+    void cancelTiles();
 
     void mouseMoveEvent(QMouseEvent * event) Q_DECL_OVERRIDE;
     void resizeEvent(QResizeEvent *event) Q_DECL_OVERRIDE;
@@ -37,17 +79,55 @@ protected:
     QtRuleBar *m_hruler;
     QtRuleBar *m_vruler;
     QtCornerBox * box;
+    QGraphicsItem * m_hoverItem;
+    int m_hoverHandle;
+    QRect m_hoverRect;
+    TileCache m_tiles;
+    TileRenderer * m_renderer;
+    SceneSnapshotPtr m_snapshot;
+    // bumped on every scene change, results of older requests are dropped
+    quint64 m_generation;
+    quint64 m_snapshotGeneration;
+    QSet<TileKey> m_pendingTiles;
 
 private:
     bool maybeSave();
     void setCurrentFile(const QString &fileName);
     QString strippedName(const QString &fullFileName);
-    void loadCanvas( QXmlStreamReader *xml );
-    GraphicsItemGroup * loadGroupFromXML( QXmlStreamReader * xml );
+    void scheduleLoadBatches();
+    void finishLoading();
+    bool finishSaving();
+    void updateAutoSaveFile();
 
+    Document m_document;
     QString curFile;
     bool isUntitled;
     bool modified;
+
+    // background saving, autosaves go to a file of their own while modified
+    DocumentWriter * m_writer;
+    QTimer * m_autoSaveTimer;
+    QString m_autoSaveFile;
+    int m_autoSaveId;
+    quint64 m_revision;
+    quint64 m_autoSavedRevision;
+    bool m_saveFailed;
+
+    // background loading
+    QThread * m_loadThread;
+    DocumentLoader * m_loader;
+    QProgressDialog * m_loadProgress;
+    QList<QByteArray> m_loadBatches;
+    QList<int> m_loadMarks;
+    QVector<int> m_loadKinds;
+    qint64 m_loadOffset;
+    QString m_loadError;
+    bool m_loading;
+    bool m_loadDone;
+    bool m_loadOk;
+    bool m_loadScheduled;
+    bool m_loadJournal;
+    int m_loadRecords;
 };
 
 #endif // DRAWVIEW_H
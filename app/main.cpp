@@ -8,6 +8,8 @@ int main(int argc, char *argv[])
 
     Q_INIT_RESOURCE(app);
     QApplication a(argc, argv);
+    // names the directory of the autosaves
+    QCoreApplication::setApplicationName("qdraw");
 
     QTextCodec::setCodecForLocale(QTextCodec::codecForName("UTF-8"));
 
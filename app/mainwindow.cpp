@@ -6,14 +6,29 @@
 #include <QGraphicsItem>
 #include <QMdiSubWindow>
 #include <QUndoStack>
+#include <QLoggingCategory>
 #include "customproperty.h"
 #include "drawobj.h"
 #include "commands.h"
 
+// defaults of the undo history, the budget in MiB
+static const int UndoLimit = 1000;
+static const int UndoMemoryBudget = 64;
+
+// QT_LOGGING_RULES="qdraw.actions.debug=true" logs once a second how many
+// selection snapshots updateActions took, none while the window is idle
+Q_LOGGING_CATEGORY(lcActions,"qdraw.actions",QtWarningMsg)
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
-    undoStack = new QUndoStack(this);
+    undoStack = new UndoStack(this);
+    batchCommand = NULL;
+    // the limit bounds the steps, the budget the shapes deleted or replaced
+    // by them, the history keeps both alive
+    QSettings settings(QSettings::IniFormat,QSettings::UserScope,QCoreApplication::applicationName());
+    undoStack->setUndoLimit(settings.value("undo/limit",UndoLimit).toInt());
+    undoStack->setMemoryBudget(settings.value("undo/memoryBudget",UndoMemoryBudget).toLongLong() << 20);
     undoView = new QUndoView(undoStack);
     undoView->setWindowTitle(tr("Command List"));
     undoView->setAttribute(Qt::WA_QuitOnClose, false);
@@ -33,6 +48,12 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(mdiArea, SIGNAL(subWindowActivated(QMdiSubWindow*)),
             this, SLOT(updateMenus()));
+    connect(mdiArea, SIGNAL(subWindowActivated(QMdiSubWindow*)),
+            this, SLOT(updateActions()));
+    connect(undoStack, SIGNAL(canUndoChanged(bool)),
+            this, SLOT(updateActions()));
+    connect(undoStack, SIGNAL(canRedoChanged(bool)),
+            this, SLOT(updateActions()));
     windowMapper = new QSignalMapper(this);
     connect(windowMapper, SIGNAL(mapped(QWidget*)),
             this, SLOT(setActiveSubWindow(QWidget*)));
@@ -52,9 +73,15 @@ MainWindow::MainWindow(QWidget *parent)
     statusBar()->addWidget(m_posInfo);
 */
     connect(QApplication::clipboard(),SIGNAL(dataChanged()),this,SLOT(dataChanged()));
-    connect(&m_timer,SIGNAL(timeout()),this,SLOT(updateActions()));
-    m_timer.start(500);
+    QTimer::singleShot(0,this,SLOT(recoverAutoSaves()));
     theControlledObject = NULL;
+    m_selectionSnapshots = 0;
+    if ( lcActions().isDebugEnabled() ){
+        QTimer * trace = new QTimer(this);
+        connect(trace,SIGNAL(timeout()),this,SLOT(traceActions()));
+        trace->start(1000);
+    }
+    updateActions();
 
 }
 
@@ -405,6 +432,7 @@ void MainWindow::createPropertyEditor()
 
     propertyEditor = new ObjectController(this);
     dockProperty->setWidget(propertyEditor);
+    connect(propertyEditor,SIGNAL(objectChanged(QObject*)),this,SLOT(propertyChanged(QObject*)));
 }
 
 void MainWindow::updateMenus()
@@ -422,8 +450,8 @@ void MainWindow::updateMenus()
     previousAct->setEnabled(hasMdiChild);
     separatorAct->setVisible(hasMdiChild);
 
-    bool hasSelection = (activeMdiChild() &&
-                         activeMdiChild()->scene()->selectedItems().count()>0);
+    DrawScene * scene = activeMdiChild() ? dynamic_cast<DrawScene*>(activeMdiChild()->scene()) : NULL;
+    bool hasSelection = (scene && !scene->selectedShapes().isEmpty());
 
     cutAct->setEnabled(hasSelection);
     copyAct->setEnabled(hasSelection);
@@ -473,7 +501,8 @@ void MainWindow::newFile()
 
 void MainWindow::open()
 {
-    QString fileName = QFileDialog::getOpenFileName(this);
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open"), QString(),
+                                                    tr("Drawings (*.xml *.qdrw);;All files (*)"));
     if (!fileName.isEmpty()) {
         QMdiSubWindow *existing = findMdiChild(fileName);
         if (existing) {
@@ -482,14 +511,15 @@ void MainWindow::open()
         }
 
         if (openFile(fileName))
-            statusBar()->showMessage(tr("File loaded"), 2000);
+            statusBar()->showMessage(tr("Loading %1").arg(QFileInfo(fileName).fileName()));
     }
 }
 
 bool MainWindow::openFile(const QString &fileName)
 {
     DrawView *child = createMdiChild();
-    const bool succeeded = child->loadFile(fileName);
+    connect(child,SIGNAL(loadFinished(bool,QString)),this,SLOT(loadFinished(bool,QString)));
+    const bool succeeded = child->startLoading(fileName);
     if (succeeded)
         child->show();
     else
@@ -497,12 +527,55 @@ bool MainWindow::openFile(const QString &fileName)
     return succeeded;
 }
 
+void MainWindow::loadFinished(bool ok, const QString &error)
+{
+    if ( ok )
+        statusBar()->showMessage(tr("File loaded"), 2000);
+    else
+        statusBar()->showMessage(error, 5000);
+}
+
 void MainWindow::save()
 {
     if (activeMdiChild() && activeMdiChild()->save())
         statusBar()->showMessage(tr("File saved"), 2000);
 }
 
+void MainWindow::recoverAutoSaves()
+{
+    // the autosaves of other programs still running are theirs
+    DrawView::lockAutoSaves();
+    // newest first, one autosave per drawing
+    QFileInfoList files;
+    foreach (const QFileInfo & file, QDir(DrawView::autoSaveDirectory()).entryInfoList(
+                 QStringList() << "*.qdrw",QDir::Files,QDir::Time)) {
+        if ( DrawView::isAutoSaveOrphaned(file.filePath()) )
+            files.append(file);
+    }
+    if ( files.isEmpty() )
+        return;
+
+    const QMessageBox::StandardButton ret =
+            QMessageBox::question(this, tr("Qt Drawing"),
+                                  tr("%n drawing(s) were not saved when the program last closed.\n"
+                                     "Do you want to recover them? Discarded drawings are deleted, "
+                                     "the others are offered again at the next start.","",files.size()),
+                                  QMessageBox::Yes | QMessageBox::Discard | QMessageBox::Cancel);
+    if ( ret != QMessageBox::Yes && ret != QMessageBox::Discard )
+        return;
+    foreach (const QFileInfo & file, files) {
+        if ( ret == QMessageBox::Yes ){
+            DrawView *child = createMdiChild();
+            if ( child->recoverFile(file.filePath()) )
+                child->show();
+            else
+                child->close();
+        }
+        // the recovered drawings autosave under names of their own
+        QFile::remove(file.filePath());
+    }
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     mdiArea->closeAllSubWindows();
@@ -525,6 +598,10 @@ DrawView *MainWindow::createMdiChild()
 
     connect(scene, SIGNAL(selectionChanged()),
             this, SLOT(itemSelected()));
+    connect(scene, SIGNAL(selectionChanged()),
+            this, SLOT(updateActions()));
+    connect(scene, SIGNAL(toolChanged()),
+            this, SLOT(updateActions()));
 
     connect(scene,SIGNAL(itemAdded(QGraphicsItem*)),
             this, SLOT(itemAdded(QGraphicsItem*)));
@@ -532,6 +609,8 @@ DrawView *MainWindow::createMdiChild()
             this,SLOT(itemMoved(QGraphicsItem*,QPointF)));
     connect(scene,SIGNAL(itemRotate(QGraphicsItem*,qreal)),
             this,SLOT(itemRotate(QGraphicsItem*,qreal)));
+    connect(scene,SIGNAL(itemsRotate(QList<QGraphicsItem*>,QPointF,qreal)),
+            this,SLOT(itemsRotate(QList<QGraphicsItem*>,QPointF,qreal)));
 
     connect(scene,SIGNAL(itemResize(QGraphicsItem* , int , const QPointF&)),
             this,SLOT(itemResize(QGraphicsItem*,int,QPointF)));
@@ -564,36 +643,50 @@ DrawView *MainWindow::createMdiChild()
 
 void MainWindow::addShape()
 {
+    if (!activeMdiChild()) return ;
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
+    // every document keeps its own tool
+    DrawShape shape = scene->drawShape();
     if ( sender() == selectAct )
-        DrawTool::c_drawShape = selection;
+        shape = selection;
     else if (sender() == lineAct )
-        DrawTool::c_drawShape = line;
+        shape = line;
     else if ( sender() == rectAct )
-        DrawTool::c_drawShape = rectangle;
+        shape = rectangle;
     else if ( sender() == roundRectAct )
-        DrawTool::c_drawShape = roundrect;
+        shape = roundrect;
     else if ( sender() == ellipseAct )
-        DrawTool::c_drawShape = ellipse ;
+        shape = ellipse ;
     else if ( sender() == polygonAct )
-        DrawTool::c_drawShape = polygon;
+        shape = polygon;
     else if ( sender() == bezierAct )
-        DrawTool::c_drawShape = bezier ;
+        shape = bezier ;
     else if (sender() == rotateAct )
-        DrawTool::c_drawShape = rotation;
+        shape = rotation;
     else if (sender() == polylineAct )
-        DrawTool::c_drawShape = polyline;
+        shape = polyline;
+
+    scene->setDrawShape(shape);
 
     if ( sender() != selectAct && sender() != rotateAct ){
-        activeMdiChild()->scene()->clearSelection();
+        scene->clearSelection();
     }
+    updateActions();
 }
 
 void MainWindow::updateActions()
 {
 
-     QGraphicsScene * scene = NULL;
+     DrawScene * scene = NULL;
     if (activeMdiChild())
-        scene = activeMdiChild()->scene();
+        scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
+    QList<QGraphicsItem*> items;
+    if ( scene ){
+        items = scene->selectedShapes();
+        ++m_selectionSnapshots;
+    }
+    const int nSelected = items.count();
+    const DrawShape shape = scene ? scene->drawShape() : selection;
 
     selectAct->setEnabled(scene);
     lineAct->setEnabled(scene);
@@ -608,52 +701,51 @@ void MainWindow::updateActions()
     zoomInAct->setEnabled(scene);
     zoomOutAct->setEnabled(scene);
 
-    selectAct->setChecked(DrawTool::c_drawShape == selection);
-    lineAct->setChecked(DrawTool::c_drawShape == line);
-    rectAct->setChecked(DrawTool::c_drawShape == rectangle);
-    roundRectAct->setChecked(DrawTool::c_drawShape == roundrect);
-    ellipseAct->setChecked(DrawTool::c_drawShape == ellipse);
-    bezierAct->setChecked(DrawTool::c_drawShape == bezier);
-    rotateAct->setChecked(DrawTool::c_drawShape == rotation);
-    polygonAct->setChecked(DrawTool::c_drawShape == polygon);
-    polylineAct->setChecked(DrawTool::c_drawShape == polyline );
+    selectAct->setChecked(shape == selection);
+    lineAct->setChecked(shape == line);
+    rectAct->setChecked(shape == rectangle);
+    roundRectAct->setChecked(shape == roundrect);
+    ellipseAct->setChecked(shape == ellipse);
+    bezierAct->setChecked(shape == bezier);
+    rotateAct->setChecked(shape == rotation);
+    polygonAct->setChecked(shape == polygon);
+    polylineAct->setChecked(shape == polyline );
     undoAct->setEnabled(undoStack->canUndo());
     redoAct->setEnabled(undoStack->canRedo());
 
 
-    bringToFrontAct->setEnabled(scene && scene->selectedItems().count() > 0);
-    sendToBackAct->setEnabled(scene && scene->selectedItems().count() > 0);
-    groupAct->setEnabled( scene && scene->selectedItems().count() > 0);
-    unGroupAct->setEnabled(scene &&scene->selectedItems().count() > 0 &&
-                              dynamic_cast<GraphicsItemGroup*>( scene->selectedItems().first()));
+    bringToFrontAct->setEnabled(nSelected > 0);
+    sendToBackAct->setEnabled(nSelected > 0);
+    groupAct->setEnabled(nSelected > 0);
+    unGroupAct->setEnabled(nSelected > 0 &&
+                              dynamic_cast<GraphicsItemGroup*>( items.first()));
 
-    leftAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    rightAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    leftAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    vCenterAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    hCenterAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    upAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    downAct->setEnabled(scene && scene->selectedItems().count() > 1);
+    leftAct->setEnabled(nSelected > 1);
+    rightAct->setEnabled(nSelected > 1);
+    vCenterAct->setEnabled(nSelected > 1);
+    hCenterAct->setEnabled(nSelected > 1);
+    upAct->setEnabled(nSelected > 1);
+    downAct->setEnabled(nSelected > 1);
 
-    heightAct->setEnabled(scene && scene->selectedItems().count() > 1);
-    widthAct->setEnabled(scene &&scene->selectedItems().count() > 1);
-    allAct->setEnabled(scene &&scene->selectedItems().count()>1);
-    horzAct->setEnabled(scene &&scene->selectedItems().count() > 2);
-    vertAct->setEnabled(scene &&scene->selectedItems().count() > 2);
+    heightAct->setEnabled(nSelected > 1);
+    widthAct->setEnabled(nSelected > 1);
+    allAct->setEnabled(nSelected > 1);
+    horzAct->setEnabled(nSelected > 2);
+    vertAct->setEnabled(nSelected > 2);
 
-    copyAct->setEnabled(scene &&scene->selectedItems().count() > 0);
-    cutAct->setEnabled(scene &&scene->selectedItems().count() > 0);
+    copyAct->setEnabled(nSelected > 0);
+    cutAct->setEnabled(nSelected > 0);
 }
 
 void MainWindow::itemSelected()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    if ( scene->selectedItems().count() > 0
-         && scene->selectedItems().first()->isSelected())
+    if ( scene->selectedShapes().count() > 0
+         && scene->selectedShapes().first()->isSelected())
     {
-        QGraphicsItem *item = scene->selectedItems().first();
+        QGraphicsItem *item = scene->selectedShapes().first();
 
         theControlledObject = dynamic_cast<QObject*>(item);
         propertyEditor->setObject(theControlledObject);
@@ -667,13 +759,29 @@ void MainWindow::itemSelected()
     }
 }
 
+// a width or height written to a shape in place changes no position or
+// transform, the scene would not see it for the next save
+void MainWindow::propertyChanged(QObject *object)
+{
+    QGraphicsItem * item = dynamic_cast<QGraphicsItem*>(object);
+    DrawScene * scene = item ? qobject_cast<DrawScene*>(item->scene()) : NULL;
+    if ( !scene )
+        return;
+    scene->markShapeChanged(item);
+    DrawView * view = qobject_cast<DrawView*>(scene->view());
+    if ( view )
+        view->setModified(true);
+}
+
 void MainWindow::itemMoved(QGraphicsItem *item, const QPointF &oldPosition)
 {
     Q_UNUSED(item);
     if (!activeMdiChild()) return ;
         activeMdiChild()->setModified(true);
 
-    if ( item ){
+    if ( batchCommand && item ){
+        batchCommand->addMove(item, oldPosition);
+    }else if ( item ){
         QUndoCommand *moveCommand = new MoveShapeCommand(item, oldPosition);
         undoStack->push(moveCommand);
     }else{
@@ -700,11 +808,28 @@ void MainWindow::itemRotate(QGraphicsItem *item, const qreal oldAngle)
     undoStack->push(rotateCommand);
 }
 
+// a turned selection is one undo step
+void MainWindow::itemsRotate(const QList<QGraphicsItem *> &items, const QPointF &center, qreal angle)
+{
+    if (!activeMdiChild()) return ;
+        activeMdiChild()->setModified(true);
+
+    BatchShapeCommand * command = new BatchShapeCommand(activeMdiChild()->scene(),tr("Rotate"));
+    foreach (QGraphicsItem *item, items) {
+        command->addRotate(item,center,angle);
+    }
+    undoStack->push(command);
+}
+
 void MainWindow::itemResize(QGraphicsItem *item, int handle, const QPointF& scale)
 {
     if (!activeMdiChild()) return ;
         activeMdiChild()->setModified(true);
 
+    if ( batchCommand ){
+        batchCommand->addResize(item, handle, scale);
+        return;
+    }
     QUndoCommand *resizeCommand = new ResizeShapeCommand(item ,handle, scale );
     undoStack->push(resizeCommand);
 }
@@ -722,10 +847,10 @@ void MainWindow::deleteItem()
 {
     qDebug()<<"deleteItem";
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
     activeMdiChild()->setModified(true);
 
-    if (scene->selectedItems().isEmpty())
+    if (scene->selectedShapes().isEmpty())
         return;
 
     QUndoCommand *deleteCommand = new RemoveShapeCommand(scene);
@@ -736,15 +861,15 @@ void MainWindow::deleteItem()
 void MainWindow::on_actionBringToFront_triggered()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    if (scene->selectedItems().isEmpty())
+    if (scene->selectedShapes().isEmpty())
         return;
     activeMdiChild()->setModified(true);
 
-    QGraphicsItem *selectedItem = scene->selectedItems().first();
+    QGraphicsItem *selectedItem = scene->selectedShapes().first();
 
-    QList<QGraphicsItem *> overlapItems = selectedItem->collidingItems();
+    QList<QGraphicsItem *> overlapItems = scene->collidingShapes(selectedItem);
     qreal zValue = 0;
     foreach (QGraphicsItem *item, overlapItems) {
         if (item->zValue() >= zValue && item->type() == GraphicsItem::Type)
@@ -757,15 +882,15 @@ void MainWindow::on_actionBringToFront_triggered()
 void MainWindow::on_actionSendToBack_triggered()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    if (scene->selectedItems().isEmpty())
+    if (scene->selectedShapes().isEmpty())
         return;
 
      activeMdiChild()->setModified(true);
 
-    QGraphicsItem *selectedItem = scene->selectedItems().first();
-    QList<QGraphicsItem *> overlapItems = selectedItem->collidingItems();
+    QGraphicsItem *selectedItem = scene->selectedShapes().first();
+    QList<QGraphicsItem *> overlapItems = scene->collidingShapes(selectedItem);
 
     qreal zValue = 0;
     foreach (QGraphicsItem *item, overlapItems) {
@@ -780,30 +905,44 @@ void MainWindow::on_aglin_triggered()
     if (!activeMdiChild()) return ;
     DrawScene * scene =dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    activeMdiChild()->setModified(true);
-
+    AlignType alignType;
     if ( sender() == rightAct ){
-        scene->align(RIGHT_ALIGN);
+        alignType = RIGHT_ALIGN;
     }else if ( sender() == leftAct){
-        scene->align(LEFT_ALIGN);
+        alignType = LEFT_ALIGN;
     }else if ( sender() == upAct ){
-        scene->align(UP_ALIGN);
+        alignType = UP_ALIGN;
     }else if ( sender() == downAct ){
-        scene->align(DOWN_ALIGN);
+        alignType = DOWN_ALIGN;
     }else if ( sender() == vCenterAct ){
-        scene->align(VERT_ALIGN);
+        alignType = VERT_ALIGN;
     }else if ( sender() == hCenterAct){
-        scene->align(HORZ_ALIGN);
+        alignType = HORZ_ALIGN;
     }else if ( sender() == heightAct )
-        scene->align(HEIGHT_ALIGN);
+        alignType = HEIGHT_ALIGN;
     else if ( sender()==widthAct )
-        scene->align(WIDTH_ALIGN);
+        alignType = WIDTH_ALIGN;
     else if ( sender() == horzAct )
-        scene->align(HORZEVEN_ALIGN);
+        alignType = HORZEVEN_ALIGN;
     else if ( sender() == vertAct )
-        scene->align(VERTEVEN_ALIGN);
+        alignType = VERTEVEN_ALIGN;
     else if ( sender () == allAct )
-        scene->align(ALL_ALIGN);
+        alignType = ALL_ALIGN;
+    else
+        return;
+
+    activeMdiChild()->setModified(true);
+
+    // every shape the scene moves or resizes goes into one undo step
+    const bool distribute = alignType == HORZEVEN_ALIGN || alignType == VERTEVEN_ALIGN;
+    batchCommand = new BatchShapeCommand(scene, distribute ? tr("Distribute") : tr("Align"));
+    scene->align(alignType);
+    BatchShapeCommand * command = batchCommand;
+    batchCommand = NULL;
+    if ( command->isEmpty() )
+        delete command;
+    else
+        undoStack->push(command);
 }
 
 void MainWindow::zoomIn()
@@ -824,7 +963,7 @@ void MainWindow::on_group_triggered()
     DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
     //QGraphicsItemGroup
-    QList<QGraphicsItem *> selectedItems = scene->selectedItems();
+    QList<QGraphicsItem *> selectedItems = scene->selectedShapes();
     // Create a new group at that level
     if ( selectedItems.count() < 1) return;
     GraphicsItemGroup *group = scene->createGroup(selectedItems);
@@ -835,9 +974,9 @@ void MainWindow::on_group_triggered()
 void MainWindow::on_unGroup_triggered()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    QGraphicsItem *selectedItem = scene->selectedItems().first();
+    QGraphicsItem *selectedItem = scene->selectedShapes().first();
     GraphicsItemGroup * group = dynamic_cast<GraphicsItemGroup*>(selectedItem);
     if ( group ){
         QUndoCommand *unGroupCommand = new UnGroupShapeCommand(group,scene);
@@ -875,41 +1014,51 @@ void MainWindow::on_func_test_triggered()
 void MainWindow::on_copy()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
-    ShapeMimeData * data = new ShapeMimeData( scene->selectedItems() );
+    ShapeMimeData * data = new ShapeMimeData( scene->selectedShapes() );
     QApplication::clipboard()->setMimeData(data);
 }
 
 void MainWindow::on_paste()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
     QMimeData * mp = const_cast<QMimeData *>(QApplication::clipboard()->mimeData()) ;
     ShapeMimeData * data = dynamic_cast< ShapeMimeData*>( mp );
     if ( data ){
         scene->clearSelection();
+        QList<QGraphicsItem *> copies;
         foreach (QGraphicsItem * item , data->items() ) {
             AbstractShape *sp = qgraphicsitem_cast<AbstractShape*>(item);
             QGraphicsItem * copy = sp->duplicate();
             if ( copy ){
                 copy->setSelected(true);
                 copy->moveBy(10,10);
-                QUndoCommand *addCommand = new AddShapeCommand(copy, scene);
-                undoStack->push(addCommand);
+                copies.append(copy);
             }
         }
+        // the command finds its items already in the scene
+        scene->addItems(copies);
+        if ( copies.isEmpty() )
+            return;
+        BatchShapeCommand *pasteCommand = new BatchShapeCommand(scene, tr("Paste"));
+        foreach (QGraphicsItem * copy , copies) {
+            pasteCommand->addShape(copy);
+        }
+        undoStack->push(pasteCommand);
+        activeMdiChild()->setModified(true);
     }
 }
 
 void MainWindow::on_cut()
 {
     if (!activeMdiChild()) return ;
-    QGraphicsScene * scene = activeMdiChild()->scene();
+    DrawScene * scene = dynamic_cast<DrawScene*>(activeMdiChild()->scene());
 
     QList<QGraphicsItem *> copylist ;
-    foreach (QGraphicsItem *item , scene->selectedItems()) {
+    foreach (QGraphicsItem *item , scene->selectedShapes()) {
         AbstractShape *sp = qgraphicsitem_cast<AbstractShape*>(item);
         QGraphicsItem * copy = sp->duplicate();
         if ( copy )
@@ -928,6 +1077,12 @@ void MainWindow::dataChanged()
     pasteAct->setEnabled(true);
 }
 
+void MainWindow::traceActions()
+{
+    qCDebug(lcActions) << "selection snapshots per second:" << m_selectionSnapshots;
+    m_selectionSnapshots = 0;
+}
+
 void MainWindow::positionChanged(int x, int y)
 {
    char buf[255];
@@ -5,7 +5,6 @@
 #include <QMap>
 #include <QGraphicsView>
 #include <QGraphicsScene>
-#include <QTimer>
 #include "drawscene.h"
 #include "objectcontroller.h"
 #include "drawview.h"
@@ -35,6 +34,8 @@ QT_END_NAMESPACE
 
 class QtVariantProperty;
 class QtProperty;
+class UndoStack;
+class BatchShapeCommand;
 
 class MainWindow : public QMainWindow
 {
@@ -50,7 +51,10 @@ public slots:
 
     void newFile();
     void open();
+    void loadFinished(bool ok , const QString & error );
     void save();
+    // offers the autosaves a crashed session left behind
+    void recoverAutoSaves();
     DrawView *createMdiChild();
     void updateMenus();
     void updateWindowMenu();
@@ -60,9 +64,11 @@ public slots:
     void updateActions();
     void deleteItem();
     void itemSelected();
+    void propertyChanged(QObject * object );
     void itemMoved(QGraphicsItem * item , const QPointF & oldPosition );
     void itemAdded(QGraphicsItem * item );
     void itemRotate(QGraphicsItem * item , const qreal oldAngle );
+    void itemsRotate(const QList<QGraphicsItem *> & items , const QPointF & center , qreal angle );
     void itemResize(QGraphicsItem * item , int handle , const QPointF& scale );
     void itemControl(QGraphicsItem * item , int handle , const QPointF & newPos , const QPointF& lastPos_ );
 
@@ -79,6 +85,7 @@ public slots:
     void on_cut();
     void dataChanged();
     void positionChanged(int x, int y );
+    void traceActions();
 
     void about();
 protected:
@@ -100,8 +107,6 @@ private:
     QMdiArea *mdiArea;
     QSignalMapper *windowMapper;
 
-    // update ui
-    QTimer      m_timer;
     // toolbox
     QToolBox *toolBox;
     // edit toolbar;
@@ -172,10 +177,14 @@ private:
 
     QListWidget    *listView;
 
-    QUndoStack *undoStack;
+    UndoStack *undoStack;
+    // collects the edits the scene reports during an align
+    BatchShapeCommand *batchCommand;
     QUndoView *undoView;
     // statusbar label
     QLabel *m_posInfo;
+    // selection snapshots taken by updateActions since the last trace
+    int m_selectionSnapshots;
 };
 
 #endif // MAINWINDOW_H
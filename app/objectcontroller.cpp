@@ -59,6 +59,7 @@ public:
     void saveExpandedState();
     void restoreExpandedState();
     void slotValueChanged(QtProperty *property, const QVariant &value);
+    void slotObjectDestroyed();
     int enumToInt(const QMetaEnum &metaEnum, int enumValue) const;
     int intToEnum(const QMetaEnum &metaEnum, int intValue) const;
     int flagToInt(const QMetaEnum &metaEnum, int flagValue) const;
@@ -318,6 +319,18 @@ void ObjectControllerPrivate::slotValueChanged(QtProperty *property, const QVari
     }
 
     updateClassProperties(metaObject, true);
+    emit q_ptr->objectChanged(m_object);
+}
+
+// shapes are deleted behind the editor's back, by the undo history among others
+void ObjectControllerPrivate::slotObjectDestroyed()
+{
+    m_object = 0;
+    QListIterator<QtProperty *> it(m_topLevelProperties);
+    while (it.hasNext()) {
+        m_browser->removeProperty(it.next());
+    }
+    m_topLevelProperties.clear();
 }
 
 ///////////////////
@@ -366,6 +379,7 @@ void ObjectController::setObject(QObject *object)
         return;
 
     if (d_ptr->m_object) {
+        disconnect(d_ptr->m_object, SIGNAL(destroyed()), this, SLOT(slotObjectDestroyed()));
         d_ptr->saveExpandedState();
         QListIterator<QtProperty *> it(d_ptr->m_topLevelProperties);
         while (it.hasNext()) {
@@ -379,6 +393,7 @@ void ObjectController::setObject(QObject *object)
     if (!d_ptr->m_object)
         return;
 
+    connect(d_ptr->m_object, SIGNAL(destroyed()), this, SLOT(slotObjectDestroyed()));
     d_ptr->addClassProperties(d_ptr->m_object->metaObject());
 
     d_ptr->restoreExpandedState();
@@ -55,11 +55,16 @@ public:
     void setObject(QObject *object);
     QObject *object() const;
 
+signals:
+    // a property of the object was written from the editor
+    void objectChanged(QObject *object);
+
 private:
     ObjectControllerPrivate *d_ptr;
     Q_DECLARE_PRIVATE(ObjectController)
     Q_DISABLE_COPY(ObjectController)
     Q_PRIVATE_SLOT(d_func(), void slotValueChanged(QtProperty *, const QVariant &))
+    Q_PRIVATE_SLOT(d_func(), void slotObjectDestroyed())
 };
 
 #endif
@@ -0,0 +1,450 @@
+#include "shapeindex.h"
+#include <QVarLengthArray>
+#include <QtMath>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+// entries of a node before it splits, and the fewest it keeps before its
+// entries are inserted again elsewhere
+static const int MaxEntries = 16;
+static const int MinEntries = 6;
+
+struct ShapeIndex::Node
+{
+    explicit Node( bool isLeaf ) : parent(0), leaf(isLeaf) {}
+    int count() const { return leaf ? entries.size() : children.size(); }
+    QRectF bounds;
+    Node * parent;
+    bool leaf;
+    QVector<Node*> children;
+    QVector<ShapeIndex::Entry> entries;
+};
+
+// unlike the QRectF operators these keep rects of no width or height, like
+// the bounds of a straight line
+static QRectF unite( const QRectF & a , const QRectF & b )
+{
+    return QRectF(QPointF(qMin(a.left(),b.left()),qMin(a.top(),b.top())),
+                  QPointF(qMax(a.right(),b.right()),qMax(a.bottom(),b.bottom())));
+}
+
+static bool overlaps( const QRectF & a , const QRectF & b )
+{
+    return a.left() <= b.right() && b.left() <= a.right() &&
+           a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+static bool encloses( const QRectF & outer , const QRectF & inner )
+{
+    return outer.left() <= inner.left() && inner.right() <= outer.right() &&
+           outer.top() <= inner.top() && inner.bottom() <= outer.bottom();
+}
+
+static qreal area( const QRectF & rect )
+{
+    return rect.width() * rect.height();
+}
+
+static qreal distance2( const QRectF & rect , const QPointF & pos )
+{
+    const qreal dx = qMax(qMax(rect.left() - pos.x(),pos.x() - rect.right()),qreal(0));
+    const qreal dy = qMax(qMax(rect.top() - pos.y(),pos.y() - rect.bottom()),qreal(0));
+    return dx * dx + dy * dy;
+}
+
+struct CenterLess
+{
+    CenterLess( const QVector<QRectF> & bounds , bool vertical )
+        :m_bounds(bounds),m_vertical(vertical) {}
+    bool operator()( int a , int b ) const
+    {
+        const QRectF & ra = m_bounds.at(a);
+        const QRectF & rb = m_bounds.at(b);
+        if ( m_vertical )
+            return ra.top() + ra.bottom() < rb.top() + rb.bottom();
+        return ra.left() + ra.right() < rb.left() + rb.right();
+    }
+    const QVector<QRectF> & m_bounds;
+    bool m_vertical;
+};
+
+static QVector<int> identity( int size )
+{
+    QVector<int> order(size);
+    for ( int i = 0 ; i < size ; ++i )
+        order[i] = i;
+    return order;
+}
+
+// sort-tile-recursive order: vertical slices by x, each sorted by y, so
+// that runs of MaxEntries make compact nodes
+static QVector<int> tileOrder( const QVector<QRectF> & bounds )
+{
+    QVector<int> order = identity(bounds.size());
+    std::sort(order.begin(),order.end(),CenterLess(bounds,false));
+    const int nodes = (bounds.size() + MaxEntries - 1) / MaxEntries;
+    const int sliceSize = qCeil(qSqrt(nodes)) * MaxEntries;
+    for ( int start = 0 ; start < order.size() ; start += sliceSize ){
+        const int end = qMin(start + sliceSize,order.size());
+        std::sort(order.begin() + start,order.begin() + end,CenterLess(bounds,true));
+    }
+    return order;
+}
+
+// a split cuts along the axis the centers spread more on
+static bool spreadsVertically( const QVector<QRectF> & bounds )
+{
+    qreal left = bounds.first().center().x(), right = left;
+    qreal top = bounds.first().center().y(), bottom = top;
+    foreach (const QRectF & rect, bounds) {
+        const QPointF center = rect.center();
+        left = qMin(left,center.x());
+        right = qMax(right,center.x());
+        top = qMin(top,center.y());
+        bottom = qMax(bottom,center.y());
+    }
+    return bottom - top > right - left;
+}
+
+ShapeIndex::ShapeIndex()
+    :m_root(new Node(true))
+{
+}
+
+ShapeIndex::~ShapeIndex()
+{
+    deleteNode(m_root);
+}
+
+void ShapeIndex::clear()
+{
+    deleteNode(m_root);
+    m_root = new Node(true);
+    m_leafOf.clear();
+}
+
+void ShapeIndex::deleteNode(Node *node)
+{
+    foreach (Node *child, node->children) {
+        deleteNode(child);
+    }
+    delete node;
+}
+
+void ShapeIndex::updateBounds(Node *node)
+{
+    if ( node->count() == 0 ){
+        node->bounds = QRectF();
+    }else if ( node->leaf ){
+        QRectF bounds = node->entries.first().bounds;
+        for ( int i = 1 ; i < node->entries.size() ; ++i )
+            bounds = unite(bounds,node->entries.at(i).bounds);
+        node->bounds = bounds;
+    }else{
+        QRectF bounds = node->children.first()->bounds;
+        for ( int i = 1 ; i < node->children.size() ; ++i )
+            bounds = unite(bounds,node->children.at(i)->bounds);
+        node->bounds = bounds;
+    }
+}
+
+void ShapeIndex::load(const QVector<Entry> &entries)
+{
+    clear();
+    if ( entries.isEmpty() )
+        return;
+
+    QVector<QRectF> bounds(entries.size());
+    for ( int i = 0 ; i < entries.size() ; ++i )
+        bounds[i] = entries.at(i).bounds;
+    const QVector<int> order = tileOrder(bounds);
+
+    QVector<Node*> leaves;
+    for ( int i = 0 ; i < order.size() ; i += MaxEntries ){
+        Node * leaf = new Node(true);
+        const int end = qMin(i + MaxEntries,order.size());
+        for ( int k = i ; k < end ; ++k ){
+            const Entry & entry = entries.at(order.at(k));
+            leaf->entries.append(entry);
+            m_leafOf.insert(entry.item,leaf);
+        }
+        updateBounds(leaf);
+        leaves.append(leaf);
+    }
+    delete m_root;
+    m_root = pack(leaves);
+}
+
+// packs each level into parents the same way until one node is left
+ShapeIndex::Node *ShapeIndex::pack(QVector<Node *> nodes)
+{
+    while ( nodes.size() > 1 ){
+        QVector<QRectF> bounds(nodes.size());
+        for ( int i = 0 ; i < nodes.size() ; ++i )
+            bounds[i] = nodes.at(i)->bounds;
+        const QVector<int> order = tileOrder(bounds);
+
+        QVector<Node*> parents;
+        for ( int i = 0 ; i < order.size() ; i += MaxEntries ){
+            Node * parent = new Node(false);
+            const int end = qMin(i + MaxEntries,order.size());
+            for ( int k = i ; k < end ; ++k ){
+                Node * child = nodes.at(order.at(k));
+                child->parent = parent;
+                parent->children.append(child);
+            }
+            updateBounds(parent);
+            parents.append(parent);
+        }
+        nodes = parents;
+    }
+    return nodes.first();
+}
+
+void ShapeIndex::insert(QGraphicsItem *item, const QRectF &bounds)
+{
+    QHash<QGraphicsItem*,Node*>::iterator it = m_leafOf.find(item);
+    if ( it != m_leafOf.end() ){
+        Node * leaf = it.value();
+        // small moves stay in their leaf and only tighten the bounds above it
+        if ( encloses(leaf->bounds,bounds) ){
+            for ( int i = 0 ; i < leaf->entries.size() ; ++i ){
+                if ( leaf->entries.at(i).item == item ){
+                    leaf->entries[i].bounds = bounds;
+                    break;
+                }
+            }
+            for ( Node * node = leaf ; node ; node = node->parent ){
+                const QRectF old = node->bounds;
+                updateBounds(node);
+                if ( node->bounds == old )
+                    break;
+            }
+            return;
+        }
+        remove(item);
+    }
+
+    Entry entry;
+    entry.item = item;
+    entry.bounds = bounds;
+    insertEntry(entry);
+}
+
+void ShapeIndex::insertEntry(const Entry &entry)
+{
+    Node * node = m_root;
+    while ( !node->leaf ){
+        // the child that grows least, the smaller one on ties
+        Node * best = 0;
+        qreal bestGrowth = 0;
+        qreal bestArea = 0;
+        foreach (Node *child, node->children) {
+            const qreal childArea = area(child->bounds);
+            const qreal growth = area(unite(child->bounds,entry.bounds)) - childArea;
+            if ( !best || growth < bestGrowth || (growth == bestGrowth && childArea < bestArea) ){
+                best = child;
+                bestGrowth = growth;
+                bestArea = childArea;
+            }
+        }
+        node = best;
+    }
+
+    node->entries.append(entry);
+    m_leafOf.insert(entry.item,node);
+    node->bounds = node->entries.size() == 1 ? entry.bounds : unite(node->bounds,entry.bounds);
+    for ( Node * parent = node->parent ; parent ; parent = parent->parent )
+        parent->bounds = unite(parent->bounds,entry.bounds);
+    if ( node->entries.size() > MaxEntries )
+        split(node);
+}
+
+// halves an overfull node along its longer axis, growing a new root when
+// the root splits
+void ShapeIndex::split(Node *node)
+{
+    const int count = node->count();
+    QVector<QRectF> bounds(count);
+    for ( int i = 0 ; i < count ; ++i )
+        bounds[i] = node->leaf ? node->entries.at(i).bounds : node->children.at(i)->bounds;
+    QVector<int> order = identity(count);
+    std::sort(order.begin(),order.end(),CenterLess(bounds,spreadsVertically(bounds)));
+    const int half = count / 2;
+
+    Node * sibling = new Node(node->leaf);
+    if ( node->leaf ){
+        const QVector<Entry> entries = node->entries;
+        node->entries.clear();
+        for ( int k = 0 ; k < count ; ++k ){
+            const Entry & entry = entries.at(order.at(k));
+            if ( k < half ){
+                node->entries.append(entry);
+            }else{
+                sibling->entries.append(entry);
+                m_leafOf.insert(entry.item,sibling);
+            }
+        }
+    }else{
+        const QVector<Node*> children = node->children;
+        node->children.clear();
+        for ( int k = 0 ; k < count ; ++k ){
+            Node * child = children.at(order.at(k));
+            Node * owner = k < half ? node : sibling;
+            child->parent = owner;
+            owner->children.append(child);
+        }
+    }
+    updateBounds(node);
+    updateBounds(sibling);
+
+    if ( !node->parent ){
+        Node * root = new Node(false);
+        root->children.append(node);
+        root->children.append(sibling);
+        node->parent = root;
+        sibling->parent = root;
+        updateBounds(root);
+        m_root = root;
+        return;
+    }
+    // the parent covers the same area as before
+    Node * parent = node->parent;
+    sibling->parent = parent;
+    parent->children.append(sibling);
+    if ( parent->children.size() > MaxEntries )
+        split(parent);
+}
+
+void ShapeIndex::remove(QGraphicsItem *item)
+{
+    QHash<QGraphicsItem*,Node*>::iterator it = m_leafOf.find(item);
+    if ( it == m_leafOf.end() )
+        return;
+    Node * leaf = it.value();
+    m_leafOf.erase(it);
+    for ( int i = 0 ; i < leaf->entries.size() ; ++i ){
+        if ( leaf->entries.at(i).item == item ){
+            leaf->entries.remove(i);
+            break;
+        }
+    }
+    condense(leaf);
+}
+
+// dissolves the nodes on the way up that fell below MinEntries and inserts
+// their shapes again, then drops the levels a thin root no longer needs
+void ShapeIndex::condense(Node *node)
+{
+    QVector<Entry> orphans;
+    while ( node->parent ){
+        Node * parent = node->parent;
+        if ( node->count() < MinEntries ){
+            parent->children.remove(parent->children.indexOf(node));
+            collect(node,&orphans);
+        }else{
+            updateBounds(node);
+        }
+        node = parent;
+    }
+    updateBounds(m_root);
+
+    while ( !m_root->leaf && m_root->children.size() == 1 ){
+        Node * child = m_root->children.first();
+        m_root->children.clear();
+        delete m_root;
+        m_root = child;
+        m_root->parent = 0;
+    }
+    if ( !m_root->leaf && m_root->children.isEmpty() )
+        m_root->leaf = true;
+
+    foreach (const Entry & entry, orphans) {
+        insertEntry(entry);
+    }
+}
+
+void ShapeIndex::collect(Node *node, QVector<Entry> *entries)
+{
+    if ( node->leaf ){
+        foreach (const Entry & entry, node->entries) {
+            entries->append(entry);
+            m_leafOf.remove(entry.item);
+        }
+    }else{
+        foreach (Node *child, node->children) {
+            collect(child,entries);
+        }
+    }
+    delete node;
+}
+
+QList<QGraphicsItem *> ShapeIndex::intersecting(const QRectF &rect) const
+{
+    QList<QGraphicsItem *> items;
+    if ( m_leafOf.isEmpty() || !overlaps(m_root->bounds,rect) )
+        return items;
+
+    QVarLengthArray<const Node*,64> stack;
+    stack.append(m_root);
+    while ( !stack.isEmpty() ){
+        const Node * node = stack.last();
+        stack.resize(stack.size() - 1);
+        if ( node->leaf ){
+            for ( int i = 0 ; i < node->entries.size() ; ++i ){
+                if ( overlaps(node->entries.at(i).bounds,rect) )
+                    items.append(node->entries.at(i).item);
+            }
+        }else{
+            for ( int i = 0 ; i < node->children.size() ; ++i ){
+                if ( overlaps(node->children.at(i)->bounds,rect) )
+                    stack.append(node->children.at(i));
+            }
+        }
+    }
+    return items;
+}
+
+QList<QGraphicsItem *> ShapeIndex::containing(const QPointF &pos) const
+{
+    return intersecting(QRectF(pos,pos));
+}
+
+// best first, nodes are visited by their distance until none can be closer
+QGraphicsItem *ShapeIndex::nearest(const QPointF &pos) const
+{
+    if ( m_leafOf.isEmpty() )
+        return 0;
+
+    typedef std::pair<qreal,const Node*> Candidate;
+    std::priority_queue<Candidate,std::vector<Candidate>,std::greater<Candidate> > queue;
+    queue.push(Candidate(distance2(m_root->bounds,pos),m_root));
+    QGraphicsItem * best = 0;
+    qreal bestDistance = std::numeric_limits<qreal>::max();
+    while ( !queue.empty() ){
+        const Candidate candidate = queue.top();
+        queue.pop();
+        if ( candidate.first >= bestDistance )
+            break;
+        const Node * node = candidate.second;
+        if ( node->leaf ){
+            for ( int i = 0 ; i < node->entries.size() ; ++i ){
+                const qreal distance = distance2(node->entries.at(i).bounds,pos);
+                if ( distance < bestDistance ){
+                    bestDistance = distance;
+                    best = node->entries.at(i).item;
+                }
+            }
+        }else{
+            for ( int i = 0 ; i < node->children.size() ; ++i ){
+                const qreal distance = distance2(node->children.at(i)->bounds,pos);
+                if ( distance < bestDistance )
+                    queue.push(Candidate(distance,node->children.at(i)));
+            }
+        }
+    }
+    return best;
+}
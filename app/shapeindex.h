@@ -0,0 +1,59 @@
+#ifndef SHAPEINDEX
+#define SHAPEINDEX
+
+#include <QHash>
+#include <QList>
+#include <QRectF>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QGraphicsItem;
+QT_END_NAMESPACE
+
+// An R-tree over the scene bounds of shapes. It is packed in one pass when
+// a whole drawing is loaded and updated in place when single shapes move,
+// unlike the bsp tree of QGraphicsScene that is rebuilt after changes.
+// Queries test bounds only, callers refine them with the shapes.
+class ShapeIndex
+{
+public:
+    struct Entry
+    {
+        QGraphicsItem * item;
+        QRectF bounds;
+    };
+
+    ShapeIndex();
+    ~ShapeIndex();
+
+    void clear();
+    // replaces the contents, packing the tree bottom up (sort-tile-recursive)
+    void load( const QVector<Entry> & entries );
+    // inserts the item or moves it to the new bounds
+    void insert( QGraphicsItem * item , const QRectF & bounds );
+    void remove( QGraphicsItem * item );
+    bool contains( QGraphicsItem * item ) const { return m_leafOf.contains(item); }
+    int size() const { return m_leafOf.size(); }
+
+    QList<QGraphicsItem *> intersecting( const QRectF & rect ) const;
+    QList<QGraphicsItem *> containing( const QPointF & pos ) const;
+    // the item whose bounds are closest to pos, NULL if the index is empty
+    QGraphicsItem * nearest( const QPointF & pos ) const;
+
+private:
+    struct Node;
+    void insertEntry( const Entry & entry );
+    void split( Node * node );
+    void condense( Node * node );
+    void collect( Node * node , QVector<Entry> * entries );
+    Node * pack( QVector<Node*> nodes );
+    static void updateBounds( Node * node );
+    static void deleteNode( Node * node );
+
+    Node * m_root;
+    QHash<QGraphicsItem*,Node*> m_leafOf;
+
+    Q_DISABLE_COPY(ShapeIndex)
+};
+
+#endif // SHAPEINDEX
@@ -1,85 +1,60 @@
+
 #include "sizehandle.h"
 #include <QGraphicsScene>
-#include <QGraphicsSceneContextMenuEvent>
-#include <QMenu>
+#include <QGraphicsView>
 #include <QPainter>
 #include <qdebug.h>
 #include <QtWidgets>
 
-SizeHandleRect::SizeHandleRect(QGraphicsItem* parent , int d, bool control)
-    :QGraphicsRectItem(-SELECTION_HANDLE_SIZE/2,
-                       -SELECTION_HANDLE_SIZE/2,
-                       SELECTION_HANDLE_SIZE,
-                       SELECTION_HANDLE_SIZE,parent)
-    ,m_dir(d)
+SelectionHandle::SelectionHandle(int d, bool control)
+    :m_dir(d)
     ,m_controlPoint(control)
-    ,m_state(SelectionHandleOff)
-    ,borderColor("white")
 {
-    this->setAcceptHoverEvents(true);
-    setFlag(QGraphicsItem::ItemIgnoresTransformations,true);
-    hide();
 }
 
-
-void SizeHandleRect::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+void SelectionHandle::move(qreal x, qreal y)
 {
-    painter->save();
-    painter->setPen(Qt::SolidLine);
-    painter->setBrush(QBrush(borderColor));
-
-    painter->setRenderHint(QPainter::Antialiasing,false);
-
-    if ( m_controlPoint  )
-    {
-        painter->setPen(QPen(Qt::red,Qt::SolidLine));
-        painter->setBrush(Qt::green);
-        painter->drawEllipse(rect().center(),3,3);
-    }else
-        painter->drawRect(rect());
-    painter->restore();
-}
-
-
-void SizeHandleRect::setState(SelectionHandleState st)
-{
-    if (st == m_state)
-        return;
-    switch (st) {
-    case SelectionHandleOff:
-        hide();
-        break;
-    case SelectionHandleInactive:
-    case SelectionHandleActive:
-        show();
-        break;
-    }
-    borderColor = Qt::white;
-    m_state = st;
-}
-
-void SizeHandleRect::move(qreal x, qreal y)
-{   
-    setPos(x,y);
+    m_pos = QPointF(x,y);
 }
 
-void SizeHandleRect::hoverEnterEvent(QGraphicsSceneHoverEvent *e)
+QSizeF SelectionHandle::sceneSize(const QTransform &trans)
 {
-    borderColor = Qt::blue;
-    update();
-    QGraphicsRectItem::hoverEnterEvent(e);
+    QSizeF size(SELECTION_HANDLE_SIZE,SELECTION_HANDLE_SIZE);
+    qreal sx = qAbs(trans.m11());
+    qreal sy = qAbs(trans.m22());
+    if ( !qFuzzyIsNull(sx) )
+        size.setWidth(size.width() / sx);
+    if ( !qFuzzyIsNull(sy) )
+        size.setHeight(size.height() / sy);
+    return size;
 }
 
-void SizeHandleRect::hoverLeaveEvent(QGraphicsSceneHoverEvent *e)
+void SelectionHandle::paint(QPainter *painter, const QVector<QRectF> &rects,
+                            const QVector<QRectF> &controls, const QRectF &hover)
 {
-    borderColor = Qt::white;
-    update();
-    QGraphicsRectItem::hoverLeaveEvent(e);
-}
-
-
-
-
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing,false);
 
+    if ( !rects.isEmpty() ){
+        painter->setPen(Qt::SolidLine);
+        painter->setBrush(QBrush(Qt::white));
+        painter->drawRects(rects);
+    }
 
+    if ( !controls.isEmpty() ){
+        QPainterPath path;
+        foreach (const QRectF & rc, controls) {
+            path.addEllipse(rc.center(),3,3);
+        }
+        painter->setPen(QPen(Qt::red,Qt::SolidLine));
+        painter->setBrush(Qt::green);
+        painter->drawPath(path);
+    }
 
+    if ( !hover.isNull() ){
+        painter->setPen(Qt::SolidLine);
+        painter->setBrush(QBrush(Qt::blue));
+        painter->drawRect(hover);
+    }
+    painter->restore();
+}
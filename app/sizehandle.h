@@ -1,43 +1,45 @@
 #ifndef SIZEHANDLE
 #define SIZEHANDLE
 
-#include <QGraphicsRectItem>
-#include <QList>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE
 class QColor;
-class QFocusEvent;
 class QGraphicsItem;
-class QGraphicsScene;
-class QGraphicsSceneMouseEvent;
-class QGraphicsSceneHoverEvent;
+class QPainter;
+class QTransform;
 QT_END_NAMESPACE
 
 
 enum { SELECTION_HANDLE_SIZE = 6, SELECTION_MARGIN = 10 };
-enum SelectionHandleState { SelectionHandleOff, SelectionHandleInactive, SelectionHandleActive };
 enum { Handle_None = 0 , LeftTop , Top, RightTop, Right, RightBottom, Bottom, LeftBottom, Left };
 
-class SizeHandleRect :public QGraphicsRectItem
+// geometry of a selection handle in the local coordinates of its shape.
+// Handles are not scene items: the view paints the handles of all selected
+// shapes in one foreground pass and hit-tests them from their positions.
+class SelectionHandle
 {
 public:
-
-    SizeHandleRect(QGraphicsItem* parent , int d , bool control = false );
+    SelectionHandle( int d = Handle_None , bool control = false );
     int dir() const  { return m_dir; }
-    void setState(SelectionHandleState st);
+    bool isControlPoint() const { return m_controlPoint; }
+    QPointF pos() const { return m_pos; }
     void move(qreal x, qreal y );
-protected:
-    void hoverEnterEvent(QGraphicsSceneHoverEvent *e );
-    void hoverLeaveEvent(QGraphicsSceneHoverEvent *e );
-    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
 
+    // handles keep a fixed size on screen, this is that size in scene units
+    // in the view of the given transform
+    static QSizeF sceneSize( const QTransform & viewTransform );
+    static void paint( QPainter * painter ,
+                       const QVector<QRectF> & rects ,
+                       const QVector<QRectF> & controls ,
+                       const QRectF & hover = QRectF() );
 private:
-    const int m_dir;
-    bool   m_controlPoint;
-    SelectionHandleState m_state;
-    QColor borderColor;
+    int     m_dir;
+    bool    m_controlPoint;
+    QPointF m_pos;
 };
 
-
 #endif // SIZEHANDLE
 
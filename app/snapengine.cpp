@@ -0,0 +1,58 @@
+#include "snapengine.h"
+
+void SnapEngine::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_bounds.clear();
+}
+
+void SnapEngine::insert(QGraphicsItem *item, const QRectF &bounds)
+{
+    remove(item);
+    m_bounds.insert(item,bounds);
+    m_x.insert(bounds.left(),item);
+    m_x.insert(bounds.center().x(),item);
+    m_x.insert(bounds.right(),item);
+    m_y.insert(bounds.top(),item);
+    m_y.insert(bounds.center().y(),item);
+    m_y.insert(bounds.bottom(),item);
+}
+
+// the keys are computed from the same bounds as on insert, so they match
+void SnapEngine::remove(QGraphicsItem *item)
+{
+    QHash<QGraphicsItem*,QRectF>::iterator it = m_bounds.find(item);
+    if ( it == m_bounds.end() )
+        return;
+    const QRectF bounds = it.value();
+    m_bounds.erase(it);
+    m_x.remove(bounds.left(),item);
+    m_x.remove(bounds.center().x(),item);
+    m_x.remove(bounds.right(),item);
+    m_y.remove(bounds.top(),item);
+    m_y.remove(bounds.center().y(),item);
+    m_y.remove(bounds.bottom(),item);
+}
+
+bool SnapEngine::snap(Qt::Orientation axis, const QVector<qreal> &values, qreal tolerance,
+                      const QSet<QGraphicsItem *> &exclude, Guide *guide) const
+{
+    const QMultiMap<qreal,QGraphicsItem*> & targets = axis == Qt::Horizontal ? m_x : m_y;
+    bool found = false;
+    foreach (qreal value, values) {
+        QMultiMap<qreal,QGraphicsItem*>::const_iterator it = targets.lowerBound(value - tolerance);
+        for ( ; it != targets.constEnd() && it.key() <= value + tolerance ; ++it ){
+            if ( exclude.contains(it.value()) )
+                continue;
+            const qreal offset = it.key() - value;
+            if ( !found || qAbs(offset) < qAbs(guide->offset) ){
+                guide->item = it.value();
+                guide->target = it.key();
+                guide->offset = offset;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
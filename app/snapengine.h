@@ -0,0 +1,48 @@
+#ifndef SNAPENGINE
+#define SNAPENGINE
+
+#include <QHash>
+#include <QMap>
+#include <QRectF>
+#include <QSet>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QGraphicsItem;
+QT_END_NAMESPACE
+
+// The snap targets of shapes: the left, center and right of their scene
+// bounds and the top, center and bottom, each axis in a sorted map. A
+// lookup is a range search around the coordinate, so its cost grows with
+// the log of the number of shapes rather than the number itself.
+class SnapEngine
+{
+public:
+    struct Guide
+    {
+        Guide() : item(0), target(0), offset(0) {}
+        // the shape snapped to, NULL for the grid
+        QGraphicsItem * item;
+        qreal target;
+        // what moves the snapped coordinate onto the target
+        qreal offset;
+    };
+
+    void clear();
+    // inserts the item or moves its targets to the new bounds
+    void insert( QGraphicsItem * item , const QRectF & bounds );
+    void remove( QGraphicsItem * item );
+    QRectF bounds( QGraphicsItem * item ) const { return m_bounds.value(item); }
+
+    // the target closest to any of the values within tolerance, horizontal
+    // for x. false if there is none besides the excluded shapes
+    bool snap( Qt::Orientation axis , const QVector<qreal> & values , qreal tolerance ,
+               const QSet<QGraphicsItem *> & exclude , Guide * guide ) const;
+
+private:
+    QMultiMap<qreal,QGraphicsItem*> m_x;
+    QMultiMap<qreal,QGraphicsItem*> m_y;
+    QHash<QGraphicsItem*,QRectF> m_bounds;
+};
+
+#endif // SNAPENGINE
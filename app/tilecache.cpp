@@ -0,0 +1,75 @@
+#include "tilecache.h"
+#include <QtMath>
+
+// zoom levels kept at the same time, older ones are dropped as a whole
+static const int MaxLevels = 4;
+
+TileCache::TileCache(int maxTiles)
+    :m_tiles(maxTiles)
+{
+}
+
+qint64 TileCache::levelOf(const QTransform &trans)
+{
+    return qRound64(trans.m11() * 65536) ^ ( qRound64(trans.m22() * 65536) << 24 );
+}
+
+QRect TileCache::tileRange(const QRectF &rect)
+{
+    const int left = qFloor(rect.left() / TileSize);
+    const int top = qFloor(rect.top() / TileSize);
+    const int right = qFloor(rect.right() / TileSize);
+    const int bottom = qFloor(rect.bottom() / TileSize);
+    return QRect(QPoint(left,top),QPoint(right,bottom));
+}
+
+QRect TileCache::tileRect(int x, int y)
+{
+    return QRect(x * TileSize, y * TileSize, TileSize, TileSize);
+}
+
+QPixmap *TileCache::tile(const QTransform &trans, int x, int y) const
+{
+    return m_tiles.object(TileKey(levelOf(trans),x,y));
+}
+
+void TileCache::insert(const QTransform &trans, int x, int y, const QPixmap &tile)
+{
+    addLevel(trans);
+    m_tiles.insert(TileKey(levelOf(trans),x,y),new QPixmap(tile));
+}
+
+void TileCache::invalidate(const QRectF &rect)
+{
+    QHash<qint64,QTransform>::const_iterator it = m_levels.constBegin();
+    for ( ; it != m_levels.constEnd() ; ++it ){
+        // one pixel of slack for antialiased edges
+        const QRect range = tileRange(it.value().mapRect(rect).adjusted(-1,-1,1,1));
+        if ( qint64(range.width()) * range.height() > m_tiles.count() ){
+            foreach (const TileKey & key, m_tiles.keys()) {
+                if ( key.level == it.key() && range.contains(key.x,key.y) )
+                    m_tiles.remove(key);
+            }
+            continue;
+        }
+        for ( int y = range.top() ; y <= range.bottom() ; ++y )
+            for ( int x = range.left() ; x <= range.right() ; ++x )
+                m_tiles.remove(TileKey(it.key(),x,y));
+    }
+}
+
+void TileCache::clear()
+{
+    m_tiles.clear();
+    m_levels.clear();
+}
+
+void TileCache::addLevel(const QTransform &trans)
+{
+    const qint64 level = levelOf(trans);
+    if ( m_levels.contains(level) )
+        return;
+    if ( m_levels.size() >= MaxLevels )
+        clear();
+    m_levels.insert(level,trans);
+}
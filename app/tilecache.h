@@ -0,0 +1,55 @@
+#ifndef TILECACHE
+#define TILECACHE
+
+#include <QCache>
+#include <QHash>
+#include <QPixmap>
+#include <QRect>
+#include <QTransform>
+
+struct TileKey
+{
+    TileKey( qint64 l = 0 , int tx = 0 , int ty = 0 )
+        :level(l),x(tx),y(ty){}
+    bool operator==( const TileKey & other ) const
+    {
+        return level == other.level && x == other.x && y == other.y;
+    }
+    qint64 level;
+    int x;
+    int y;
+};
+
+inline uint qHash( const TileKey & key , uint seed = 0 )
+{
+    return qHash(key.level,seed) ^ qHash((key.x << 16) ^ key.y,seed);
+}
+
+// Rendered pieces of a scene, keyed by zoom level and tile coordinate.
+// Tiles are TileSize pixels square and laid out in the device space of
+// the view transform without its scroll offset, so panning never changes
+// their content.
+class TileCache
+{
+public:
+    enum { TileSize = 256 };
+    explicit TileCache( int maxTiles = 256 );
+
+    static qint64 levelOf( const QTransform & trans );
+    // range of tile coordinates covering a rect in untranslated device space
+    static QRect tileRange( const QRectF & rect );
+    static QRect tileRect( int x , int y );
+
+    QPixmap * tile( const QTransform & trans , int x , int y ) const;
+    void insert( const QTransform & trans , int x , int y , const QPixmap & tile );
+    // drops the tiles of every cached level that intersect the scene rect
+    void invalidate( const QRectF & rect );
+    void clear();
+
+private:
+    void addLevel( const QTransform & trans );
+    QCache<TileKey,QPixmap> m_tiles;
+    QHash<qint64,QTransform> m_levels;
+};
+
+#endif // TILECACHE
@@ -0,0 +1,225 @@
+#include "tilerenderer.h"
+#include <QGraphicsScene>
+#include <QGraphicsRectItem>
+#include <QStyleOptionGraphicsItem>
+#include <QPainter>
+#include <QRunnable>
+#include <QThread>
+#include "drawscene.h"
+#include "drawobj.h"
+#include "tilecache.h"
+
+namespace {
+
+class ViewTileJob : public QRunnable
+{
+public:
+    ViewTileJob( TileRenderer * renderer , const SceneSnapshotPtr & snapshot , const QTransform & trans ,
+                 int x , int y , quint64 generation , const QColor & background )
+        :m_renderer(renderer),m_snapshot(snapshot),m_trans(trans)
+        ,m_x(x),m_y(y),m_generation(generation),m_background(background)
+    {}
+    void run() Q_DECL_OVERRIDE
+    {
+        const QImage image = TileRenderer::renderTile(*m_snapshot,m_trans,
+                                                      TileCache::tileRect(m_x,m_y),m_background);
+        // the renderer waits for its pool before it goes away
+        emit m_renderer->tileReady(image,m_trans,m_x,m_y,m_generation);
+    }
+private:
+    TileRenderer * m_renderer;
+    SceneSnapshotPtr m_snapshot;
+    QTransform m_trans;
+    int m_x;
+    int m_y;
+    quint64 m_generation;
+    QColor m_background;
+};
+
+class ImageTileJob : public QRunnable
+{
+public:
+    ImageTileJob( const SceneSnapshotPtr & snapshot , const QTransform & trans ,
+                  const QRect & rect , const QColor & background , QImage * result )
+        :m_snapshot(snapshot),m_trans(trans),m_rect(rect)
+        ,m_background(background),m_result(result)
+    {}
+    void run() Q_DECL_OVERRIDE
+    {
+        *m_result = TileRenderer::renderTile(*m_snapshot,m_trans,m_rect,m_background);
+    }
+private:
+    SceneSnapshotPtr m_snapshot;
+    QTransform m_trans;
+    QRect m_rect;
+    QColor m_background;
+    QImage * m_result;
+};
+
+}
+
+// the copied shapes are QObjects of the gui thread
+class SnapshotItems : public QObject
+{
+public:
+    ~SnapshotItems() { qDeleteAll(items); }
+    QVector<QGraphicsItem*> items;
+};
+
+SceneSnapshot::SceneSnapshot()
+    :m_items(new SnapshotItems)
+    ,m_grid(NULL)
+{
+}
+
+// the last tile job to finish may release the snapshot on a worker, the
+// copies are then deleted by the event loop of their own thread
+SceneSnapshot::~SceneSnapshot()
+{
+    if ( m_items->thread() == QThread::currentThread() )
+        delete m_items;
+    else
+        m_items->deleteLater();
+    delete m_grid;
+}
+
+SceneSnapshotPtr SceneSnapshot::create(QGraphicsScene *scene, const QRectF &area)
+{
+    QSharedPointer<SceneSnapshot> snapshot(new SceneSnapshot);
+    snapshot->m_sceneRect = scene->sceneRect();
+    snapshot->m_area = area;
+    snapshot->m_palette = scene->palette();
+    DrawScene * drawScene = qobject_cast<DrawScene*>(scene);
+    if ( drawScene && drawScene->grid() && drawScene->isGridVisible() )
+        snapshot->m_grid = new GridTool(*drawScene->grid());
+
+    // the item index finds the shapes of a few tiles without a walk of the scene
+    const QList<QGraphicsItem*> items = area.isNull() ? scene->items(Qt::AscendingOrder) :
+                scene->items(area,Qt::IntersectsItemBoundingRect,Qt::AscendingOrder);
+    snapshot->m_entries.reserve(items.size());
+    foreach (QGraphicsItem *item, items) {
+        if ( !item->isVisible() )
+            continue;
+        const bool group = item->type() == GraphicsItemGroup::Type;
+        if ( item->type() != GraphicsItem::Type && !group ){
+            // the scene keeps an empty rect item around
+            QGraphicsRectItem * rect = qgraphicsitem_cast<QGraphicsRectItem*>(item);
+            if ( rect && rect->rect().isEmpty() )
+                continue;
+            return SceneSnapshotPtr();
+        }
+        // groups paint nothing but their selection
+        if ( group && !item->isSelected() )
+            continue;
+        AbstractShape * shape = qgraphicsitem_cast<AbstractShape*>(item);
+        Entry entry;
+        entry.item = shape->duplicate();
+        if ( !entry.item )
+            return SceneSnapshotPtr();
+        snapshot->m_items->items.append(entry.item);
+        // builds the cached paths before the copy is shared between threads
+        entry.item->boundingRect();
+        entry.transform = item->sceneTransform();
+        entry.bounds = item->sceneBoundingRect();
+        entry.selected = item->isSelected();
+        snapshot->m_entries.append(entry);
+    }
+    return snapshot;
+}
+
+void SceneSnapshot::render(QPainter *painter, const QRectF &rect) const
+{
+    if ( m_grid ){
+        // the grid caches its tiles, every painter gets a copy of its own
+        GridTool grid(*m_grid);
+        grid.paintGrid(painter,m_sceneRect.toRect(),rect);
+    }else
+        painter->fillRect(m_sceneRect & rect,Qt::white);
+
+    const QTransform base = painter->worldTransform();
+    QStyleOptionGraphicsItem option;
+    option.palette = m_palette;
+    foreach (const Entry & entry, m_entries) {
+        if ( !entry.bounds.intersects(rect) )
+            continue;
+        option.state = entry.selected ? QStyle::State_Selected : QStyle::State_None;
+        option.exposedRect = entry.item->boundingRect();
+        painter->save();
+        painter->setWorldTransform(entry.transform * base);
+        entry.item->paint(painter,&option,0);
+        painter->restore();
+    }
+}
+
+TileRenderer::TileRenderer(QObject *parent)
+    :QObject(parent)
+{
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+TileRenderer::~TileRenderer()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void TileRenderer::setThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(qMax(1,count));
+}
+
+int TileRenderer::threadCount() const
+{
+    return m_pool.maxThreadCount();
+}
+
+void TileRenderer::request(const SceneSnapshotPtr &snapshot, const QTransform &trans,
+                           int x, int y, quint64 generation, const QColor &background)
+{
+    m_pool.start(new ViewTileJob(this,snapshot,trans,x,y,generation,background));
+}
+
+void TileRenderer::cancel()
+{
+    m_pool.clear();
+}
+
+QImage TileRenderer::renderTile(const SceneSnapshot &snapshot, const QTransform &trans,
+                                const QRect &rect, const QColor &background)
+{
+    QImage tile(rect.size(),QImage::Format_ARGB32_Premultiplied);
+    tile.fill(background);
+    QPainter painter(&tile);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setWorldTransform(trans * QTransform::fromTranslate(-rect.left(),-rect.top()));
+    snapshot.render(&painter,trans.inverted().mapRect(QRectF(rect)));
+    return tile;
+}
+
+QImage TileRenderer::renderImage(const SceneSnapshotPtr &snapshot, const QTransform &trans,
+                                 const QSize &size, const QColor &background, int threads)
+{
+    QImage image(size,QImage::Format_ARGB32_Premultiplied);
+    if ( !snapshot || image.isNull() )
+        return QImage();
+
+    const int tileSize = TileCache::TileSize;
+    const int cols = ( size.width() + tileSize - 1 ) / tileSize;
+    const int rows = ( size.height() + tileSize - 1 ) / tileSize;
+    QVector<QRect> rects;
+    for ( int y = 0 ; y < rows ; ++y )
+        for ( int x = 0 ; x < cols ; ++x )
+            rects.append(TileCache::tileRect(x,y) & image.rect());
+
+    QVector<QImage> tiles(rects.size());
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(1,threads));
+    for ( int i = 0 ; i < rects.size() ; ++i )
+        pool.start(new ImageTileJob(snapshot,trans,rects[i],background,&tiles[i]));
+    pool.waitForDone();
+
+    QPainter painter(&image);
+    for ( int i = 0 ; i < rects.size() ; ++i )
+        painter.drawImage(rects[i].topLeft(),tiles[i]);
+    return image;
+}
@@ -0,0 +1,92 @@
+#ifndef TILERENDERER
+#define TILERENDERER
+
+#include <QObject>
+#include <QImage>
+#include <QPalette>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QTransform>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QGraphicsItem;
+class QGraphicsScene;
+class QPainter;
+QT_END_NAMESPACE
+
+class GridTool;
+
+class SnapshotItems;
+
+// Copies of the shapes of a scene, taken on the gui thread and only read
+// afterwards, so any number of threads can paint them at the same time.
+class SceneSnapshot
+{
+public:
+    // copies the shapes touching area, all of them for a null area. returns
+    // a null pointer if the scene holds items that cannot be copied
+    static QSharedPointer<const SceneSnapshot> create( QGraphicsScene * scene ,
+                                                       const QRectF & area = QRectF() );
+    ~SceneSnapshot();
+
+    QRectF sceneRect() const { return m_sceneRect; }
+    QRectF area() const { return m_area; }
+    // everything inside rect can be painted from this snapshot
+    bool covers( const QRectF & rect ) const { return m_area.isNull() || m_area.contains(rect); }
+    // paints the part of the scene inside rect, the painter maps scene
+    // coordinates to the device
+    void render( QPainter * painter , const QRectF & rect ) const;
+
+private:
+    SceneSnapshot();
+    struct Entry
+    {
+        QGraphicsItem * item;
+        QTransform transform;
+        QRectF bounds;
+        bool selected;
+    };
+    QVector<Entry> m_entries;
+    // owns the copies, see ~SceneSnapshot
+    SnapshotItems * m_items;
+    QRectF m_sceneRect;
+    QRectF m_area;
+    GridTool * m_grid;
+    QPalette m_palette;
+};
+
+typedef QSharedPointer<const SceneSnapshot> SceneSnapshotPtr;
+
+// Rasterizes tiles of a snapshot on a pool of worker threads.
+class TileRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TileRenderer( QObject * parent = 0 );
+    ~TileRenderer();
+
+    void setThreadCount( int count );
+    int threadCount() const;
+    // queues a tile of the view transform trans, tileReady is emitted on
+    // the thread of the renderer when it is done
+    void request( const SceneSnapshotPtr & snapshot , const QTransform & trans ,
+                  int x , int y , quint64 generation , const QColor & background );
+    // drops the requests that have not started yet
+    void cancel();
+
+    static QImage renderTile( const SceneSnapshot & snapshot , const QTransform & trans ,
+                              const QRect & rect , const QColor & background );
+    // renders the scene through trans into an image of the given size,
+    // split into tiles over count threads
+    static QImage renderImage( const SceneSnapshotPtr & snapshot , const QTransform & trans ,
+                               const QSize & size , const QColor & background , int threads );
+
+signals:
+    void tileReady( const QImage & image , const QTransform & trans , int x , int y , quint64 generation );
+
+private:
+    QThreadPool m_pool;
+};
+
+#endif // TILERENDERER
@@ -0,0 +1,518 @@
+#include "benchmark.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QScopedPointer>
+#include <QThread>
+#include <QUndoStack>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include "scenegenerator.h"
+#include "drawscene.h"
+#include "document.h"
+#include "commands.h"
+
+// move commands undone and redone by the undo case
+static const int UndoSteps = 20;
+// vertices of the polyline and bounds queries of the polyline case
+static const int PolylinePoints = 10000;
+static const int PolylineQueries = 100;
+// rectangles of the memory case, whatever the size of the drawing
+static const int MemoryRects = 100000;
+// the index cases query a grid of this many points a side and a rect
+// around every QueryRectStep-th of them
+static const int QuerySide = 32;
+static const int QueryRectStep = 16;
+
+static QPointF queryPoint( const QRectF & page , int i )
+{
+    i %= QuerySide * QuerySide;
+    return QPointF(page.left() + (i % QuerySide + 0.5) * page.width() / QuerySide,
+                   page.top() + (i / QuerySide + 0.5) * page.height() / QuerySide);
+}
+
+// a field of /proc/self/status in KiB, -1 on systems without it
+static qint64 processStatus( const QByteArray & field )
+{
+    QFile file("/proc/self/status");
+    if ( !file.open(QFile::ReadOnly) )
+        return -1;
+    foreach (const QByteArray & line, file.readAll().split('\n')) {
+        if ( line.startsWith(field + ':') )
+            return line.mid(field.size() + 1).trimmed().split(' ').first().toLongLong();
+    }
+    return -1;
+}
+
+// starts the peak resident set over at the current one, linux 4.0 and later
+static bool resetPeakRss()
+{
+    QFile file("/proc/self/clear_refs");
+    return file.open(QFile::WriteOnly) && file.write("5") == 1;
+}
+
+static void selectShapes( const QList<QGraphicsItem*> & shapes )
+{
+    foreach (QGraphicsItem *item, shapes) {
+        item->setSelected(true);
+    }
+}
+
+Benchmark::Benchmark(SceneGenerator *generator, int iterations)
+    :m_generator(generator)
+    ,m_iterations(qMax(1,iterations))
+    ,m_threads(1)
+    ,m_rtree(false)
+    ,m_scene(NULL)
+{
+}
+
+QJsonObject Benchmark::run(const QString &workDir)
+{
+    const QDir dir(workDir);
+    m_xmlFile = dir.filePath("bench.xml");
+    m_binaryFile = dir.filePath("bench.qdrw");
+    if ( !m_generator->write(m_xmlFile) )
+        return QJsonObject();
+    m_scene = loadScene(m_xmlFile);
+    if ( !m_scene )
+        return QJsonObject();
+    Document document(m_scene);
+    if ( !document.save(m_binaryFile) ){
+        delete m_scene;
+        m_scene = NULL;
+        return QJsonObject();
+    }
+
+    m_results = QJsonArray();
+    // a large drawing, --shapes for a file of a gigabyte, shows the peak of
+    // the mapped load against reading the file into memory first
+    measure("load_xml",&Benchmark::loadXml,true);
+    measure("load_binary",&Benchmark::loadBinary,true);
+    measure("load_binary_read",&Benchmark::loadBinaryRead,true);
+    measure("memory_rects_100k",&Benchmark::memoryRects,true);
+    m_outputFile = dir.filePath("saved.xml");
+    measure("save_xml",&Benchmark::save);
+    m_outputFile = dir.filePath("saved.qdrw");
+    measure("save_binary",&Benchmark::save);
+    measure("save_journal",&Benchmark::saveJournal);
+    measure("bounding_rect_polyline_10k",&Benchmark::boundingRectPolyline);
+    measure("add_item",&Benchmark::addItem);
+    measure("add_items",&Benchmark::addItems);
+    measure("select_all",&Benchmark::selectAll);
+    measure("rubber_band_select",&Benchmark::rubberBandSelect);
+    measure("align",&Benchmark::align);
+    measure("group_ungroup",&Benchmark::groupUngroup);
+    measure("undo_redo",&Benchmark::undoRedo);
+    measure("undo_redo_batch",&Benchmark::undoRedoBatch);
+    const int threads[] = { 1, 2, 4, 8 };
+    for ( unsigned i = 0 ; i < sizeof(threads) / sizeof(threads[0]) ; ++i ){
+        m_threads = threads[i];
+        measure(QString("render_threads_%1").arg(m_threads),&Benchmark::render);
+    }
+    for ( int rtree = 0 ; rtree < 2 ; ++rtree ){
+        m_rtree = rtree;
+        const QString index = m_rtree ? "rtree" : "bsp";
+        measure("index_insert_" + index,&Benchmark::indexInsert);
+        measure("index_move_query_" + index,&Benchmark::indexMoveQuery);
+        measure("point_query_" + index,&Benchmark::pointQuery);
+        measure("rect_query_" + index,&Benchmark::rectQuery);
+    }
+    measure("snap_drag",&Benchmark::snapDrag);
+    delete m_scene;
+    m_scene = NULL;
+
+    QJsonObject report;
+    report.insert("qt",QString(qVersion()));
+    report.insert("cores",QThread::idealThreadCount());
+    report.insert("iterations",m_iterations);
+    report.insert("drawing",m_generator->description());
+    report.insert("results",m_results);
+    return report;
+}
+
+void Benchmark::measure(const QString &name, Benchmark::Case run, bool memory)
+{
+    QVector<qint64> times;
+    QVector<qint64> peaks;
+    for ( int i = 0 ; i < m_iterations ; ++i ){
+        const bool peak = memory && resetPeakRss();
+        const qint64 before = peak ? processStatus("VmRSS") : -1;
+        times.append((this->*run)());
+        if ( before >= 0 )
+            peaks.append(qMax(Q_INT64_C(0),processStatus("VmHWM") - before));
+    }
+    std::sort(times.begin(),times.end());
+    std::sort(peaks.begin(),peaks.end());
+
+    qint64 total = 0;
+    foreach (qint64 time, times) {
+        total += time;
+    }
+    QJsonObject result;
+    result.insert("name",name);
+    result.insert("min_ms",times.first() / 1e6);
+    result.insert("median_ms",times.at(times.size() / 2) / 1e6);
+    result.insert("mean_ms",total / 1e6 / times.size());
+    if ( !peaks.isEmpty() )
+        result.insert("peak_rss_kib",double(peaks.at(peaks.size() / 2)));
+    m_results.append(result);
+}
+
+DrawScene *Benchmark::loadScene(const QString &fileName)
+{
+    DrawScene * scene = new DrawScene;
+    Document document(scene);
+    if ( !document.load(fileName) ){
+        delete scene;
+        return NULL;
+    }
+    return scene;
+}
+
+int Benchmark::hitCount(DrawScene *scene, const QPointF &pos) const
+{
+    return m_rtree ? scene->shapesAt(pos).size() : scene->items(pos).size();
+}
+
+int Benchmark::hitCount(DrawScene *scene, const QRectF &rect) const
+{
+    return m_rtree ? scene->shapesIn(rect).size() : scene->items(rect).size();
+}
+
+qint64 Benchmark::loadXml()
+{
+    DrawScene scene;
+    Document document(&scene);
+    QElapsedTimer timer;
+    timer.start();
+    document.load(m_xmlFile);
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::loadBinary()
+{
+    DrawScene scene;
+    Document document(&scene);
+    QElapsedTimer timer;
+    timer.start();
+    document.load(m_binaryFile);
+    return timer.nsecsElapsed();
+}
+
+// the binary drawing read into memory before it is parsed, the way files
+// were loaded before they were mapped
+qint64 Benchmark::loadBinaryRead()
+{
+    DrawScene scene;
+    Document document(&scene);
+    QElapsedTimer timer;
+    timer.start();
+    QFile file(m_binaryFile);
+    if ( !file.open(QFile::ReadOnly) )
+        return 0;
+    const QByteArray bytes = file.readAll();
+    bool journal = false;
+    int records = 0;
+    document.loadBinary(bytes,&journal,&records);
+    return timer.nsecsElapsed();
+}
+
+// the format follows m_outputFile
+qint64 Benchmark::save()
+{
+    Document document(m_scene);
+    QElapsedTimer timer;
+    timer.start();
+    document.save(m_outputFile);
+    return timer.nsecsElapsed();
+}
+
+// one moved shape appended to the drawing saved before
+qint64 Benchmark::saveJournal()
+{
+    Document document(m_scene);
+    document.save(m_outputFile,true);
+    const QList<QGraphicsItem*> shapes = m_scene->shapes();
+    if ( shapes.isEmpty() )
+        return 0;
+    shapes.first()->moveBy(1,1);
+    QElapsedTimer timer;
+    timer.start();
+    document.save(m_outputFile);
+    const qint64 elapsed = timer.nsecsElapsed();
+    shapes.first()->moveBy(-1,-1);
+    return elapsed;
+}
+
+// the scene asks a shape for its bounds and outline on every index update,
+// hit test and repaint, a polyline strokes its path once per change
+qint64 Benchmark::boundingRectPolyline()
+{
+    GraphicsBezier polyline(false);
+    const QRectF page = m_scene->sceneRect();
+    for ( int i = 0 ; i < PolylinePoints ; ++i ){
+        polyline.addPoint(QPointF(page.left() + page.width() * i / PolylinePoints,
+                                  page.top() + (i % 2 ? page.height() / 4 : 0)));
+    }
+    polyline.updateCoordinate();
+
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < PolylineQueries ; ++i ){
+        polyline.boundingRect();
+        polyline.shape();
+    }
+    return timer.nsecsElapsed();
+}
+
+// selected shapes only get handles, the scene holds one item per rectangle
+qint64 Benchmark::memoryRects()
+{
+    const QRectF page = m_scene->sceneRect();
+    DrawScene scene;
+    scene.setSceneRect(page);
+    QList<QGraphicsItem*> items;
+    items.reserve(MemoryRects);
+    const int side = qCeil(qSqrt(MemoryRects));
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < MemoryRects ; ++i ){
+        GraphicsRectItem * item = new GraphicsRectItem(QRect(0,0,40,30));
+        item->setPos(page.left() + page.width() * (i % side) / side,
+                     page.top() + page.height() * (i / side) / side);
+        items.append(item);
+    }
+    scene.addItems(items);
+    scene.itemsBoundingRect();
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::addItem()
+{
+    DrawScene scene;
+    Document document(&scene);
+    document.load(m_binaryFile);
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    foreach (QGraphicsItem *item, shapes) {
+        scene.removeItem(item);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    foreach (QGraphicsItem *item, shapes) {
+        scene.addItem(item);
+    }
+    scene.itemsBoundingRect();
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::addItems()
+{
+    DrawScene scene;
+    Document document(&scene);
+    document.load(m_binaryFile);
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    foreach (QGraphicsItem *item, shapes) {
+        scene.removeItem(item);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    scene.addItems(shapes);
+    scene.itemsBoundingRect();
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::selectAll()
+{
+    const QList<QGraphicsItem*> shapes = m_scene->shapes();
+    QElapsedTimer timer;
+    timer.start();
+    selectShapes(shapes);
+    m_scene->selectedShapes();
+    const qint64 elapsed = timer.nsecsElapsed();
+    m_scene->clearSelection();
+    return elapsed;
+}
+
+qint64 Benchmark::rubberBandSelect()
+{
+    const QRectF page = m_scene->sceneRect();
+    const QRectF band = page.adjusted(page.width() / 4,page.height() / 4,-page.width() / 4,-page.height() / 4);
+    QElapsedTimer timer;
+    timer.start();
+    m_scene->selectShapes(band,QList<QGraphicsItem*>());
+    m_scene->selectedShapes();
+    const qint64 elapsed = timer.nsecsElapsed();
+    m_scene->clearSelection();
+    return elapsed;
+}
+
+qint64 Benchmark::align()
+{
+    // works on a copy, aligning moves the shapes
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    selectShapes(scene->shapes());
+    QElapsedTimer timer;
+    timer.start();
+    scene->align(LEFT_ALIGN);
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::groupUngroup()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    const QList<QGraphicsItem*> shapes = scene->shapes();
+    QElapsedTimer timer;
+    timer.start();
+    GraphicsItemGroup * group = scene->createGroup(shapes);
+    if ( group )
+        scene->destroyGroup(group);
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::undoRedo()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    const QList<QGraphicsItem*> shapes = scene->shapes();
+    selectShapes(shapes);
+    QUndoStack stack;
+    // moves of the same selection within a second merge into one step,
+    // each step leaves out another shape so that they all stay apart
+    for ( int i = 0 ; i < UndoSteps ; ++i ){
+        QGraphicsItem * left = shapes.at(i % shapes.size());
+        left->setSelected(false);
+        stack.push(new MoveShapeCommand(scene.data(),QPointF(1,1)));
+        left->setSelected(true);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while ( stack.canUndo() )
+        stack.undo();
+    while ( stack.canRedo() )
+        stack.redo();
+    return timer.nsecsElapsed();
+}
+
+// every shape moved as one step, the way align records it
+qint64 Benchmark::undoRedoBatch()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    BatchShapeCommand * command = new BatchShapeCommand(scene.data(),"Align");
+    foreach (QGraphicsItem *item, scene->shapes()) {
+        item->moveBy(1,1);
+        command->addMove(item,QPointF(1,1));
+    }
+    QUndoStack stack;
+    stack.push(command);
+
+    QElapsedTimer timer;
+    timer.start();
+    stack.undo();
+    stack.redo();
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::render()
+{
+    Document document(m_scene);
+    QElapsedTimer timer;
+    timer.start();
+    document.renderImage(m_scene->sceneRect().size().toSize(),m_threads);
+    return timer.nsecsElapsed();
+}
+
+// the scenes of the r-tree cases keep no bsp tree, the index is built by
+// the first query after the shapes are added
+qint64 Benchmark::indexInsert()
+{
+    DrawScene scene;
+    Document document(&scene);
+    document.load(m_binaryFile);
+    if ( m_rtree )
+        scene.setItemIndexMethod(QGraphicsScene::NoIndex);
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    foreach (QGraphicsItem *item, shapes) {
+        scene.removeItem(item);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    foreach (QGraphicsItem *item, shapes) {
+        scene.addItem(item);
+    }
+    hitCount(&scene,scene.sceneRect().center());
+    return timer.nsecsElapsed();
+}
+
+// every tenth shape moved with a hit test after each, like a drag
+qint64 Benchmark::indexMoveQuery()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    if ( m_rtree )
+        scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+    const QList<QGraphicsItem*> shapes = scene->shapes();
+    const QRectF page = scene->sceneRect();
+    hitCount(scene.data(),page.center());
+
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < shapes.size() ; i += 10 ){
+        shapes.at(i)->moveBy(5,5);
+        hitCount(scene.data(),queryPoint(page,i));
+    }
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::pointQuery()
+{
+    const QRectF page = m_scene->sceneRect();
+    hitCount(m_scene,page.center());
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < QuerySide * QuerySide ; ++i )
+        hitCount(m_scene,queryPoint(page,i));
+    return timer.nsecsElapsed();
+}
+
+qint64 Benchmark::rectQuery()
+{
+    const QRectF page = m_scene->sceneRect();
+    const QSizeF size(page.width() / 8,page.height() / 8);
+    hitCount(m_scene,page.center());
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < QuerySide * QuerySide ; i += QueryRectStep ){
+        QRectF rect(QPointF(),size);
+        rect.moveCenter(queryPoint(page,i));
+        hitCount(m_scene,rect);
+    }
+    return timer.nsecsElapsed();
+}
+
+// one shape dragged over the page, snapping at every step
+qint64 Benchmark::snapDrag()
+{
+    const QList<QGraphicsItem*> shapes = m_scene->shapes();
+    if ( shapes.isEmpty() )
+        return 0;
+    const QList<QGraphicsItem*> dragged = shapes.mid(0,1);
+    const QRectF bounds = m_scene->shapeBounds(dragged);
+    const QRectF page = m_scene->sceneRect();
+    m_scene->beginSnap(dragged);
+    m_scene->snapOffset(bounds);
+
+    QElapsedTimer timer;
+    timer.start();
+    for ( int i = 0 ; i < QuerySide * QuerySide ; ++i ){
+        QRectF rect = bounds;
+        rect.moveCenter(queryPoint(page,i));
+        m_scene->snapOffset(rect);
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+    m_scene->endSnap();
+    return elapsed;
+}
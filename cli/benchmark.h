@@ -0,0 +1,68 @@
+#ifndef BENCHMARK
+#define BENCHMARK
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QPointF;
+class QRectF;
+QT_END_NAMESPACE
+
+class DrawScene;
+class SceneGenerator;
+
+// Times the editing operations on a generated drawing and reports them as
+// json: the minimum, median and mean of every case in milliseconds. Memory
+// cases add the median growth of the peak resident set during a run, on
+// systems that report it.
+class Benchmark
+{
+public:
+    Benchmark( SceneGenerator * generator , int iterations );
+    // returns an empty object if the drawing cannot be written or read
+    QJsonObject run( const QString & workDir );
+
+private:
+    typedef qint64 (Benchmark::*Case)();
+    void measure( const QString & name , Case run , bool memory = false );
+    DrawScene * loadScene( const QString & fileName );
+    // hit tests through the scene's bsp tree or its shape index, by m_rtree
+    int hitCount( DrawScene * scene , const QPointF & pos ) const;
+    int hitCount( DrawScene * scene , const QRectF & rect ) const;
+
+    qint64 loadXml();
+    qint64 loadBinary();
+    qint64 loadBinaryRead();
+    qint64 save();
+    qint64 saveJournal();
+    qint64 boundingRectPolyline();
+    qint64 memoryRects();
+    qint64 addItem();
+    qint64 addItems();
+    qint64 selectAll();
+    qint64 rubberBandSelect();
+    qint64 align();
+    qint64 groupUngroup();
+    qint64 undoRedo();
+    qint64 undoRedoBatch();
+    qint64 render();
+    qint64 indexInsert();
+    qint64 indexMoveQuery();
+    qint64 pointQuery();
+    qint64 rectQuery();
+    qint64 snapDrag();
+
+    SceneGenerator * m_generator;
+    int m_iterations;
+    int m_threads;
+    bool m_rtree;
+    QString m_xmlFile;
+    QString m_binaryFile;
+    QString m_outputFile;
+    DrawScene * m_scene;
+    QJsonArray m_results;
+};
+
+#endif // BENCHMARK
@@ -0,0 +1,48 @@
+#-------------------------------------------------
+#
+# qdraw-cli renders, converts and benchmarks drawings without a window
+#
+#-------------------------------------------------
+
+QT       += core gui xml svg
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = qdraw-cli
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../app
+DEPENDPATH += ../app
+
+SOURCES += main.cpp \
+    scenegenerator.cpp \
+    benchmark.cpp \
+    ../app/commands.cpp \
+    ../app/drawobj.cpp \
+    ../app/drawscene.cpp \
+    ../app/drawtool.cpp \
+    ../app/sizehandle.cpp \
+    ../app/document.cpp \
+    ../app/documentloader.cpp \
+    ../app/documentwriter.cpp \
+    ../app/tilecache.cpp \
+    ../app/shapeindex.cpp \
+    ../app/snapengine.cpp \
+    ../app/tilerenderer.cpp
+
+HEADERS += scenegenerator.h \
+    benchmark.h \
+    ../app/commands.h \
+    ../app/drawobj.h \
+    ../app/drawscene.h \
+    ../app/drawtool.h \
+    ../app/sizehandle.h \
+    ../app/document.h \
+    ../app/documentloader.h \
+    ../app/documentwriter.h \
+    ../app/tilecache.h \
+    ../app/shapeindex.h \
+    ../app/snapengine.h \
+    ../app/tilerenderer.h
@@ -0,0 +1,295 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTextStream>
+#include "drawscene.h"
+#include "document.h"
+#include "scenegenerator.h"
+#include "benchmark.h"
+
+struct Options
+{
+    QString command;
+    QString output;
+    QString outputDir;
+    QString format;
+    int width;
+    int threads;
+    bool grid;
+};
+
+static QTextStream & err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// ends an error line: endl is deprecated in Qt 5.15 and Qt::endl is not in
+// the versions before 5.14
+static QTextStream & newline( QTextStream & stream )
+{
+    stream << '\n';
+    stream.flush();
+    return stream;
+}
+
+static QString outputFormat( const Options & options , const QString & input )
+{
+    if ( !options.format.isEmpty() )
+        return options.format.toLower();
+    if ( !options.output.isEmpty() )
+        return QFileInfo(options.output).suffix().toLower();
+    if ( options.command == QLatin1String("convert") )
+        return QFileInfo(input).suffix().toLower() == QLatin1String("qdrw") ? "xml" : "qdrw";
+    return "png";
+}
+
+static QString outputFile( const Options & options , const QString & input )
+{
+    if ( !options.output.isEmpty() )
+        return options.output;
+    const QFileInfo info(input);
+    const QDir dir(options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir);
+    return dir.filePath(info.completeBaseName() + QLatin1Char('.') + outputFormat(options,input));
+}
+
+static bool processFile( const Options & options , const QString & input )
+{
+    DrawScene scene;
+    scene.setGridVisible(options.grid);
+    Document document(&scene);
+    if ( !document.load(input) ){
+        err() << input << ": " << document.errorString() << newline;
+        return false;
+    }
+
+    const QString output = outputFile(options,input);
+    const QString format = outputFormat(options,input);
+    bool ok = false;
+    if ( options.command == QLatin1String("convert") ){
+        if ( format != QLatin1String("xml") && format != QLatin1String("qdrw") ){
+            err() << output << ": cannot convert to " << format << newline;
+            return false;
+        }
+        ok = document.save(output);
+    }else if ( format == QLatin1String("svg") ){
+        ok = document.exportSvg(output);
+    }else{
+        const QSizeF page = scene.sceneRect().size();
+        QSize size = page.toSize();
+        if ( options.width > 0 && page.width() > 0 )
+            size = QSize(options.width,qMax(1,qRound(page.height() * options.width / page.width())));
+        const QImage image = document.renderImage(size,options.threads);
+        ok = !image.isNull() && image.save(output,format.toLatin1().constData());
+        if ( !ok ){
+            err() << output << ": cannot write image" << newline;
+            return false;
+        }
+    }
+    if ( !ok )
+        err() << output << ": " << document.errorString() << newline;
+    return ok;
+}
+
+static int generate( SceneGenerator & generator , const QString & output )
+{
+    if ( !generator.write(output) ){
+        err() << output << ": cannot write drawing" << newline;
+        return 1;
+    }
+    return 0;
+}
+
+static int bench( SceneGenerator & generator , int iterations , const QString & output )
+{
+    QTemporaryDir dir;
+    Benchmark benchmark(&generator,iterations);
+    const QJsonObject report = dir.isValid() ? benchmark.run(dir.path()) : QJsonObject();
+    if ( report.isEmpty() ){
+        err() << "cannot generate the drawing" << newline;
+        return 1;
+    }
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    if ( output.isEmpty() ){
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QFile file(output);
+    if ( !file.open(QFile::WriteOnly) || file.write(json) != json.size() ){
+        err() << output << ": " << file.errorString() << newline;
+        return 1;
+    }
+    return 0;
+}
+
+// hands the files round robin to copies of this program, one per job
+static int runJobs( const Options & options , const QStringList & files , int jobs )
+{
+    QStringList arguments;
+    arguments << options.command << "--jobs" << "1"
+              << "--threads" << QString::number(options.threads);
+    if ( !options.outputDir.isEmpty() )
+        arguments << "--output-dir" << options.outputDir;
+    if ( !options.format.isEmpty() )
+        arguments << "--format" << options.format;
+    if ( options.width > 0 )
+        arguments << "--width" << QString::number(options.width);
+    if ( options.grid )
+        arguments << "--grid";
+    arguments << "--";
+
+    QList<QProcess*> processes;
+    for ( int i = 0 ; i < jobs && i < files.size() ; ++i ){
+        QStringList chunk;
+        for ( int k = i ; k < files.size() ; k += jobs )
+            chunk << files.at(k);
+        QProcess * process = new QProcess;
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(QCoreApplication::applicationFilePath(),arguments + chunk);
+        processes << process;
+    }
+
+    int result = 0;
+    foreach (QProcess * process, processes) {
+        if ( !process->waitForFinished(-1) || process->exitStatus() != QProcess::NormalExit ||
+             process->exitCode() != 0 )
+            result = 1;
+        delete process;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // shapes are widgets module items, a QApplication on a platform without a display
+    if ( qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") )
+        qputenv("QT_QPA_PLATFORM","offscreen");
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName("qdraw-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders, converts, generates and benchmarks qdraw drawings without a window.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command","render: write png, jpg or svg images\n"
+                                           "convert: write xml or qdrw drawings\n"
+                                           "generate: write a synthetic drawing\n"
+                                           "bench: time editing operations on a synthetic drawing, as json");
+    parser.addPositionalArgument("files","Drawings to process.","files...");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Output file of a single drawing.","file");
+    QCommandLineOption outputDirOption(QStringList() << "d" << "output-dir",
+                                       "Directory for the output of many drawings, "
+                                       "next to each drawing by default.","directory");
+    QCommandLineOption formatOption(QStringList() << "f" << "format",
+                                    "Output format, png for render and the other "
+                                    "drawing format for convert by default.","format");
+    QCommandLineOption widthOption(QStringList() << "w" << "width",
+                                   "Width of rendered images in pixels, the page width by default.","pixels");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+                                     "Render threads per drawing.","count");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+                                  "Drawings processed in parallel, one per core by default.","count");
+    QCommandLineOption gridOption("grid","Paint the grid into rendered images.");
+    QCommandLineOption shapesOption("shapes","Shapes in a synthetic drawing.","count","10000");
+    QCommandLineOption mixOption("mix","Weights of the shape kinds, as rect=30,roundrect=10,"
+                                 "ellipse=20,polygon=15,bezier=15,group=10.","weights");
+    QCommandLineOption verticesOption("vertices","Points of polygons and beziers.","count","8");
+    QCommandLineOption groupSizeOption("group-size","Children of a group.","count","5");
+    QCommandLineOption groupDepthOption("group-depth","Nesting levels of groups.","count","2");
+    QCommandLineOption seedOption("seed","Seed of a synthetic drawing.","number","1");
+    QCommandLineOption pageOption("page","Page size of a synthetic drawing.","widthxheight","3200x2400");
+    QCommandLineOption iterationsOption("iterations","Runs of every benchmark.","count","5");
+    parser.addOption(outputOption);
+    parser.addOption(outputDirOption);
+    parser.addOption(formatOption);
+    parser.addOption(widthOption);
+    parser.addOption(threadsOption);
+    parser.addOption(jobsOption);
+    parser.addOption(gridOption);
+    parser.addOption(shapesOption);
+    parser.addOption(mixOption);
+    parser.addOption(verticesOption);
+    parser.addOption(groupSizeOption);
+    parser.addOption(groupDepthOption);
+    parser.addOption(seedOption);
+    parser.addOption(pageOption);
+    parser.addOption(iterationsOption);
+    parser.process(a);
+
+    QStringList files = parser.positionalArguments();
+    if ( files.isEmpty() )
+        parser.showHelp(1);
+
+    Options options;
+    options.command = files.takeFirst();
+    options.output = parser.value(outputOption);
+    options.outputDir = parser.value(outputDirOption);
+    options.format = parser.value(formatOption);
+    options.width = parser.value(widthOption).toInt();
+    options.grid = parser.isSet(gridOption);
+
+    if ( options.command == QLatin1String("generate") || options.command == QLatin1String("bench") ){
+        SceneGenerator generator;
+        generator.setShapeCount(parser.value(shapesOption).toInt());
+        generator.setVertices(parser.value(verticesOption).toInt());
+        generator.setGroupSize(parser.value(groupSizeOption).toInt());
+        generator.setGroupDepth(parser.value(groupDepthOption).toInt());
+        generator.setSeed(parser.value(seedOption).toUInt());
+        const QStringList page = parser.value(pageOption).split(QLatin1Char('x'));
+        if ( page.size() == 2 && page.at(0).toInt() > 0 && page.at(1).toInt() > 0 )
+            generator.setPageSize(QSize(page.at(0).toInt(),page.at(1).toInt()));
+        if ( !generator.setMix(parser.value(mixOption)) ){
+            err() << "bad shape mix " << parser.value(mixOption) << newline;
+            return 1;
+        }
+        const QString output = !options.output.isEmpty() || files.isEmpty() ? options.output : files.first();
+        if ( options.command == QLatin1String("bench") )
+            return bench(generator,parser.value(iterationsOption).toInt(),output);
+        if ( output.isEmpty() ){
+            err() << "no output file given" << newline;
+            return 1;
+        }
+        return generate(generator,output);
+    }
+
+    if ( options.command != QLatin1String("render") && options.command != QLatin1String("convert") ){
+        err() << "unknown command " << options.command << newline;
+        return 1;
+    }
+    if ( files.isEmpty() ){
+        err() << "no drawings given" << newline;
+        return 1;
+    }
+    if ( !options.output.isEmpty() && files.size() > 1 ){
+        err() << "--output takes a single drawing, use --output-dir" << newline;
+        return 1;
+    }
+    if ( !options.outputDir.isEmpty() && !QDir().mkpath(options.outputDir) ){
+        err() << "cannot create " << options.outputDir << newline;
+        return 1;
+    }
+
+    const int cores = qMax(1,QThread::idealThreadCount());
+    const int jobs = parser.isSet(jobsOption) ? qMax(1,parser.value(jobsOption).toInt())
+                                              : qMin(cores,files.size());
+    // the cores go to the drawings in batches and to the tiles otherwise
+    options.threads = parser.isSet(threadsOption) ? qMax(1,parser.value(threadsOption).toInt())
+                                                  : qMax(1,cores / jobs);
+    if ( jobs > 1 )
+        return runJobs(options,files,jobs);
+
+    int result = 0;
+    foreach (const QString & file, files) {
+        if ( !processFile(options,file) )
+            result = 1;
+    }
+    return result;
+}
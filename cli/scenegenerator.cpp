@@ -0,0 +1,198 @@
+#include "scenegenerator.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QPointF>
+#include <QPolygonF>
+#include <QStringList>
+#include <QXmlStreamWriter>
+#include <QtMath>
+
+static const char * KindNames[] = { "rect", "roundrect", "ellipse", "polygon", "bezier", "group" };
+
+SceneGenerator::SceneGenerator()
+    :m_shapeCount(10000)
+    ,m_vertices(8)
+    ,m_groupSize(5)
+    ,m_groupDepth(2)
+    ,m_pageSize(3200,2400)
+    ,m_seed(1)
+    ,m_state(1)
+    ,m_z(0)
+{
+    m_weights << 30 << 10 << 20 << 15 << 15 << 10;
+}
+
+QString SceneGenerator::kindName(int kind)
+{
+    return kind >= 0 && kind < KindCount ? QLatin1String(KindNames[kind]) : QString();
+}
+
+bool SceneGenerator::setMix(const QString &mix)
+{
+    foreach (const QString & part, mix.split(QLatin1Char(','),QString::SkipEmptyParts)) {
+        const QStringList pair = part.split(QLatin1Char('='));
+        bool ok = false;
+        const int weight = pair.size() == 2 ? pair.at(1).trimmed().toInt(&ok) : 0;
+        if ( !ok || weight < 0 )
+            return false;
+        int kind = 0;
+        while ( kind < KindCount && kindName(kind) != pair.at(0).trimmed() )
+            ++kind;
+        if ( kind == KindCount )
+            return false;
+        m_weights[kind] = weight;
+    }
+    return true;
+}
+
+quint32 SceneGenerator::random()
+{
+    // xorshift, the same sequence on every platform
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+}
+
+qreal SceneGenerator::uniform(qreal low, qreal high)
+{
+    return low + ( high - low ) * ( random() / 4294967296.0 );
+}
+
+int SceneGenerator::pickKind(bool leaf)
+{
+    const int kinds = leaf ? Group : KindCount;
+    int total = 0;
+    for ( int k = 0 ; k < kinds ; ++k )
+        total += m_weights.at(k);
+    if ( total <= 0 )
+        return Rect;
+    int pick = int(random() % quint32(total));
+    for ( int k = 0 ; k < kinds ; ++k ){
+        pick -= m_weights.at(k);
+        if ( pick < 0 )
+            return k;
+    }
+    return Rect;
+}
+
+bool SceneGenerator::write(const QString &fileName)
+{
+    QFile file(fileName);
+    if ( !file.open(QFile::WriteOnly | QFile::Text) )
+        return false;
+
+    m_state = m_seed ? m_seed : 1;
+    m_z = 0;
+    QXmlStreamWriter xml(&file);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeDTD("<!DOCTYPE qdraw>");
+    xml.writeStartElement("canvas");
+    xml.writeAttribute("width",QString::number(m_pageSize.width()));
+    xml.writeAttribute("height",QString::number(m_pageSize.height()));
+
+    int budget = m_shapeCount;
+    while ( budget > 0 ) {
+        const QPointF center(uniform(50,m_pageSize.width() - 50),uniform(50,m_pageSize.height() - 50));
+        writeShape(&xml,pickKind(false),center,1,budget);
+    }
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    return !xml.hasError();
+}
+
+void SceneGenerator::writeBase(QXmlStreamWriter *xml, const QPointF &center, qreal width, qreal height)
+{
+    xml->writeAttribute("rotate","0");
+    xml->writeAttribute("x",QString::number(center.x()));
+    xml->writeAttribute("y",QString::number(center.y()));
+    xml->writeAttribute("z",QString::number(m_z++));
+    xml->writeAttribute("width",QString::number(width));
+    xml->writeAttribute("height",QString::number(height));
+}
+
+void SceneGenerator::writeShape(QXmlStreamWriter *xml, int kind, const QPointF &center, int depth, int &budget)
+{
+    if ( kind == Group && depth > m_groupDepth )
+        kind = pickKind(true);
+
+    switch ( kind ) {
+    case Group:
+    {
+        // children are stored in scene coordinates like the editor saves them
+        xml->writeStartElement("group");
+        xml->writeAttribute("x",QString::number(center.x()));
+        xml->writeAttribute("y",QString::number(center.y()));
+        xml->writeAttribute("rotate","0");
+        for ( int i = 0 ; i < m_groupSize && budget > 0 ; ++i ){
+            const QPointF offset(uniform(-100,100),uniform(-100,100));
+            writeShape(xml,pickKind(depth >= m_groupDepth),center + offset,depth + 1,budget);
+        }
+        xml->writeEndElement();
+        return;
+    }
+    case Rect:
+    case RoundRect:
+    case Ellipse:
+        xml->writeStartElement(kindName(kind));
+        if ( kind == RoundRect ){
+            xml->writeAttribute("rx",QString::number(uniform(0.05,0.3)));
+            xml->writeAttribute("ry",QString::number(uniform(0.05,0.3)));
+        }else if ( kind == Ellipse ){
+            xml->writeAttribute("startAngle","0");
+            xml->writeAttribute("spanAngle","360");
+        }
+        writeBase(xml,center,uniform(10,80),uniform(10,80));
+        xml->writeEndElement();
+        break;
+    case Polygon:
+    case Bezier:
+    {
+        const qreal radius = uniform(10,50);
+        QPolygonF points;
+        if ( kind == Polygon ){
+            for ( int i = 0 ; i < m_vertices ; ++i ){
+                const qreal angle = 2 * M_PI * i / m_vertices;
+                const qreal r = radius * uniform(0.6,1);
+                points.append(QPointF(r * qCos(angle),r * qSin(angle)));
+            }
+        }else{
+            // one start point and three points per cubic segment
+            const int segments = qMax(1,( m_vertices - 1 ) / 3);
+            for ( int i = 0 ; i < segments * 3 + 1 ; ++i )
+                points.append(QPointF(uniform(-radius,radius),uniform(-radius,radius)));
+        }
+        const QRectF bounds = points.boundingRect();
+        xml->writeStartElement(kindName(kind));
+        writeBase(xml,center,bounds.width(),bounds.height());
+        foreach (const QPointF & pt, points) {
+            xml->writeStartElement("point");
+            xml->writeAttribute("x",QString::number(pt.x()));
+            xml->writeAttribute("y",QString::number(pt.y()));
+            xml->writeEndElement();
+        }
+        xml->writeEndElement();
+    }
+        break;
+    default:
+        break;
+    }
+    --budget;
+}
+
+QJsonObject SceneGenerator::description() const
+{
+    QJsonObject mix;
+    for ( int k = 0 ; k < KindCount ; ++k )
+        mix.insert(kindName(k),m_weights.at(k));
+    QJsonObject object;
+    object.insert("shapes",m_shapeCount);
+    object.insert("mix",mix);
+    object.insert("vertices",m_vertices);
+    object.insert("group_size",m_groupSize);
+    object.insert("group_depth",m_groupDepth);
+    object.insert("page",QJsonArray() << m_pageSize.width() << m_pageSize.height());
+    object.insert("seed",qint64(m_seed));
+    return object;
+}
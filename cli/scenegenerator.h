@@ -0,0 +1,58 @@
+#ifndef SCENEGENERATOR
+#define SCENEGENERATOR
+
+#include <QJsonObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QXmlStreamWriter;
+QT_END_NAMESPACE
+
+// Writes synthetic drawings in the xml format. The same seed and settings
+// always give the same drawing.
+class SceneGenerator
+{
+public:
+    enum Kind { Rect = 0, RoundRect, Ellipse, Polygon, Bezier, Group, KindCount };
+
+    SceneGenerator();
+
+    // number of leaf shapes, children of groups included
+    void setShapeCount( int count ) { m_shapeCount = count; }
+    int shapeCount() const { return m_shapeCount; }
+    // weights per kind as "rect=30,ellipse=20,...", unnamed kinds keep their weight
+    bool setMix( const QString & mix );
+    void setVertices( int count ) { m_vertices = qMax(3,count); }
+    void setGroupSize( int count ) { m_groupSize = qMax(2,count); }
+    void setGroupDepth( int depth ) { m_groupDepth = qMax(1,depth); }
+    void setPageSize( const QSize & size ) { m_pageSize = size; }
+    QSize pageSize() const { return m_pageSize; }
+    void setSeed( quint32 seed ) { m_seed = seed; }
+
+    bool write( const QString & fileName );
+    // the settings, for reports
+    QJsonObject description() const;
+
+    static QString kindName( int kind );
+
+private:
+    quint32 random();
+    qreal uniform( qreal low , qreal high );
+    int pickKind( bool leaf );
+    void writeShape( QXmlStreamWriter * xml , int kind , const QPointF & center , int depth , int & budget );
+    void writeBase( QXmlStreamWriter * xml , const QPointF & center , qreal width , qreal height );
+
+    int m_shapeCount;
+    QVector<int> m_weights;
+    int m_vertices;
+    int m_groupSize;
+    int m_groupDepth;
+    QSize m_pageSize;
+    quint32 m_seed;
+    quint32 m_state;
+    int m_z;
+};
+
+#endif // SCENEGENERATOR
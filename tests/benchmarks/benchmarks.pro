@@ -0,0 +1,6 @@
+TARGET = tst_benchmarks
+TEMPLATE = app
+
+include(../tests.pri)
+
+SOURCES += tst_benchmarks.cpp
@@ -0,0 +1,198 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QScopedPointer>
+#include "scenegenerator.h"
+#include "drawscene.h"
+#include "document.h"
+#include "commands.h"
+
+// The editing operations of qdraw-cli bench as QBENCHMARK cases on a
+// generated drawing, for comparing builds with -callgrind or -tickcounter.
+// The cli reports the same cases over drawings of any size.
+class tst_Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void loadXml();
+    void loadBinary();
+    void save_data();
+    void save();
+    void addItems();
+    void selectAll();
+    void rubberBandSelect();
+    void align();
+    void groupUngroup();
+    void undoRedoBatch();
+    void render();
+
+private:
+    DrawScene * loadScene( const QString & fileName );
+
+    QTemporaryDir m_dir;
+    QString m_xmlFile;
+    QString m_binaryFile;
+    DrawScene * m_scene;
+};
+
+void tst_Benchmarks::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    m_xmlFile = m_dir.path() + "/bench.xml";
+    m_binaryFile = m_dir.path() + "/bench.qdrw";
+    SceneGenerator generator;
+    generator.setShapeCount(2000);
+    QVERIFY(generator.write(m_xmlFile));
+    m_scene = loadScene(m_xmlFile);
+    QVERIFY(m_scene);
+    Document document(m_scene);
+    QVERIFY(document.save(m_binaryFile));
+}
+
+void tst_Benchmarks::cleanupTestCase()
+{
+    delete m_scene;
+    m_scene = NULL;
+}
+
+DrawScene *tst_Benchmarks::loadScene(const QString &fileName)
+{
+    DrawScene * scene = new DrawScene;
+    Document document(scene);
+    if ( !document.load(fileName) ){
+        delete scene;
+        return NULL;
+    }
+    return scene;
+}
+
+void tst_Benchmarks::loadXml()
+{
+    QBENCHMARK {
+        DrawScene scene;
+        Document document(&scene);
+        document.load(m_xmlFile);
+    }
+}
+
+void tst_Benchmarks::loadBinary()
+{
+    QBENCHMARK {
+        DrawScene scene;
+        Document document(&scene);
+        document.load(m_binaryFile);
+    }
+}
+
+void tst_Benchmarks::save_data()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::newRow("xml") << "saved.xml";
+    QTest::newRow("binary") << "saved.qdrw";
+}
+
+// full saves every time, the journal is compacted
+void tst_Benchmarks::save()
+{
+    QFETCH(QString,fileName);
+    const QString path = m_dir.path() + "/" + fileName;
+    Document document(m_scene);
+    QBENCHMARK {
+        document.save(path,true);
+    }
+}
+
+void tst_Benchmarks::addItems()
+{
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY(document.load(m_binaryFile));
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    QBENCHMARK {
+        foreach (QGraphicsItem *item, shapes) {
+            scene.removeItem(item);
+        }
+        scene.addItems(shapes);
+        scene.itemsBoundingRect();
+    }
+}
+
+void tst_Benchmarks::selectAll()
+{
+    const QList<QGraphicsItem*> shapes = m_scene->shapes();
+    QBENCHMARK {
+        foreach (QGraphicsItem *item, shapes) {
+            item->setSelected(true);
+        }
+        m_scene->selectedShapes();
+        m_scene->clearSelection();
+    }
+}
+
+void tst_Benchmarks::rubberBandSelect()
+{
+    const QRectF page = m_scene->sceneRect();
+    const QRectF band = page.adjusted(page.width() / 4,page.height() / 4,-page.width() / 4,-page.height() / 4);
+    QBENCHMARK {
+        m_scene->selectShapes(band,QList<QGraphicsItem*>());
+        m_scene->selectedShapes();
+        m_scene->clearSelection();
+    }
+}
+
+// works on a copy, aligning moves the shapes
+void tst_Benchmarks::align()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    QVERIFY(scene);
+    foreach (QGraphicsItem *item, scene->shapes()) {
+        item->setSelected(true);
+    }
+    QBENCHMARK {
+        scene->align(LEFT_ALIGN);
+    }
+}
+
+void tst_Benchmarks::groupUngroup()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    QVERIFY(scene);
+    const QList<QGraphicsItem*> shapes = scene->shapes();
+    QBENCHMARK {
+        GraphicsItemGroup * group = scene->createGroup(shapes);
+        QVERIFY(group);
+        scene->destroyGroup(group);
+    }
+}
+
+// every shape moved as one step, the way align records it
+void tst_Benchmarks::undoRedoBatch()
+{
+    QScopedPointer<DrawScene> scene(loadScene(m_binaryFile));
+    QVERIFY(scene);
+    BatchShapeCommand * command = new BatchShapeCommand(scene.data(),"Align");
+    foreach (QGraphicsItem *item, scene->shapes()) {
+        item->moveBy(1,1);
+        command->addMove(item,QPointF(1,1));
+    }
+    UndoStack stack;
+    stack.push(command);
+    QBENCHMARK {
+        stack.undo();
+        stack.redo();
+    }
+}
+
+void tst_Benchmarks::render()
+{
+    Document document(m_scene);
+    QBENCHMARK {
+        document.renderImage(m_scene->sceneRect().size().toSize(),1);
+    }
+}
+
+QTEST_MAIN(tst_Benchmarks)
+
+#include "tst_benchmarks.moc"
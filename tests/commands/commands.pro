@@ -0,0 +1,6 @@
+TARGET = tst_commands
+TEMPLATE = app
+
+include(../tests.pri)
+
+SOURCES += tst_commands.cpp
@@ -0,0 +1,188 @@
+#include <QtTest>
+#include "drawscene.h"
+#include "drawobj.h"
+#include "commands.h"
+
+// The batch command against the edits it records, and the undo stack
+// giving up its oldest steps under a memory budget.
+class tst_Commands : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void batchMove();
+    void batchRotate();
+    void budgetDiscards();
+    void undoDropsDiscarded();
+
+private:
+    void addRects( int count );
+    static bool near( const QPointF & a , const QPointF & b );
+
+    DrawScene * m_scene;
+    QList<QGraphicsItem *> m_items;
+};
+
+void tst_Commands::init()
+{
+    m_scene = new DrawScene;
+    m_scene->setSceneRect(0,0,800,600);
+}
+
+void tst_Commands::cleanup()
+{
+    delete m_scene;
+    m_scene = NULL;
+    m_items.clear();
+}
+
+void tst_Commands::addRects(int count)
+{
+    for ( int i = 0 ; i < count ; ++i ){
+        GraphicsRectItem * item = new GraphicsRectItem(QRect(0,0,40,30));
+        item->setPos(100 + 60 * i,100 + 20 * i);
+        m_scene->addItem(item);
+        m_items.append(item);
+    }
+}
+
+bool tst_Commands::near(const QPointF &a, const QPointF &b)
+{
+    return QLineF(a,b).length() < 1e-6;
+}
+
+void tst_Commands::batchMove()
+{
+    addRects(3);
+    QList<QPointF> before;
+    UndoStack stack;
+    BatchShapeCommand * command = new BatchShapeCommand(m_scene,"Move");
+    foreach (QGraphicsItem *item, m_items) {
+        before.append(item->pos());
+        item->moveBy(10,-5);
+        command->addMove(item,QPointF(10,-5));
+    }
+    stack.push(command);
+    for ( int i = 0 ; i < m_items.size() ; ++i )
+        QCOMPARE(m_items.at(i)->pos(),before.at(i) + QPointF(10,-5));
+
+    stack.undo();
+    for ( int i = 0 ; i < m_items.size() ; ++i )
+        QCOMPARE(m_items.at(i)->pos(),before.at(i));
+    stack.redo();
+    for ( int i = 0 ; i < m_items.size() ; ++i )
+        QCOMPARE(m_items.at(i)->pos(),before.at(i) + QPointF(10,-5));
+}
+
+// the shapes turn about the center of the selection the way the rotate
+// tool leaves them, each keeping its place relative to the others
+void tst_Commands::batchRotate()
+{
+    addRects(3);
+    m_items.at(1)->setRotation(30);
+    const QPointF center = m_scene->shapeBounds(m_items).center();
+    const qreal angle = 45;
+    QTransform turn;
+    turn.translate(center.x(),center.y());
+    turn.rotate(angle);
+    turn.translate(-center.x(),-center.y());
+
+    QList<QPointF> positions;
+    QList<qreal> rotations;
+    QList<QPointF> anchors;
+    foreach (QGraphicsItem *item, m_items) {
+        positions.append(item->pos());
+        rotations.append(item->rotation());
+        const QPointF anchor = item->mapToScene(item->transformOriginPoint());
+        anchors.append(turn.map(anchor));
+        const QPointF delta = turn.map(anchor) - anchor;
+        item->moveBy(delta.x(),delta.y());
+        item->setRotation(item->rotation() + angle);
+    }
+    UndoStack stack;
+    BatchShapeCommand * command = new BatchShapeCommand(m_scene,"Rotate");
+    foreach (QGraphicsItem *item, m_items) {
+        command->addRotate(item,center,angle);
+    }
+    stack.push(command);
+
+    stack.undo();
+    for ( int i = 0 ; i < m_items.size() ; ++i ){
+        QVERIFY(near(m_items.at(i)->pos(),positions.at(i)));
+        QCOMPARE(m_items.at(i)->rotation(),rotations.at(i));
+    }
+    stack.redo();
+    for ( int i = 0 ; i < m_items.size() ; ++i ){
+        QGraphicsItem * item = m_items.at(i);
+        QVERIFY(near(item->mapToScene(item->transformOriginPoint()),anchors.at(i)));
+        QCOMPARE(item->rotation(),rotations.at(i) + angle);
+    }
+}
+
+// five equal steps against a budget of two, the newest two stay live
+void tst_Commands::budgetDiscards()
+{
+    addRects(1);
+    QGraphicsItem * item = m_items.first();
+    UndoStack stack;
+    qint64 cost = 0;
+    for ( int i = 0 ; i < 5 ; ++i ){
+        BatchShapeCommand * command = new BatchShapeCommand(m_scene,"Move");
+        item->moveBy(1,0);
+        command->addMove(item,QPointF(1,0));
+        stack.push(command);
+        if ( i == 0 )
+            cost = stack.memoryUsed();
+    }
+    QVERIFY(cost > 0);
+    QCOMPARE(stack.memoryUsed(),5 * cost);
+
+    stack.setMemoryBudget(2 * cost);
+    QCOMPARE(stack.count(),5);
+    QCOMPARE(stack.memoryUsed(),2 * cost);
+    for ( int i = 0 ; i < 5 ; ++i ){
+        const bool discarded = i < 3;
+        QCOMPARE(stack.command(i)->isObsolete(),discarded);
+        QCOMPARE(stack.text(i).endsWith("(discarded)"),discarded);
+    }
+}
+
+// undoing the oldest live step takes the discarded ones with it, they
+// leave nothing to undo and the shape keeps their moves
+void tst_Commands::undoDropsDiscarded()
+{
+    addRects(1);
+    QGraphicsItem * item = m_items.first();
+    const QPointF start = item->pos();
+    UndoStack stack;
+    qint64 cost = 0;
+    for ( int i = 0 ; i < 5 ; ++i ){
+        BatchShapeCommand * command = new BatchShapeCommand(m_scene,"Move");
+        item->moveBy(1,0);
+        command->addMove(item,QPointF(1,0));
+        stack.push(command);
+        if ( i == 0 )
+            cost = stack.memoryUsed();
+    }
+    stack.setMemoryBudget(2 * cost);
+
+    stack.undo();
+    QVERIFY(stack.canUndo());
+    QCOMPARE(item->pos(),start + QPointF(4,0));
+    stack.undo();
+    QVERIFY(!stack.canUndo());
+    QCOMPARE(stack.index(),0);
+    QCOMPARE(stack.count(),2);
+    QCOMPARE(item->pos(),start + QPointF(3,0));
+
+    stack.redo();
+    stack.redo();
+    QVERIFY(!stack.canRedo());
+    QCOMPARE(item->pos(),start + QPointF(5,0));
+}
+
+QTEST_MAIN(tst_Commands)
+
+#include "tst_commands.moc"
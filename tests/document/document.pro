@@ -0,0 +1,6 @@
+TARGET = tst_document
+TEMPLATE = app
+
+include(../tests.pri)
+
+SOURCES += tst_document.cpp
@@ -0,0 +1,375 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "scenegenerator.h"
+#include "drawscene.h"
+#include "drawobj.h"
+#include "document.h"
+#include "documentloader.h"
+
+// A shape record with its numbers in the order they are stored, and the
+// records of the children of a group.
+struct Record
+{
+    int kind;
+    QVector<qreal> values;
+    QList<Record> children;
+};
+
+static bool readRecord( QDataStream & stream , Record * record )
+{
+    quint8 kind = 0;
+    quint32 size = 0;
+    stream >> kind >> size;
+    if ( stream.status() != QDataStream::Ok )
+        return false;
+    const qint64 end = stream.device()->pos() + size;
+    record->kind = kind;
+
+    // x, y, z, rotation, width and height, a group has no z and no size
+    const int reals = kind == GroupRecord ? 3 : kind == RoundRectRecord ? 8 : 6;
+    for ( int i = 0 ; i < reals ; ++i ){
+        qreal value = 0;
+        stream >> value;
+        record->values.append(value);
+    }
+    quint32 count = 0;
+    switch ( kind ) {
+    case RectRecord:
+    case RoundRectRecord:
+        break;
+    case EllipseRecord:
+    {
+        qint32 startAngle = 0;
+        qint32 spanAngle = 0;
+        stream >> startAngle >> spanAngle;
+        record->values << startAngle << spanAngle;
+    }
+        break;
+    case PolygonRecord:
+    case BezierRecord:
+    case PolylineRecord:
+    case LineRecord:
+        stream >> count;
+        record->values.append(count);
+        for ( quint32 i = 0 ; i < 2 * count && stream.status() == QDataStream::Ok ; ++i ){
+            qreal value = 0;
+            stream >> value;
+            record->values.append(value);
+        }
+        break;
+    case GroupRecord:
+        stream >> count;
+        for ( quint32 i = 0 ; i < count && stream.status() == QDataStream::Ok ; ++i ){
+            Record child;
+            if ( !readRecord(stream,&child) )
+                return false;
+            record->children.append(child);
+        }
+        break;
+    default:
+        return false;
+    }
+    return stream.status() == QDataStream::Ok && stream.device()->pos() == end;
+}
+
+// the records of a snapshot, empty with ok cleared if they do not parse
+static QList<Record> readRecords( const QByteArray & bytes , bool * ok )
+{
+    QDataStream stream(bytes);
+    DocumentLoader::setupBinaryStream(stream);
+    QList<Record> records;
+    *ok = true;
+    while ( !stream.atEnd() ) {
+        Record record;
+        if ( !readRecord(stream,&record) ){
+            *ok = false;
+            return QList<Record>();
+        }
+        records.append(record);
+    }
+    return records;
+}
+
+// numbers written as xml text keep six significant digits
+static bool sameValue( qreal a , qreal b )
+{
+    return qAbs(a - b) <= 1e-4 * qMax(qreal(1),qMax(qAbs(a),qAbs(b)));
+}
+
+// empty if the records match, where they differ otherwise
+static QString compareRecords( const QList<Record> & expected , const QList<Record> & actual ,
+                               const QString & path = QString() )
+{
+    if ( expected.size() != actual.size() )
+        return QString("%1: %2 records, expected %3").arg(path).arg(actual.size()).arg(expected.size());
+    for ( int i = 0 ; i < expected.size() ; ++i ){
+        const Record & a = expected.at(i);
+        const Record & b = actual.at(i);
+        const QString where = QString("%1/%2").arg(path).arg(i);
+        if ( a.kind != b.kind )
+            return QString("%1: kind %2, expected %3").arg(where).arg(b.kind).arg(a.kind);
+        if ( a.values.size() != b.values.size() )
+            return QString("%1: %2 values, expected %3").arg(where).arg(b.values.size()).arg(a.values.size());
+        for ( int j = 0 ; j < a.values.size() ; ++j ){
+            if ( !sameValue(a.values.at(j),b.values.at(j)) )
+                return QString("%1: value %2 is %3, expected %4").arg(where).arg(j)
+                        .arg(b.values.at(j)).arg(a.values.at(j));
+        }
+        const QString children = compareRecords(a.children,b.children,where);
+        if ( !children.isEmpty() )
+            return children;
+    }
+    return QString();
+}
+
+static QString compareSnapshots( const Document & expected , const Document & actual )
+{
+    bool ok = false;
+    const QList<Record> a = readRecords(expected.snapshot().records,&ok);
+    if ( !ok || a.isEmpty() )
+        return "the records saved do not parse";
+    const QList<Record> b = readRecords(actual.snapshot().records,&ok);
+    if ( !ok )
+        return "the records read back do not parse";
+    return compareRecords(a,b);
+}
+
+// Both formats read back the records they were saved from, and a binary
+// drawing with changes appended replays them into the drawing last saved.
+class tst_Document : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void journalMoves();
+    void journalAppends();
+    void journalRemovals();
+    void journalRejoins();
+
+private:
+    QString journalCopy( const QString & name );
+    QString appendAndReload( Document * document , const QString & fileName );
+
+    QTemporaryDir m_dir;
+    QString m_xmlFile;
+    QString m_binaryFile;
+};
+
+// a generated drawing, with groups, and a few shapes turned since the
+// generator writes none
+void tst_Document::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    const QString generated = m_dir.path() + "/generated.xml";
+    SceneGenerator generator;
+    generator.setShapeCount(500);
+    QVERIFY(generator.write(generated));
+
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY2(document.load(generated),qPrintable(document.errorString()));
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    QVERIFY(shapes.size() > 20);
+    for ( int i = 0 ; i < shapes.size() ; i += 5 ){
+        if ( !qgraphicsitem_cast<GraphicsItemGroup*>(shapes.at(i)) )
+            shapes.at(i)->setRotation(30);
+    }
+    m_xmlFile = m_dir.path() + "/start.xml";
+    m_binaryFile = m_dir.path() + "/start.qdrw";
+    QVERIFY2(document.save(m_xmlFile),qPrintable(document.errorString()));
+    QVERIFY2(document.save(m_binaryFile),qPrintable(document.errorString()));
+}
+
+void tst_Document::roundTrip_data()
+{
+    QTest::addColumn<QStringList>("formats");
+    QTest::newRow("xml binary xml") << (QStringList() << "xml" << "qdrw" << "xml");
+    QTest::newRow("binary xml binary") << (QStringList() << "qdrw" << "xml" << "qdrw");
+}
+
+// every load has the records of the first one
+void tst_Document::roundTrip()
+{
+    QFETCH(QStringList,formats);
+    QString fileName = formats.first() == "xml" ? m_xmlFile : m_binaryFile;
+
+    DrawScene first;
+    Document expected(&first);
+    QVERIFY2(expected.load(fileName),qPrintable(expected.errorString()));
+    for ( int i = 1 ; i < formats.size() ; ++i ){
+        DrawScene saved;
+        Document document(&saved);
+        QVERIFY(document.load(fileName));
+        fileName = m_dir.path() + QString("/trip%1.%2").arg(i).arg(formats.at(i));
+        QVERIFY2(document.save(fileName),qPrintable(document.errorString()));
+
+        DrawScene scene;
+        Document loaded(&scene);
+        QVERIFY2(loaded.load(fileName),qPrintable(loaded.errorString()));
+        QCOMPARE(scene.sceneRect(),first.sceneRect());
+        const QString difference = compareSnapshots(expected,loaded);
+        QVERIFY2(difference.isEmpty(),qPrintable(difference));
+    }
+}
+
+QString tst_Document::journalCopy(const QString &name)
+{
+    const QString fileName = m_dir.path() + "/" + name + ".qdrw";
+    QFile::remove(fileName);
+    return QFile::copy(m_binaryFile,fileName) ? fileName : QString();
+}
+
+// empty if the save appended to fileName and a load of it has the records
+// of the drawing saved, what went wrong otherwise
+QString tst_Document::appendAndReload(Document *document, const QString &fileName)
+{
+    QFile file(fileName);
+    if ( !file.open(QFile::ReadOnly) )
+        return file.errorString();
+    const QByteArray before = file.readAll();
+    file.close();
+    if ( !document->save(fileName) )
+        return document->errorString();
+    if ( !file.open(QFile::ReadOnly) )
+        return file.errorString();
+    const QByteArray after = file.readAll();
+    file.close();
+    if ( after.size() <= before.size() || !after.startsWith(before) )
+        return "the save did not append the changes";
+
+    DrawScene scene;
+    Document loaded(&scene);
+    if ( !loaded.load(fileName) )
+        return loaded.errorString();
+    return compareSnapshots(*document,loaded);
+}
+
+void tst_Document::journalMoves()
+{
+    const QString fileName = journalCopy("moves");
+    QVERIFY(!fileName.isEmpty());
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY(document.load(fileName));
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    for ( int i = 0 ; i < shapes.size() ; i += 7 )
+        shapes.at(i)->moveBy(15,-10);
+    QString error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+
+    // the same shapes again, the later segment wins
+    for ( int i = 0 ; i < shapes.size() ; i += 7 )
+        shapes.at(i)->setRotation(shapes.at(i)->rotation() + 45);
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+}
+
+// new shapes take the keys after the loaded ones, and keep them
+void tst_Document::journalAppends()
+{
+    const QString fileName = journalCopy("appends");
+    QVERIFY(!fileName.isEmpty());
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY(document.load(fileName));
+    QList<QGraphicsItem*> added;
+    for ( int i = 0 ; i < 10 ; ++i ){
+        AbstractShape * item = i % 2 ? static_cast<AbstractShape*>(new GraphicsEllipseItem(QRect(-20,-15,40,30)))
+                                     : static_cast<AbstractShape*>(new GraphicsRectItem(QRect(-20,-15,40,30)));
+        item->setPos(50 + 40 * i,60);
+        scene.addItem(item);
+        added.append(item);
+    }
+    QString error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+
+    added.first()->moveBy(5,5);
+    added.last()->setRotation(90);
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+}
+
+void tst_Document::journalRemovals()
+{
+    const QString fileName = journalCopy("removals");
+    QVERIFY(!fileName.isEmpty());
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY(document.load(fileName));
+
+    // a shape added and removed between two saves was never written
+    GraphicsRectItem * transient = new GraphicsRectItem(QRect(-10,-10,20,20));
+    scene.addItem(transient);
+    scene.removeItem(transient);
+    delete transient;
+
+    const QList<QGraphicsItem*> shapes = scene.shapes();
+    for ( int i = 0 ; i < shapes.size() ; i += 5 ){
+        scene.removeItem(shapes.at(i));
+        delete shapes.at(i);
+    }
+    QString error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+
+    // the keys after a removed one still reach their shapes
+    QList<QGraphicsItem*> rest = scene.shapes();
+    rest.last()->moveBy(-20,0);
+    scene.removeItem(rest.first());
+    delete rest.first();
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+}
+
+// a shape back on the top level stacks above the others, the journal
+// drops it at its old key and adds it at a new one
+void tst_Document::journalRejoins()
+{
+    const QString fileName = journalCopy("rejoins");
+    QVERIFY(!fileName.isEmpty());
+    DrawScene scene;
+    Document document(&scene);
+    QVERIFY(document.load(fileName));
+
+    // a delete undone before the save
+    QList<QGraphicsItem*> shapes = scene.shapes();
+    QGraphicsItem * restored = shapes.at(shapes.size() / 2);
+    scene.removeItem(restored);
+    scene.addItem(restored);
+    QCOMPARE(scene.shapes().last(),restored);
+    QString error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+
+    // grouped in one save, back on their own in the next
+    shapes = scene.shapes();
+    QList<QGraphicsItem*> members;
+    foreach (QGraphicsItem *item, shapes) {
+        if ( !qgraphicsitem_cast<GraphicsItemGroup*>(item) && members.size() < 3 )
+            members.append(item);
+    }
+    QCOMPARE(members.size(),3);
+    GraphicsItemGroup * group = scene.createGroup(members);
+    QVERIFY(group);
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+    scene.destroyGroup(group);
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+
+    // a group of the loaded drawing taken apart
+    GraphicsItemGroup * loadedGroup = NULL;
+    foreach (QGraphicsItem *item, scene.shapes()) {
+        if ( !loadedGroup )
+            loadedGroup = qgraphicsitem_cast<GraphicsItemGroup*>(item);
+    }
+    QVERIFY(loadedGroup);
+    scene.destroyGroup(loadedGroup);
+    error = appendAndReload(&document,fileName);
+    QVERIFY2(error.isEmpty(),qPrintable(error));
+}
+
+QTEST_MAIN(tst_Document)
+
+#include "tst_document.moc"
@@ -0,0 +1,6 @@
+TARGET = tst_shapeindex
+TEMPLATE = app
+
+include(../tests.pri)
+
+SOURCES += tst_shapeindex.cpp
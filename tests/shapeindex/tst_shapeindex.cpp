@@ -0,0 +1,256 @@
+#include <QtTest>
+#include <QGraphicsRectItem>
+#include "shapeindex.h"
+
+// The R-tree against a brute force search over the same bounds, through
+// packing, inserts, moves and removals.
+class tst_ShapeIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void empty();
+    void intersecting_data();
+    void intersecting();
+    void containing();
+    void nearest();
+    void moveAndRemove();
+    void packedThenUpdated();
+
+private:
+    QRectF randomRect();
+    QPointF randomPoint();
+    void fill( int count );
+    QList<QGraphicsItem *> expectedIn( const QRectF & rect ) const;
+    static QSet<QGraphicsItem *> toSet( const QList<QGraphicsItem *> & items );
+
+    QList<QGraphicsItem *> m_items;
+    QHash<QGraphicsItem *,QRectF> m_bounds;
+    quint32 m_state;
+};
+
+void tst_ShapeIndex::init()
+{
+    m_state = 1;
+}
+
+void tst_ShapeIndex::cleanup()
+{
+    qDeleteAll(m_items);
+    m_items.clear();
+    m_bounds.clear();
+}
+
+// xorshift, the same rectangles on every run
+QRectF tst_ShapeIndex::randomRect()
+{
+    const QPointF topLeft = randomPoint();
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return QRectF(topLeft,QSizeF(1 + m_state % 50,1 + m_state / 50 % 50));
+}
+
+QPointF tst_ShapeIndex::randomPoint()
+{
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return QPointF(m_state % 1000,m_state / 1000 % 1000);
+}
+
+void tst_ShapeIndex::fill(int count)
+{
+    for ( int i = 0 ; i < count ; ++i ){
+        QGraphicsItem * item = new QGraphicsRectItem;
+        m_items.append(item);
+        m_bounds.insert(item,randomRect());
+    }
+}
+
+// bounds that only touch count, as they do for the index
+static bool overlaps( const QRectF & a , const QRectF & b )
+{
+    return a.left() <= b.right() && b.left() <= a.right() &&
+           a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
+QList<QGraphicsItem *> tst_ShapeIndex::expectedIn(const QRectF &rect) const
+{
+    QList<QGraphicsItem *> items;
+    foreach (QGraphicsItem *item, m_items) {
+        if ( overlaps(m_bounds.value(item),rect) )
+            items.append(item);
+    }
+    return items;
+}
+
+QSet<QGraphicsItem *> tst_ShapeIndex::toSet(const QList<QGraphicsItem *> &items)
+{
+    QSet<QGraphicsItem *> set;
+    foreach (QGraphicsItem *item, items) {
+        set.insert(item);
+    }
+    return set;
+}
+
+void tst_ShapeIndex::empty()
+{
+    ShapeIndex index;
+    QCOMPARE(index.size(),0);
+    QVERIFY(index.intersecting(QRectF(0,0,100,100)).isEmpty());
+    QVERIFY(index.containing(QPointF(10,10)).isEmpty());
+    QVERIFY(!index.nearest(QPointF(10,10)));
+}
+
+void tst_ShapeIndex::intersecting_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("packed");
+    QTest::newRow("few inserted") << 10 << false;
+    QTest::newRow("many inserted") << 2000 << false;
+    QTest::newRow("many packed") << 2000 << true;
+}
+
+void tst_ShapeIndex::intersecting()
+{
+    QFETCH(int,count);
+    QFETCH(bool,packed);
+    fill(count);
+
+    ShapeIndex index;
+    if ( packed ){
+        QVector<ShapeIndex::Entry> entries;
+        foreach (QGraphicsItem *item, m_items) {
+            ShapeIndex::Entry entry;
+            entry.item = item;
+            entry.bounds = m_bounds.value(item);
+            entries.append(entry);
+        }
+        index.load(entries);
+    }else{
+        foreach (QGraphicsItem *item, m_items) {
+            index.insert(item,m_bounds.value(item));
+        }
+    }
+    QCOMPARE(index.size(),count);
+
+    for ( int i = 0 ; i < 100 ; ++i ){
+        const QRectF query = randomRect().adjusted(-20,-20,20,20);
+        QCOMPARE(toSet(index.intersecting(query)),toSet(expectedIn(query)));
+    }
+}
+
+void tst_ShapeIndex::containing()
+{
+    fill(1000);
+    ShapeIndex index;
+    foreach (QGraphicsItem *item, m_items) {
+        index.insert(item,m_bounds.value(item));
+    }
+    for ( int i = 0 ; i < 100 ; ++i ){
+        const QPointF pos = randomPoint();
+        QCOMPARE(toSet(index.containing(pos)),toSet(expectedIn(QRectF(pos,pos))));
+    }
+}
+
+// any of the items at the smallest distance will do
+void tst_ShapeIndex::nearest()
+{
+    fill(500);
+    ShapeIndex index;
+    foreach (QGraphicsItem *item, m_items) {
+        index.insert(item,m_bounds.value(item));
+    }
+    for ( int i = 0 ; i < 100 ; ++i ){
+        const QPointF pos = randomPoint();
+        qreal best = -1;
+        foreach (QGraphicsItem *item, m_items) {
+            const QRectF rect = m_bounds.value(item);
+            const qreal dx = qMax(qMax(rect.left() - pos.x(),pos.x() - rect.right()),qreal(0));
+            const qreal dy = qMax(qMax(rect.top() - pos.y(),pos.y() - rect.bottom()),qreal(0));
+            const qreal distance = dx * dx + dy * dy;
+            if ( best < 0 || distance < best )
+                best = distance;
+        }
+        QGraphicsItem * found = index.nearest(pos);
+        QVERIFY(found);
+        const QRectF rect = m_bounds.value(found);
+        const qreal dx = qMax(qMax(rect.left() - pos.x(),pos.x() - rect.right()),qreal(0));
+        const qreal dy = qMax(qMax(rect.top() - pos.y(),pos.y() - rect.bottom()),qreal(0));
+        QCOMPARE(dx * dx + dy * dy,best);
+    }
+}
+
+void tst_ShapeIndex::moveAndRemove()
+{
+    fill(1000);
+    ShapeIndex index;
+    foreach (QGraphicsItem *item, m_items) {
+        index.insert(item,m_bounds.value(item));
+    }
+
+    // every third item moves, every fifth goes
+    for ( int i = 0 ; i < m_items.size() ; i += 3 ){
+        m_bounds.insert(m_items.at(i),randomRect());
+        index.insert(m_items.at(i),m_bounds.value(m_items.at(i)));
+    }
+    QList<QGraphicsItem *> removed;
+    for ( int i = 0 ; i < m_items.size() ; i += 5 )
+        removed.append(m_items.at(i));
+    foreach (QGraphicsItem *item, removed) {
+        index.remove(item);
+        m_items.removeOne(item);
+        m_bounds.remove(item);
+    }
+    QCOMPARE(index.size(),m_items.size());
+    foreach (QGraphicsItem *item, removed) {
+        QVERIFY(!index.contains(item));
+    }
+    qDeleteAll(removed);
+
+    const QRectF everything(-100,-100,1200,1200);
+    QCOMPARE(toSet(index.intersecting(everything)),toSet(m_items));
+    for ( int i = 0 ; i < 100 ; ++i ){
+        const QRectF query = randomRect().adjusted(-20,-20,20,20);
+        QCOMPARE(toSet(index.intersecting(query)),toSet(expectedIn(query)));
+    }
+}
+
+// a loaded drawing is packed, edits after it go through the tree in place
+void tst_ShapeIndex::packedThenUpdated()
+{
+    fill(1500);
+    QVector<ShapeIndex::Entry> entries;
+    foreach (QGraphicsItem *item, m_items) {
+        ShapeIndex::Entry entry;
+        entry.item = item;
+        entry.bounds = m_bounds.value(item);
+        entries.append(entry);
+    }
+    ShapeIndex index;
+    index.load(entries);
+
+    fill(500);
+    for ( int i = 1500 ; i < m_items.size() ; ++i )
+        index.insert(m_items.at(i),m_bounds.value(m_items.at(i)));
+    for ( int i = 0 ; i < 1500 ; i += 2 ){
+        m_bounds.insert(m_items.at(i),randomRect());
+        index.insert(m_items.at(i),m_bounds.value(m_items.at(i)));
+    }
+    QCOMPARE(index.size(),m_items.size());
+    for ( int i = 0 ; i < 100 ; ++i ){
+        const QRectF query = randomRect().adjusted(-20,-20,20,20);
+        QCOMPARE(toSet(index.intersecting(query)),toSet(expectedIn(query)));
+    }
+
+    index.clear();
+    QCOMPARE(index.size(),0);
+    QVERIFY(index.intersecting(QRectF(-100,-100,1200,1200)).isEmpty());
+}
+
+QTEST_MAIN(tst_ShapeIndex)
+
+#include "tst_shapeindex.moc"
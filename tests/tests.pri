@@ -0,0 +1,42 @@
+# the drawing code of the app without its windows, as qdraw-cli builds it,
+# and the scene generator of the cli for drawings of any size
+
+QT       += core gui xml svg testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../app $$PWD/../cli
+DEPENDPATH += $$PWD/../app $$PWD/../cli
+
+SOURCES += \
+    $$PWD/../cli/scenegenerator.cpp \
+    $$PWD/../app/commands.cpp \
+    $$PWD/../app/drawobj.cpp \
+    $$PWD/../app/drawscene.cpp \
+    $$PWD/../app/drawtool.cpp \
+    $$PWD/../app/sizehandle.cpp \
+    $$PWD/../app/document.cpp \
+    $$PWD/../app/documentloader.cpp \
+    $$PWD/../app/documentwriter.cpp \
+    $$PWD/../app/tilecache.cpp \
+    $$PWD/../app/shapeindex.cpp \
+    $$PWD/../app/snapengine.cpp \
+    $$PWD/../app/tilerenderer.cpp
+
+HEADERS += \
+    $$PWD/../cli/scenegenerator.h \
+    $$PWD/../app/commands.h \
+    $$PWD/../app/drawobj.h \
+    $$PWD/../app/drawscene.h \
+    $$PWD/../app/drawtool.h \
+    $$PWD/../app/sizehandle.h \
+    $$PWD/../app/document.h \
+    $$PWD/../app/documentloader.h \
+    $$PWD/../app/documentwriter.h \
+    $$PWD/../app/tilecache.h \
+    $$PWD/../app/shapeindex.h \
+    $$PWD/../app/snapengine.h \
+    $$PWD/../app/tilerenderer.h
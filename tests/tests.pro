@@ -0,0 +1,12 @@
+#-------------------------------------------------
+#
+# unit tests and benchmarks of the drawing code, run with make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+SUBDIRS += \
+    shapeindex \
+    commands \
+    document \
+    benchmarks